@@ -0,0 +1,319 @@
+// times every stage of the encoder separately, for every version, error correction level and kind of payload
+// (each payload is as long as its version holds, so that it fills the code)
+// the stages call the same functions as quer_encode:
+//     fill: planning the segments, writing them, the terminator and the padding
+//     rs: the correction codewords of all blocks and the interleaving
+//     patterns: drawing the function patterns (quer_encode does it once per version and caches the result)
+//     placement: placing the codewords in the data modules
+//     masks: evaluating the penalty of all 8 masks
+//     raster: rendering every pixel row of the image at 4 pixels per module
+//     encode: the whole quer_encode
+//     plan: quer_plan, finding the version without encoding
+// output: CSV (or JSON with --json) with one row per version, level, payload and stage,
+// ns_per_op is the fastest of ROUNDS rounds, codes_per_s the number of codes per second the stage alone would allow
+// and peak_rss_kb the peak resident set size of the process so far
+// usage: encode_bench [--json] [min_version max_version]
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/resource.h>
+#include <time.h>
+
+#include "../bitstream.h"
+#include "../decoder.h"
+#include "../penalty.h"
+#include "../quer.h"
+#include "../raster.h"
+#include "../reed_solomon.h"
+#include "../segments.h"
+#include "../tables.h"
+#include "../templates.h"
+
+#define ROUNDS 3
+#define MIN_ROUND_NS 1000000.0
+#define PPM 4
+
+enum payload_t {
+    PAYLOAD_NUMERIC,
+    PAYLOAD_ALPHANUMERIC,
+    PAYLOAD_BYTE,
+    PAYLOAD_KANJI,
+    N_PAYLOADS,
+};
+
+enum stage_t {
+    STAGE_FILL,
+    STAGE_RS,
+    STAGE_PATTERNS,
+    STAGE_PLACEMENT,
+    STAGE_MASKS,
+    STAGE_RASTER,
+    STAGE_ENCODE,
+    STAGE_PLAN,
+    N_STAGES,
+};
+
+// everything a stage needs, the output of every stage is kept so that the next one starts from it
+typedef struct bench_t {
+    const uint8_t *data;
+    int data_len;
+    quer_options_t options;
+    int version;
+    int dim;
+    const version_template_t *template;
+    uint8_t segments_mem[SEGMENTS_MEM_SIZE(QUER_MAX_INPUT_LEN)];
+    uint8_t modes[QUER_MAX_INPUT_LEN];
+    uint8_t values[MAX_CODEWORDS];
+    uint8_t codewords[MAX_CODEWORDS];
+    bitset_t code;
+    bitset_t blocked;
+    raster_t raster;
+    uint8_t *row;
+    void *scratch;
+    quer_code_t encoded;
+    void *plan_scratch;
+    quer_plan_t plan;
+} bench_t;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static volatile int sink;
+
+static void stage_fill(bench_t *b) {
+    int group = version_group(b->version);
+    plan_segments(b->data, b->data_len, group, b->options.kanji, b->segments_mem, b->modes);
+    bitstream_t bitstream = {.values = b->values, .len_bytes = 0, .len_bits = 0};
+    write_segments(&bitstream, b->data, b->data_len, b->modes, group, b->options.eci);
+    int total_bits = TOTAL_DATA_CODEWORDS[b->options.corr_level][b->version] * 8;
+    add_bits_to_stream(&bitstream, 0, total_bits - bitstream.len_bits >= 4 ? 4 : total_bits - bitstream.len_bits);
+    if (bitstream.len_bits % 8 > 0)
+        add_bits_to_stream(&bitstream, 0, 8 - bitstream.len_bits % 8);
+    for (int pad_byte = 0b11101100; bitstream.len_bits < total_bits; pad_byte ^= 0b11101100 ^ 0b00010001)
+        add_bits_to_stream(&bitstream, pad_byte, 8);
+}
+
+static void stage_rs(bench_t *b) {
+    int level = b->options.corr_level;
+    int n_blocks = TOTAL_BLOCKS[level][b->version];
+    int n_corr_codewords = CORR_CODEWORDS_PER_BLOCK[level][b->version];
+    int n_all_codewords = TOTAL_AVAILABLE_MODULES[b->version] / 8;
+    int corr_offset = TOTAL_DATA_CODEWORDS[level][b->version];
+    int n_small_blocks = n_blocks - n_all_codewords % n_blocks;
+    int small_block_len = n_all_codewords / n_blocks - n_corr_codewords;
+    uint8_t corr_codewords[MAX_DEGREE];
+    for (int i = 0, block_start = 0; i < n_blocks; i++) {
+        int block_len = small_block_len + (i >= n_small_blocks);
+        compute_corr_codewords(b->values + block_start, block_len, n_corr_codewords, corr_codewords);
+        for (int j = 0, idx = i; j < block_len; j++, idx += n_blocks)
+            b->codewords[j == small_block_len ? idx - n_small_blocks : idx] = b->values[block_start + j];
+        for (int j = 0; j < n_corr_codewords; j++)
+            b->codewords[corr_offset + i + n_blocks * j] = corr_codewords[j];
+        block_start += block_len;
+    }
+}
+
+static void stage_patterns(bench_t *b) {
+    bitset_reset(&b->code, b->dim, b->dim);
+    bitset_reset(&b->blocked, b->dim, b->dim);
+    draw_functional_patterns(&b->code, b->version, b->dim, &b->blocked);
+}
+
+static void stage_placement(bench_t *b) {
+    bitset_copy(&b->code, &b->template->code);
+    draw_data(&b->code, b->template, b->codewords, TOTAL_AVAILABLE_MODULES[b->version] / 8);
+}
+
+static void stage_masks(bench_t *b) {
+    for (int mask = 0; mask < N_MASKS; mask++) {
+        bitset_xor(&b->code, &b->template->masks[mask]);
+        sink += get_penalty(&b->code, b->dim);
+        bitset_xor(&b->code, &b->template->masks[mask]);
+    }
+}
+
+static void stage_raster(bench_t *b) {
+    for (int y = 0; y < b->raster.height; y++) {
+        int module_row = raster_module_row(&b->raster, y);
+        for (size_t start = 0; start < (size_t)b->raster.row_bytes; start += RASTER_CHUNK_BYTES)
+            raster_render(&b->raster, module_row, start, raster_chunk_len(&b->raster, start), b->row + start);
+    }
+}
+
+static void stage_encode(bench_t *b) {
+    sink += quer_encode((const char *)b->data, b->data_len, &b->options, b->scratch, quer_scratch_size(),
+                        &b->encoded);
+}
+
+static void stage_plan(bench_t *b) {
+    sink += quer_plan((const char *)b->data, b->data_len, &b->options, b->plan_scratch, quer_plan_scratch_size(),
+                      &b->plan);
+}
+
+static void (*const stages[N_STAGES])(bench_t *) = {
+    stage_fill, stage_rs, stage_patterns, stage_placement, stage_masks, stage_raster, stage_encode, stage_plan,
+};
+
+// the fastest round, in ns per run of the stage
+static double time_stage(enum stage_t stage, bench_t *b) {
+    double best = -1;
+    for (int round = 0; round < ROUNDS; round++) {
+        long iters = 0;
+        double start = now_ns(), elapsed;
+        do {
+            stages[stage](b);
+            iters++;
+            elapsed = now_ns() - start;
+        } while (elapsed < MIN_ROUND_NS);
+        if (best < 0 || elapsed / iters < best)
+            best = elapsed / iters;
+    }
+    return best;
+}
+
+// fills data with the given kind of characters, Kanji as Shift JIS (two bytes each)
+static void make_payload(enum payload_t payload, uint8_t *data, int len) {
+    static const char alphanumeric[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+    unsigned seed = 1;
+    for (int i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned r = seed >> 16;
+        switch (payload) {
+            case PAYLOAD_NUMERIC:
+                data[i] = '0' + r % 10;
+                break;
+            case PAYLOAD_ALPHANUMERIC:
+                data[i] = alphanumeric[r % (sizeof(alphanumeric) - 1)];
+                break;
+            case PAYLOAD_BYTE:
+                data[i] = r;
+                break;
+            default:
+                // lead bytes 0x89-0x9f, trail bytes 0x40-0xfc without 0x7f
+                data[i] = (i % 2 == 0 ? 0x89 + r % 23 : 0x40 + r % 188);
+                if (i % 2 == 1 && data[i] == 0x7f)
+                    data[i] = 0x80;
+        }
+    }
+}
+
+// the longest prefix of data that still fits in the version (whole characters for Kanji), 0 if there's none
+static int fill_version(bench_t *b, int max_len) {
+    int step = (b->options.kanji ? 2 : 1), lo = 0, hi = max_len / step;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        quer_code_t code;
+        if (quer_encode((const char *)b->data, mid * step, &b->options, b->scratch, quer_scratch_size(), &code) ==
+                QUER_OK &&
+            code.version <= b->version)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo * step;
+}
+
+// whether the stages produced the same data modules as quer_encode (the function patterns and format info differ)
+static int matches_encode(bench_t *b) {
+    bitset_xor(&b->code, &b->template->masks[b->encoded.mask]);
+    int ok = 1;
+    for (int r = 0; r < b->dim; r++) {
+        const uint64_t *code = bitset_const_row(&b->code, r), *encoded = bitset_const_row(b->encoded.modules, r),
+                       *blocked = bitset_const_row(&b->template->blocked, r);
+        for (int i = 0; i < b->code.stride; i++)
+            ok &= ((code[i] ^ encoded[i]) & ~blocked[i]) == 0;
+    }
+    bitset_xor(&b->code, &b->template->masks[b->encoded.mask]);
+    return ok;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+int main(int argc, char **argv) {
+    static const char *level_names[4] = {"L", "M", "Q", "H"};
+    static const char *payload_names[N_PAYLOADS] = {"numeric", "alphanumeric", "byte", "kanji"};
+    static const char *stage_names[N_STAGES] = {"fill",  "rs",     "patterns", "placement",
+                                                "masks", "raster", "encode",   "plan"};
+    int json = 0, min_version = QUER_MIN_VERSION, max_version = QUER_MAX_VERSION;
+    if (argc > 1 && strcmp(argv[1], "--json") == 0) {
+        json = 1;
+        argc--;
+        argv++;
+    }
+    if (argc == 3) {
+        min_version = atoi(argv[1]);
+        max_version = atoi(argv[2]);
+    }
+    if (min_version < QUER_MIN_VERSION || max_version > QUER_MAX_VERSION || min_version > max_version) {
+        fprintf(stderr, "usage: encode_bench [--json] [min_version max_version]\n");
+        return EXIT_FAILURE;
+    }
+
+    static bench_t b;
+    static uint8_t data[QUER_MAX_INPUT_LEN];
+    b.data = data;
+    b.scratch = malloc(quer_scratch_size());
+    b.plan_scratch = malloc(quer_plan_scratch_size());
+    if (b.scratch == NULL || b.plan_scratch == NULL || bitset_init(&b.code, 0, 0) == -1 ||
+        bitset_init(&b.blocked, 0, 0) == -1)
+        return EXIT_FAILURE;
+    int n_failures = 0, first = 1;
+    printf(json ? "[\n" : "version,level,payload,stage,ns_per_op,codes_per_s,peak_rss_kb\n");
+    for (int version = min_version; version <= max_version; version++) {
+        for (int level = QUER_CORR_L; level <= QUER_CORR_H; level++) {
+            for (int payload = 0; payload < N_PAYLOADS; payload++) {
+                b.options = (quer_options_t){.corr_level = level, .kanji = (payload == PAYLOAD_KANJI)};
+                b.version = version;
+                b.dim = 4 * version + 17;
+                b.template = get_version_template(version);
+                make_payload(payload, data, QUER_MAX_INPUT_LEN);
+                b.data_len = fill_version(&b, QUER_MAX_INPUT_LEN);
+                // the stages run in order once, so that each one starts from the output of the previous one
+                stage_fill(&b);
+                stage_rs(&b);
+                stage_patterns(&b);
+                stage_placement(&b);
+                stage_encode(&b);
+                stage_plan(&b);
+                if (b.data_len == 0 || b.encoded.version != version || b.plan.version != version ||
+                    !matches_encode(&b) ||
+                    raster_init(&b.raster, b.encoded.modules, PPM, b.dim / 5, 0) == -1) {
+                    fprintf(stderr, "version %d %s %s: the stages don't match quer_encode\n", version,
+                            level_names[level], payload_names[payload]);
+                    n_failures++;
+                    continue;
+                }
+                uint8_t *row = realloc(b.row, b.raster.row_bytes);
+                if (row == NULL)
+                    return EXIT_FAILURE;
+                b.row = row;
+                for (int stage = 0; stage < N_STAGES; stage++) {
+                    double ns = time_stage(stage, &b);
+                    if (json)
+                        printf("%s  {\"version\": %d, \"level\": \"%s\", \"payload\": \"%s\", \"stage\": \"%s\", "
+                               "\"ns_per_op\": %.0f, \"codes_per_s\": %.0f, \"peak_rss_kb\": %ld}",
+                               first ? "" : ",\n", version, level_names[level], payload_names[payload],
+                               stage_names[stage], ns, 1e9 / ns, peak_rss_kb());
+                    else
+                        printf("%d,%s,%s,%s,%.0f,%.0f,%ld\n", version, level_names[level], payload_names[payload],
+                               stage_names[stage], ns, 1e9 / ns, peak_rss_kb());
+                    first = 0;
+                }
+            }
+        }
+    }
+    if (json)
+        printf("\n]\n");
+    free(b.row);
+    free(b.scratch);
+    free(b.plan_scratch);
+    bitset_free(&b.code);
+    bitset_free(&b.blocked);
+    return n_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
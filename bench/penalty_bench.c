@@ -0,0 +1,299 @@
+// checks get_penalty against the straightforward scorer it replaced (kept below) and times both
+// every version, error correction level and mask of an encoded code is scored by both, as well as random matrices
+// (of several densities, so that streaks and finder-like patterns come up too), any difference is a failure
+// output: CSV with one row per version, ns per scoring of a code by each scorer
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../penalty.h"
+#include "../quer.h"
+#include "../tables.h"
+#include "../templates.h"
+
+#define N_RANDOM 16
+#define MIN_NS 20000000.0
+
+static unsigned seed = 1;
+
+static unsigned next_random(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int check_finder_pattern_ver(const bitset_t *code, int y, int x, int r, int dir) {
+    int pos = y;
+    for (int i = 0; i < r; i++) {
+        if (!bitset_get(code, pos, x))
+            return 0;
+        pos += dir;
+    }
+    for (int i = 0; i < r; i++) {
+        if (bitset_get(code, pos, x))
+            return 0;
+        pos += dir;
+    }
+    for (int i = 0; i < 3 * r; i++) {
+        if (!bitset_get(code, pos, x))
+            return 0;
+        pos += dir;
+    }
+    for (int i = 0; i < r; i++) {
+        if (bitset_get(code, pos, x))
+            return 0;
+        pos += dir;
+    }
+    for (int i = 0; i < r; i++) {
+        if (!bitset_get(code, pos, x))
+            return 0;
+        pos += dir;
+    }
+    return 1;
+}
+
+static int check_finder_pattern_hor(const bitset_t *code, int y, int x, int r, int dir) {
+    int pos = x;
+    for (int i = 0; i < r; i++) {
+        if (!bitset_get(code, y, pos))
+            return 0;
+        pos += dir;
+    }
+    for (int i = 0; i < r; i++) {
+        if (bitset_get(code, y, pos))
+            return 0;
+        pos += dir;
+    }
+    for (int i = 0; i < 3 * r; i++) {
+        if (!bitset_get(code, y, pos))
+            return 0;
+        pos += dir;
+    }
+    for (int i = 0; i < r; i++) {
+        if (bitset_get(code, y, pos))
+            return 0;
+        pos += dir;
+    }
+    for (int i = 0; i < r; i++) {
+        if (!bitset_get(code, y, pos))
+            return 0;
+        pos += dir;
+    }
+    return 1;
+}
+
+// the scorer get_penalty replaced, module by module
+static int old_get_penalty(const bitset_t *code, int dim) {
+    int penalty = 0;
+    // monochromatic streaks of >= 5 modules
+    for (int y = 0; y < dim; y++) {
+        int cur_streak = 1, prev_color = bitset_get(code, y, 0);
+        for (int x = 1; x < dim; x++) {
+            int cur_color = bitset_get(code, y, x);
+            if (cur_color == prev_color)
+                cur_streak++;
+            else {
+                if (cur_streak >= 5) {
+                    penalty += 3 + (cur_streak - 5);
+                }
+                cur_streak = 1;
+            }
+            prev_color = cur_color;
+        }
+        if (cur_streak >= 5) {
+            penalty += 3 + (cur_streak - 5);
+        }
+    }
+    for (int x = 0; x < dim; x++) {
+        int cur_streak = 1, prev_color = bitset_get(code, 0, x);
+        for (int y = 1; y < dim; y++) {
+            int cur_color = bitset_get(code, y, x);
+            if (cur_color == prev_color)
+                cur_streak++;
+            else {
+                if (cur_streak >= 5) {
+                    penalty += 3 + (cur_streak - 5);
+                }
+                cur_streak = 1;
+            }
+            prev_color = cur_color;
+        }
+        if (cur_streak >= 5) {
+            penalty += 3 + (cur_streak - 5);
+        }
+    }
+
+    // 2x2 monochromatic blocks
+    for (int y = 0; y < dim - 1; y++) {
+        for (int x = 0; x < dim - 1; x++) {
+            if (bitset_get(code, y, x) == bitset_get(code, y + 1, x) &&
+                bitset_get(code, y + 1, x) == bitset_get(code, y, x + 1) &&
+                bitset_get(code, y, x + 1) == bitset_get(code, y + 1, x + 1))
+                penalty += 3;
+        }
+    }
+
+    // 1:1:3:1:1 pattern preceded/followed by 4 light modules
+    for (int y = 0; y < dim; y++) {
+        for (int x = 0; x < dim; x++) {
+            if (y >= 4 && !(bitset_get(code, y, x) | bitset_get(code, y - 1, x) | bitset_get(code, y - 2, x) |
+                            bitset_get(code, y - 3, x))) {
+                int r = 1;
+                while (y - 3 - 7 * r >= 0) {
+                    if (check_finder_pattern_ver(code, y - 4, x, r, -1)) {
+                        penalty += 40;
+                        break;
+                    }
+                    r++;
+                }
+            }
+            if (y + 4 < dim && !(bitset_get(code, y, x) | bitset_get(code, y + 1, x) | bitset_get(code, y + 2, x) |
+                                 bitset_get(code, y + 3, x))) {
+                int r = 1;
+                while (y + 3 + 7 * r < dim) {
+                    if (check_finder_pattern_ver(code, y + 4, x, r, 1)) {
+                        penalty += 40;
+                        break;
+                    }
+                    r++;
+                }
+            }
+            if (x + 4 < dim && !(bitset_get(code, y, x) | bitset_get(code, y, x + 1) | bitset_get(code, y, x + 2) |
+                                 bitset_get(code, y, x + 3))) {
+                int r = 1;
+                while (x + 3 + 7 * r < dim) {
+                    if (check_finder_pattern_hor(code, y, x + 4, r, 1)) {
+                        penalty += 40;
+                        break;
+                    }
+                    r++;
+                }
+            }
+            if (x >= 4 && !(bitset_get(code, y, x) | bitset_get(code, y, x - 1) | bitset_get(code, y, x - 2) |
+                            bitset_get(code, y, x - 3))) {
+                int r = 1;
+                while (x - 3 - 7 * r >= 0) {
+                    if (check_finder_pattern_hor(code, y, x - 4, r, -1)) {
+                        penalty += 40;
+                        break;
+                    }
+                    r++;
+                }
+            }
+        }
+    }
+
+    // proportion of dark modules
+    int dark_count = 0;
+    for (int y = 0; y < dim; y++) {
+        for (int x = 0; x < dim; x++)
+            dark_count += bitset_get(code, y, x);
+    }
+    int proportion = (int)((double)dark_count / (dim * dim) * 100);
+    penalty += 10 * abs(proportion - 50) / 5;
+
+    return penalty;
+}
+
+static double time_scorer(int (*scorer)(const bitset_t *, int), const bitset_t *codes, int n_codes, int dim) {
+    static volatile int sink;
+    long iters = 0;
+    double start = now_ns(), elapsed;
+    do {
+        for (int i = 0; i < n_codes; i++)
+            sink += scorer(&codes[i], dim);
+        iters += n_codes;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_NS);
+    return elapsed / iters;
+}
+
+// scores the code with both scorers, returns 1 on a difference
+static int compare(const bitset_t *code, int dim, const char *what, int version, int arg) {
+    int old_penalty = old_get_penalty(code, dim), penalty = get_penalty(code, dim);
+    if (penalty == old_penalty)
+        return 0;
+    fprintf(stderr, "version %d, %s %d: get_penalty gives %d instead of %d\n", version, what, arg, penalty,
+            old_penalty);
+    return 1;
+}
+
+int main(void) {
+    const char *level_names[] = {"L", "M", "Q", "H"};
+    static char data[QUER_MAX_INPUT_LEN];
+    void *scratch = malloc(quer_scratch_size());
+    // the 4 levels x 8 masks of an encoded code, then the random matrices
+    static bitset_t codes[4 * N_MASKS + N_RANDOM];
+    if (scratch == NULL)
+        return EXIT_FAILURE;
+    for (int i = 0; i < 4 * N_MASKS + N_RANDOM; i++) {
+        if (bitset_init(&codes[i], 0, 0) == -1)
+            return EXIT_FAILURE;
+    }
+    int n_failures = 0;
+    printf("version,old_ns,new_ns,speedup\n");
+    for (int version = QUER_MIN_VERSION; version <= QUER_MAX_VERSION; version++) {
+        int dim = 4 * version + 17;
+        const version_template_t *template = get_version_template(version);
+        for (int level = QUER_CORR_L; level <= QUER_CORR_H; level++) {
+            // bytes outside of the other modes' character sets, as many as fit in the version (the byte mode header
+            // takes 2-3 codewords)
+            int data_len = TOTAL_DATA_CODEWORDS[level][version];
+            for (int i = 0; i < data_len; i++)
+                data[i] = 0x80 | next_random();
+            quer_options_t options = {.corr_level = level, .min_version = version};
+            quer_code_t code;
+            int status;
+            while (((status = quer_encode(data, data_len, &options, scratch, quer_scratch_size(), &code)) == QUER_OK &&
+                    code.version > version) ||
+                   status == QUER_ERR_TOO_LONG)
+                data_len--;
+            if (status != QUER_OK) {
+                fprintf(stderr, "version %d %s: %s\n", version, level_names[level], quer_strerror(status));
+                return EXIT_FAILURE;
+            }
+            // the data modules under every mask, with the format info of the chosen one
+            for (int mask = 0; mask < N_MASKS; mask++) {
+                bitset_t *masked = &codes[level * N_MASKS + mask];
+                if (bitset_reset(masked, dim, dim) == -1)
+                    return EXIT_FAILURE;
+                bitset_copy(masked, code.modules);
+                bitset_xor(masked, &template->masks[code.mask]);
+                bitset_xor(masked, &template->masks[mask]);
+                char what[16];
+                snprintf(what, sizeof(what), "level %s, mask", level_names[level]);
+                n_failures += compare(masked, dim, what, version, mask);
+            }
+        }
+        for (int i = 0; i < N_RANDOM; i++) {
+            bitset_t *random = &codes[4 * N_MASKS + i];
+            if (bitset_reset(random, dim, dim) == -1)
+                return EXIT_FAILURE;
+            // densities from 1/16 to 15/16
+            unsigned density = 1 + i % 15;
+            for (int y = 0; y < dim; y++) {
+                for (int x = 0; x < dim; x++) {
+                    if (next_random() % 16 < density)
+                        bitset_set(random, y, x);
+                }
+            }
+            n_failures += compare(random, dim, "random matrix", version, i);
+        }
+        double old_ns = time_scorer(old_get_penalty, codes, 4 * N_MASKS + N_RANDOM, dim);
+        double new_ns = time_scorer(get_penalty, codes, 4 * N_MASKS + N_RANDOM, dim);
+        printf("%d,%.0f,%.0f,%.2f\n", version, old_ns, new_ns, old_ns / new_ns);
+    }
+    free(scratch);
+    if (n_failures > 0) {
+        fprintf(stderr, "%d failures\n", n_failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
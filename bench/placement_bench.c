@@ -0,0 +1,72 @@
+// compares placing the codewords by walking the zigzag module by module with the precomputed placement index,
+// for every version
+// output: CSV with one row per version, ns per placement of a full set of codewords
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+
+#include "../tables.h"
+#include "../templates.h"
+
+#define MIN_ITERS 200
+#define MIN_NS 20000000.0
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double time_placement(const version_template_t *template, bitset_t *code, const uint8_t *data, int data_len,
+                             int use_index) {
+    int width = template->code.width, height = template->code.height;
+    long iters = 0;
+    double start = now_ns(), elapsed;
+    do {
+        for (int i = 0; i < MIN_ITERS; i++) {
+            bitset_copy(code, &template->code);
+            if (use_index)
+                draw_data(code, template, data, data_len);
+            else
+                draw_data_walk(code, data, data_len, width, height, &template->blocked);
+        }
+        iters += MIN_ITERS;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_NS);
+    return elapsed / iters;
+}
+
+int main(void) {
+    uint8_t data[TOTAL_AVAILABLE_MODULES[QUER_MAX_VERSION] / 8];
+    unsigned seed = 1;
+    int n_mismatches = 0;
+    bitset_t walked, indexed;
+    if (bitset_init(&walked, 0, 0) == -1 || bitset_init(&indexed, 0, 0) == -1)
+        return EXIT_FAILURE;
+    printf("version,codewords,walk_ns,index_ns,speedup\n");
+    for (int version = QUER_MIN_VERSION; version <= QUER_MAX_VERSION; version++) {
+        const version_template_t *template = get_version_template(version);
+        int dim = 4 * version + 17;
+        int data_len = TOTAL_AVAILABLE_MODULES[version] / 8;
+        for (int i = 0; i < data_len; i++) {
+            seed = seed * 1103515245 + 12345;
+            data[i] = seed >> 16;
+        }
+        bitset_reset(&walked, dim, dim);
+        bitset_reset(&indexed, dim, dim);
+        bitset_copy(&walked, &template->code);
+        draw_data_walk(&walked, data, data_len, dim, dim, &template->blocked);
+        bitset_copy(&indexed, &template->code);
+        draw_data(&indexed, template, data, data_len);
+        if (memcmp(walked.words, indexed.words, bitset_size(dim, dim)) != 0) {
+            fprintf(stderr, "mismatch for version %d\n", version);
+            n_mismatches++;
+        }
+        double walk_ns = time_placement(template, &walked, data, data_len, 0);
+        double index_ns = time_placement(template, &indexed, data, data_len, 1);
+        printf("%d,%d,%.1f,%.1f,%.2f\n", version, data_len, walk_ns, index_ns, walk_ns / index_ns);
+    }
+    bitset_free(&walked);
+    bitset_free(&indexed);
+    return n_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,75 @@
+// writes a version 40 code as a PNG with the built-in encoder at increasing ppm, each in a separate process,
+// to show that the memory used by the streaming rasterizer doesn't grow with the size of the image
+// output: CSV with one row per ppm and deflate mode, peak_rss_kb is the peak resident set size of the process
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../png_writer.h"
+#include "../quer.h"
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int run(int ppm, enum deflate_mode_t mode, const char *mode_name) {
+    char data[QUER_MAX_CAPACITY];
+    unsigned seed = 1;
+    for (int i = 0; i < QUER_MAX_CAPACITY; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = 'a' + (seed >> 16) % 26;
+    }
+    void *scratch = malloc(quer_scratch_size());
+    quer_options_t options = {.corr_level = QUER_CORR_L};
+    quer_code_t code;
+    png_writer_t writer;
+    raster_t raster;
+    FILE *file = tmpfile();
+    if (scratch == NULL || file == NULL || png_writer_init(&writer) == -1 ||
+        quer_encode(data, QUER_MAX_CAPACITY, &options, scratch, quer_scratch_size(), &code) != QUER_OK ||
+        raster_init(&raster, code.modules, ppm, code.width / 5, 0) == -1)
+        return -1;
+
+    double start = now_ns();
+    if (png_writer_write(&writer, &raster, mode, file) == -1)
+        return -1;
+    double elapsed = now_ns() - start;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("%d,%d,%lld,%s,%.1f,%ld,%ld\n", ppm, raster.width, (long long)raster.width * raster.height, mode_name,
+           elapsed / 1e6, ftell(file), usage.ru_maxrss);
+    // the child leaves with _exit, which doesn't flush
+    fflush(stdout);
+    return 0;
+}
+
+int main(void) {
+    static const int ppms[] = {1, 20, 50, 100, 200};
+    static const struct {
+        enum deflate_mode_t mode;
+        const char *name;
+    } modes[] = {{DEFLATE_RLE, "rle"}, {DEFLATE_FAST, "fast"}};
+    int n_failed = 0;
+    printf("ppm,width,pixels,mode,ms,png_bytes,peak_rss_kb\n");
+    for (size_t i = 0; i < sizeof(ppms) / sizeof(ppms[0]); i++) {
+        for (size_t j = 0; j < sizeof(modes) / sizeof(modes[0]); j++) {
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == -1)
+                return EXIT_FAILURE;
+            if (pid == 0)
+                _exit(run(ppms[i], modes[j].mode, modes[j].name) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+            int status;
+            if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+                fprintf(stderr, "ppm %d (%s) failed\n", ppms[i], modes[j].name);
+                n_failed++;
+            }
+        }
+    }
+    return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
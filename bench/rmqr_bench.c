@@ -0,0 +1,473 @@
+// checks the rMQR codes made by `quer -R` against a separate encoder written from ISO/IEC 23941 that shares no code
+// or tables with the library: for every version at levels M and H, numeric, alphanumeric and byte data that fills it
+// is encoded by both, and the symbol quer writes with `-F raw` must match the reference module for module
+// (versions that quer never picks, because a smaller one holds as much, are skipped)
+// the reference also checks its own function patterns, which must leave exactly the codewords and remainder bits of
+// the version's row of the standard's tables
+// usage: rmqr_bench.out, from the directory of ./quer.out
+// output: CSV with one row per symbol, ms is the time `quer` took to run
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define N_VERSIONS 32
+#define MAX_HEIGHT 17
+#define MAX_WIDTH 139
+#define MAX_CODEWORDS 256
+#define MAX_BLOCKS 8
+#define MAX_DATA_LEN 512
+
+enum ec_level_t { LEVEL_M, LEVEL_H };
+enum data_mode_t { MODE_NUMERIC, MODE_ALPHANUMERIC, MODE_BYTE };
+
+// error correction of one level: ec codewords per block, then n1 blocks of k1 data codewords and n2 of k2
+typedef struct ec_blocks_t {
+    int ec, n1, k1, n2, k2;
+} ec_blocks_t;
+
+// the version indicator is the index in this table
+static const struct {
+    int height;
+    int width;
+    ec_blocks_t blocks[2];
+    int remainder_bits;
+    int count_bits[3];
+} VERSIONS[N_VERSIONS] = {
+    {7, 43, {{7, 1, 6, 0, 0}, {10, 1, 3, 0, 0}}, 0, {4, 3, 3}},
+    {7, 59, {{9, 1, 12, 0, 0}, {14, 1, 7, 0, 0}}, 3, {5, 5, 4}},
+    {7, 77, {{12, 1, 20, 0, 0}, {22, 1, 10, 0, 0}}, 5, {6, 5, 5}},
+    {7, 99, {{16, 1, 28, 0, 0}, {30, 1, 14, 0, 0}}, 6, {7, 6, 5}},
+    {7, 139, {{24, 1, 44, 0, 0}, {22, 2, 12, 0, 0}}, 1, {7, 6, 6}},
+    {9, 43, {{9, 1, 12, 0, 0}, {14, 1, 7, 0, 0}}, 2, {5, 5, 4}},
+    {9, 59, {{12, 1, 21, 0, 0}, {22, 1, 11, 0, 0}}, 3, {6, 5, 5}},
+    {9, 77, {{18, 1, 31, 0, 0}, {16, 1, 8, 1, 9}}, 1, {7, 6, 5}},
+    {9, 99, {{24, 1, 42, 0, 0}, {22, 2, 11, 0, 0}}, 4, {7, 6, 6}},
+    {9, 139, {{18, 1, 31, 1, 32}, {22, 3, 11, 0, 0}}, 5, {8, 7, 6}},
+    {11, 27, {{8, 1, 7, 0, 0}, {10, 1, 5, 0, 0}}, 2, {4, 4, 3}},
+    {11, 43, {{12, 1, 19, 0, 0}, {20, 1, 11, 0, 0}}, 1, {6, 5, 5}},
+    {11, 59, {{16, 1, 31, 0, 0}, {16, 1, 7, 1, 8}}, 0, {7, 6, 5}},
+    {11, 77, {{24, 1, 43, 0, 0}, {22, 1, 11, 1, 12}}, 2, {7, 6, 6}},
+    {11, 99, {{16, 1, 28, 1, 29}, {30, 1, 14, 1, 15}}, 7, {8, 7, 6}},
+    {11, 139, {{24, 2, 42, 0, 0}, {30, 3, 14, 0, 0}}, 6, {8, 7, 7}},
+    {13, 27, {{9, 1, 12, 0, 0}, {14, 1, 7, 0, 0}}, 4, {5, 5, 4}},
+    {13, 43, {{14, 1, 27, 0, 0}, {28, 1, 13, 0, 0}}, 1, {6, 6, 5}},
+    {13, 59, {{22, 1, 38, 0, 0}, {20, 2, 10, 0, 0}}, 6, {7, 6, 6}},
+    {13, 77, {{16, 1, 26, 1, 27}, {28, 1, 14, 1, 15}}, 4, {7, 7, 6}},
+    {13, 99, {{20, 1, 36, 1, 37}, {26, 1, 11, 2, 12}}, 3, {8, 7, 7}},
+    {13, 139, {{20, 2, 35, 1, 36}, {26, 2, 13, 2, 14}}, 0, {8, 8, 7}},
+    {15, 43, {{18, 1, 33, 0, 0}, {18, 1, 7, 1, 8}}, 1, {7, 6, 6}},
+    {15, 59, {{26, 1, 48, 0, 0}, {24, 2, 13, 0, 0}}, 4, {7, 7, 6}},
+    {15, 77, {{18, 1, 33, 1, 34}, {24, 2, 10, 1, 11}}, 6, {8, 7, 7}},
+    {15, 99, {{24, 2, 44, 0, 0}, {22, 4, 12, 0, 0}}, 7, {8, 7, 7}},
+    {15, 139, {{24, 2, 42, 1, 43}, {26, 1, 13, 4, 14}}, 2, {9, 8, 7}},
+    {17, 43, {{22, 1, 39, 0, 0}, {20, 1, 10, 1, 11}}, 1, {7, 6, 6}},
+    {17, 59, {{16, 2, 28, 0, 0}, {30, 2, 14, 0, 0}}, 2, {8, 7, 6}},
+    {17, 77, {{22, 2, 39, 0, 0}, {28, 1, 12, 2, 13}}, 0, {8, 7, 7}},
+    {17, 99, {{20, 2, 33, 1, 34}, {26, 4, 14, 0, 0}}, 3, {8, 8, 7}},
+    {17, 139, {{20, 4, 38, 0, 0}, {26, 2, 12, 4, 13}}, 4, {9, 8, 8}},
+};
+
+static const char ALPHANUMERIC[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+typedef struct symbol_t {
+    int height, width;
+    uint8_t dark[MAX_HEIGHT][MAX_WIDTH];
+    uint8_t is_function[MAX_HEIGHT][MAX_WIDTH];
+} symbol_t;
+
+typedef struct bits_t {
+    uint8_t bytes[MAX_CODEWORDS];
+    int len;
+} bits_t;
+
+static uint8_t gf_exp[512], gf_log[256];
+
+static void init_gf(void) {
+    int x = 1;
+    for (int i = 0; i < 255; i++) {
+        gf_exp[i] = gf_exp[i + 255] = x;
+        gf_log[x] = i;
+        x <<= 1;
+        if (x & 0x100)
+            x ^= 0x11d;
+    }
+}
+
+static uint8_t gf_mul(uint8_t a, uint8_t b) { return a == 0 || b == 0 ? 0 : gf_exp[gf_log[a] + gf_log[b]]; }
+
+// the n error correction codewords of a block: the remainder of data * x^n divided by prod(x - a^i), i < n
+static void rs_encode(const uint8_t *data, int k, int n, uint8_t *ec) {
+    // gen[j] is the coefficient of x^j, multiplied by (x + a^i) in place for every i
+    uint8_t gen[MAX_CODEWORDS + 1] = {1};
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j > 0; j--)
+            gen[j] = gf_mul(gen[j], gf_exp[i]) ^ gen[j - 1];
+        gen[0] = gf_mul(gen[0], gf_exp[i]);
+    }
+    memset(ec, 0, n);
+    for (int i = 0; i < k; i++) {
+        uint8_t factor = data[i] ^ ec[0];
+        memmove(ec, ec + 1, n - 1);
+        ec[n - 1] = 0;
+        for (int j = 0; j < n; j++)
+            ec[j] ^= gf_mul(gen[n - 1 - j], factor);
+    }
+}
+
+static void put_bits(bits_t *bits, unsigned value, int n) {
+    for (int i = n - 1; i >= 0; i--, bits->len++) {
+        if ((value >> i) & 1)
+            bits->bytes[bits->len / 8] |= 0x80 >> (bits->len % 8);
+    }
+}
+
+static int data_bits(enum data_mode_t mode, int n) {
+    switch (mode) {
+        case MODE_NUMERIC:
+            return 10 * (n / 3) + (n % 3 == 0 ? 0 : (n % 3 == 1 ? 4 : 7));
+        case MODE_ALPHANUMERIC:
+            return 11 * (n / 2) + 6 * (n % 2);
+        default:
+            return 8 * n;
+    }
+}
+
+static int data_codewords(int version, enum ec_level_t level) {
+    const ec_blocks_t *b = &VERSIONS[version].blocks[level];
+    return b->n1 * b->k1 + b->n2 * b->k2;
+}
+
+static int fits(int version, enum ec_level_t level, enum data_mode_t mode, int n) {
+    return n < (1 << VERSIONS[version].count_bits[mode]) &&
+           3 + VERSIONS[version].count_bits[mode] + data_bits(mode, n) <= 8 * data_codewords(version, level);
+}
+
+// the version with the fewest modules (the first one of those) that holds n characters, -1 if there's none
+static int pick_version(enum ec_level_t level, enum data_mode_t mode, int n) {
+    int best = -1;
+    for (int v = 0; v < N_VERSIONS; v++) {
+        int area = VERSIONS[v].height * VERSIONS[v].width;
+        if (fits(v, level, mode, n) &&
+            (best == -1 || area < VERSIONS[best].height * VERSIONS[best].width))
+            best = v;
+    }
+    return best;
+}
+
+static void set_function(symbol_t *s, int y, int x, int dark) {
+    s->dark[y][x] = dark;
+    s->is_function[y][x] = 1;
+}
+
+static void draw_function_patterns(symbol_t *s) {
+    int h = s->height, w = s->width;
+    // finder pattern and its separator
+    for (int y = 0; y < 7; y++) {
+        for (int x = 0; x < 7; x++) {
+            int d = abs(y - 3) > abs(x - 3) ? abs(y - 3) : abs(x - 3);
+            set_function(s, y, x, d != 2);
+        }
+        set_function(s, y, 7, 0);
+    }
+    for (int x = 0; h > 7 && x < 8; x++)
+        set_function(s, 7, x, 0);
+    // finder sub-pattern
+    for (int y = h - 5; y < h; y++) {
+        for (int x = w - 5; x < w; x++) {
+            int d = abs(y - (h - 3)) > abs(x - (w - 3)) ? abs(y - (h - 3)) : abs(x - (w - 3));
+            set_function(s, y, x, d != 1);
+        }
+    }
+    // corner finder patterns
+    set_function(s, 0, w - 2, 1);
+    set_function(s, 0, w - 1, 1);
+    set_function(s, 1, w - 2, 0);
+    set_function(s, 1, w - 1, 1);
+    // (in R7 the lower left one is part of the finder pattern, in R9 its upper row is part of the separator)
+    if (h > 7) {
+        set_function(s, h - 1, 0, 1);
+        set_function(s, h - 1, 1, 1);
+    }
+    if (h > 9) {
+        set_function(s, h - 2, 0, 1);
+        set_function(s, h - 2, 1, 0);
+    }
+    // alignment patterns on the top and bottom edges (with room for the left and right edges, for the timing patterns)
+    int centers[6], n_centers = 0;
+    switch (w) {
+        case 43:
+            centers[n_centers++] = 21;
+            break;
+        case 59:
+            centers[n_centers++] = 19;
+            centers[n_centers++] = 39;
+            break;
+        case 77:
+            centers[n_centers++] = 25;
+            centers[n_centers++] = 51;
+            break;
+        case 99:
+            centers[n_centers++] = 23;
+            centers[n_centers++] = 49;
+            centers[n_centers++] = 75;
+            break;
+        case 139:
+            centers[n_centers++] = 27;
+            centers[n_centers++] = 55;
+            centers[n_centers++] = 83;
+            centers[n_centers++] = 111;
+            break;
+    }
+    for (int i = 0; i < n_centers; i++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                set_function(s, 1 + dy, centers[i] + dx, dy != 0 || dx != 0);
+                set_function(s, h - 2 + dy, centers[i] + dx, dy != 0 || dx != 0);
+            }
+        }
+    }
+    // format information, drawn later
+    for (int i = 0; i < 18; i++) {
+        set_function(s, 1 + i % 5, 8 + i / 5, 0);
+        if (i < 15)
+            set_function(s, h - 6 + i % 5, w - 8 + i / 5, 0);
+        else
+            set_function(s, h - 6, w - 5 + i - 15, 0);
+    }
+    // timing patterns fill the rest of the edges and of the columns of the alignment patterns
+    for (int x = 0; x < w; x++) {
+        if (!s->is_function[0][x])
+            set_function(s, 0, x, x % 2 == 0);
+        if (!s->is_function[h - 1][x])
+            set_function(s, h - 1, x, x % 2 == 0);
+    }
+    centers[n_centers++] = 0;
+    centers[n_centers++] = w - 1;
+    for (int i = 0; i < n_centers; i++) {
+        for (int y = 0; y < h; y++) {
+            if (!s->is_function[y][centers[i]])
+                set_function(s, y, centers[i], y % 2 == 0);
+        }
+    }
+}
+
+static void draw_format_information(symbol_t *s, int version, enum ec_level_t level) {
+    unsigned info = (level == LEVEL_H ? 1 << 5 : 0) | version;
+    // BCH(18, 6) with the generator x^12 + x^11 + x^10 + x^9 + x^8 + x^5 + x^2 + 1
+    unsigned rem = info << 12;
+    for (int i = 17; i >= 12; i--) {
+        if ((rem >> i) & 1)
+            rem ^= 0x1f25u << (i - 12);
+    }
+    unsigned bits = (info << 12) | rem, left = bits ^ 0x1fab2u, right = bits ^ 0x20a7bu;
+    int h = s->height, w = s->width;
+    for (int i = 0; i < 18; i++) {
+        s->dark[1 + i % 5][8 + i / 5] = (left >> i) & 1;
+        if (i < 15)
+            s->dark[h - 6 + i % 5][w - 8 + i / 5] = (right >> i) & 1;
+        else
+            s->dark[h - 6][w - 5 + i - 15] = (right >> i) & 1;
+    }
+}
+
+// draws the whole symbol, returns -1 if the function patterns don't leave the modules the version needs
+static int encode(const char *data, int n, int version, enum ec_level_t level, enum data_mode_t mode, symbol_t *s) {
+    const ec_blocks_t *b = &VERSIONS[version].blocks[level];
+    int n_data = data_codewords(version, level), n_blocks = b->n1 + b->n2;
+    int n_total = n_data + n_blocks * b->ec;
+    // the data codewords: mode indicator (001 numeric, 010 alphanumeric, 011 byte), character count, data,
+    // terminator, padding
+    bits_t bits = {{0}, 0};
+    put_bits(&bits, mode + 1, 3);
+    put_bits(&bits, n, VERSIONS[version].count_bits[mode]);
+    for (int i = 0; i < n;) {
+        if (mode == MODE_NUMERIC) {
+            int len = n - i < 3 ? n - i : 3, value = 0;
+            for (int j = 0; j < len; j++)
+                value = 10 * value + data[i + j] - '0';
+            put_bits(&bits, value, len == 3 ? 10 : (len == 2 ? 7 : 4));
+            i += len;
+        } else if (mode == MODE_ALPHANUMERIC) {
+            int value = strchr(ALPHANUMERIC, data[i]) - ALPHANUMERIC;
+            if (i + 1 < n) {
+                put_bits(&bits, 45 * value + (strchr(ALPHANUMERIC, data[i + 1]) - ALPHANUMERIC), 11);
+                i += 2;
+            } else {
+                put_bits(&bits, value, 6);
+                i++;
+            }
+        } else {
+            put_bits(&bits, (uint8_t)data[i++], 8);
+        }
+    }
+    int terminator = 8 * n_data - bits.len < 3 ? 8 * n_data - bits.len : 3;
+    bits.len += terminator;
+    bits.len = (bits.len + 7) / 8 * 8;
+    for (int i = 0; bits.len < 8 * n_data; i++)
+        put_bits(&bits, i % 2 == 0 ? 0xec : 0x11, 8);
+    // the blocks, interleaved
+    uint8_t ec[MAX_BLOCKS][MAX_CODEWORDS], codewords[MAX_CODEWORDS];
+    int starts[MAX_BLOCKS], lens[MAX_BLOCKS], n_codewords = 0;
+    for (int i = 0, start = 0; i < n_blocks; i++) {
+        starts[i] = start;
+        lens[i] = i < b->n1 ? b->k1 : b->k2;
+        rs_encode(bits.bytes + start, lens[i], b->ec, ec[i]);
+        start += lens[i];
+    }
+    for (int j = 0; j < b->k1 || j < b->k2; j++) {
+        for (int i = 0; i < n_blocks; i++) {
+            if (j < lens[i])
+                codewords[n_codewords++] = bits.bytes[starts[i] + j];
+        }
+    }
+    for (int j = 0; j < b->ec; j++) {
+        for (int i = 0; i < n_blocks; i++)
+            codewords[n_codewords++] = ec[i][j];
+    }
+    // the modules
+    memset(s, 0, sizeof(*s));
+    s->height = VERSIONS[version].height;
+    s->width = VERSIONS[version].width;
+    draw_function_patterns(s);
+    int n_modules = 0;
+    for (int y = 0; y < s->height; y++) {
+        for (int x = 0; x < s->width; x++)
+            n_modules += !s->is_function[y][x];
+    }
+    if (n_modules != 8 * n_total + VERSIONS[version].remainder_bits)
+        return -1;
+    // two columns at a time from the right, up then down, the right one of each pair first
+    int i_bit = 0;
+    for (int right = s->width - 2, upward = 1; right >= 1; right -= 2, upward = !upward) {
+        for (int k = 0; k < s->height; k++) {
+            int y = upward ? s->height - 1 - k : k;
+            for (int x = right; x >= right - 1; x--) {
+                if (s->is_function[y][x])
+                    continue;
+                int bit = i_bit < 8 * n_codewords && ((codewords[i_bit / 8] >> (7 - i_bit % 8)) & 1);
+                s->dark[y][x] = bit ^ ((y / 2 + x / 3) % 2 == 0);
+                i_bit++;
+            }
+        }
+    }
+    draw_format_information(s, version, level);
+    return 0;
+}
+
+// runs quer on the data and reads the raw symbol it writes, returns its size or -1
+static long run_quer(const char *data, int n, enum ec_level_t level, uint8_t *raw, size_t raw_cap, double *ms) {
+    char path[] = "/tmp/quer_rmqr_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1)
+        return -1;
+    if (write(fd, data, n) != n) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    close(fd);
+    char command[128];
+    snprintf(command, sizeof(command), "./quer.out -R -%c -F raw -i %s", level == LEVEL_H ? 'h' : 'm', path);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    FILE *out = popen(command, "r");
+    long len = -1;
+    if (out != NULL) {
+        len = fread(raw, 1, raw_cap, out);
+        if (pclose(out) != 0)
+            len = -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    unlink(path);
+    return len;
+}
+
+static unsigned seed = 1;
+
+static unsigned next_random(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+int main(void) {
+    static const char *level_names = "MH";
+    static const char *mode_names[] = {"numeric", "alphanumeric", "byte"};
+    init_gf();
+    int n_failed = 0, n_checked = 0;
+    printf("version,level,mode,chars,ms\n");
+    for (int version = 0; version < N_VERSIONS; version++) {
+        for (int level = LEVEL_M; level <= LEVEL_H; level++) {
+            for (int mode = MODE_NUMERIC; mode <= MODE_BYTE; mode++) {
+                // the most characters the version holds, skipped if a smaller version holds as many
+                int n = 0;
+                while (fits(version, level, mode, n + 1))
+                    n++;
+                if (pick_version(level, mode, n) != version)
+                    continue;
+                // numeric data is all digits, alphanumeric data has no digits (which could be cheaper as numeric
+                // segments) and byte data is lowercase letters, so that quer keeps it in a single segment
+                char data[MAX_DATA_LEN];
+                for (int i = 0; i < n; i++) {
+                    unsigned r = next_random();
+                    if (mode == MODE_NUMERIC)
+                        data[i] = '0' + r % 10;
+                    else if (mode == MODE_ALPHANUMERIC)
+                        data[i] = ALPHANUMERIC[10 + r % 35];
+                    else
+                        data[i] = 'a' + r % 26;
+                }
+                symbol_t s;
+                if (encode(data, n, version, level, mode, &s) == -1) {
+                    fprintf(stderr, "FAILED: the function patterns of R%dx%d don't leave its codewords\n",
+                            VERSIONS[version].height, VERSIONS[version].width);
+                    n_failed++;
+                    continue;
+                }
+                int row_bytes = (s.width + 7) / 8;
+                uint8_t expected[MAX_HEIGHT * ((MAX_WIDTH + 7) / 8)] = {0}, raw[sizeof(expected) + 1];
+                for (int y = 0; y < s.height; y++) {
+                    for (int x = 0; x < s.width; x++) {
+                        if (s.dark[y][x])
+                            expected[y * row_bytes + x / 8] |= 0x80 >> (x % 8);
+                    }
+                }
+                double ms = 0;
+                long len = run_quer(data, n, level, raw, sizeof(raw), &ms);
+                n_checked++;
+                if (len != s.height * row_bytes) {
+                    fprintf(stderr, "FAILED: R%dx%d, level %c, %d %s characters: %ld bytes instead of %d\n",
+                            s.height, s.width, level_names[level], n, mode_names[mode], len, s.height * row_bytes);
+                    n_failed++;
+                    continue;
+                }
+                if (memcmp(raw, expected, len) != 0) {
+                    int n_differing = 0, first_y = 0, first_x = 0;
+                    for (int y = 0; y < s.height; y++) {
+                        for (int x = 0; x < s.width; x++) {
+                            int byte = y * row_bytes + x / 8;
+                            if (((raw[byte] ^ expected[byte]) & (0x80 >> (x % 8))) && n_differing++ == 0) {
+                                first_y = y;
+                                first_x = x;
+                            }
+                        }
+                    }
+                    fprintf(stderr,
+                            "FAILED: R%dx%d, level %c, %d %s characters: %d differing modules, the first at (%d, %d)\n",
+                            s.height, s.width, level_names[level], n, mode_names[mode], n_differing, first_y, first_x);
+                    n_failed++;
+                    continue;
+                }
+                printf("R%dx%d,%c,%s,%d,%.1f\n", s.height, s.width, level_names[level], mode_names[mode], n, ms);
+            }
+        }
+    }
+    if (n_checked == 0)
+        n_failed++;
+    return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
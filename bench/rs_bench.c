@@ -0,0 +1,158 @@
+// compares the table-driven Reed-Solomon encoder with the previous implementation
+// (log table built by a linear search on every encode, generator polynomial computed on every call, `% MAX_N` and a
+// shift of the whole remainder on every step) for every block shape used by QR codes
+// output: CSV with one row per (data codewords, correction codewords) shape, old_setup_ns is the cost of the tables
+// the previous implementation built once per encode, old_ns and new_ns are the costs of encoding one block
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+
+#include "../reed_solomon.h"
+#include "../tables.h"
+
+#define MIN_ITERS 2000
+#define MIN_NS 20000000.0
+
+static int old_pow_2[MAX_N + 1];
+static int old_log_2[MAX_N + 1];
+
+static void old_init_lut(void) {
+    old_pow_2[0] = 1;
+    for (int i = 1; i <= MAX_N; i++) {
+        old_pow_2[i] = old_pow_2[i - 1] * 2;
+        if (old_pow_2[i] >= 256)
+            old_pow_2[i] ^= MOD;
+    }
+    for (int i = 1; i <= MAX_N; i++) {
+        for (int j = 0; j <= MAX_N; j++) {
+            if (old_pow_2[j] == i) {
+                old_log_2[i] = j;
+                break;
+            }
+        }
+    }
+}
+
+static void old_compute_generator_poly(int deg, int poly[MAX_DEGREE]) {
+    memset(poly, 0, MAX_DEGREE * sizeof(int));
+    poly[0] = 1;
+    int temp[MAX_DEGREE];
+    for (int i = 0; i < deg; i++) {
+        memset(temp, 0, MAX_DEGREE * sizeof(int));
+        for (int j = 1; j <= i + 1; j++)
+            temp[j] = poly[j - 1];
+        for (int j = 0; j <= i + 1; j++) {
+            if (poly[j] != 0)
+                poly[j] = old_pow_2[(old_log_2[poly[j]] + i) % MAX_N];
+            poly[j] ^= temp[j];
+        }
+    }
+    for (int i = 0; i <= deg / 2; i++) {
+        int tmp = poly[i];
+        poly[i] = poly[deg - i];
+        poly[deg - i] = tmp;
+    }
+}
+
+// the setup the previous encoder did on every encode
+static void old_setup(const uint8_t *msg, int block_len, int n_corr_codewords, uint8_t *corr_codewords) {
+    (void)msg;
+    (void)block_len;
+    int gen_poly[MAX_DEGREE];
+    old_init_lut();
+    old_compute_generator_poly(n_corr_codewords, gen_poly);
+    corr_codewords[0] = gen_poly[1];
+}
+
+// the previous encoder (it also didn't skip zero leading coefficients, which gave wrong codewords,
+// that's fixed here so that the outputs can be compared)
+static void old_encode(const uint8_t *msg, int block_len, int n_corr_codewords, uint8_t *corr_codewords) {
+    int gen_poly[MAX_DEGREE];
+    old_compute_generator_poly(n_corr_codewords, gen_poly);
+    int degree = block_len > n_corr_codewords + 1 ? block_len : n_corr_codewords + 1;
+    uint8_t res[degree];
+    for (int i = 0; i < block_len; i++)
+        res[i] = msg[i];
+    for (int i = block_len; i < degree; i++)
+        res[i] = 0;
+    for (int i = 0; i < block_len; i++) {
+        if (res[0] != 0) {
+            int coeff_exp = old_log_2[res[0]];
+            for (int j = 0; j < n_corr_codewords + 1; j++)
+                res[j] ^= old_pow_2[(old_log_2[gen_poly[j]] + coeff_exp) % MAX_N];
+        }
+        for (int j = 0; j < degree - 1; j++)
+            res[j] = res[j + 1];
+        if (i >= degree - n_corr_codewords - 1)
+            res[n_corr_codewords] = 0;
+    }
+    for (int i = 0; i < n_corr_codewords; i++)
+        corr_codewords[i] = res[i];
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static volatile uint8_t sink;
+
+static double time_encoder(void (*encode)(const uint8_t *, int, int, uint8_t *), const uint8_t *msg, int block_len,
+                           int n_corr_codewords) {
+    uint8_t corr_codewords[MAX_DEGREE];
+    long iters = 0;
+    double start = now_ns(), elapsed;
+    do {
+        for (int i = 0; i < MIN_ITERS; i++) {
+            encode(msg, block_len, n_corr_codewords, corr_codewords);
+            sink ^= corr_codewords[0];
+        }
+        iters += MIN_ITERS;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_NS);
+    return elapsed / iters;
+}
+
+int main(void) {
+    // every distinct (block length, number of correction codewords) pair, both the short and the long blocks
+    static int seen[MAX_N + 2][MAX_DEGREE];
+    uint8_t msg[MAX_N], expected[MAX_DEGREE], actual[MAX_DEGREE];
+    unsigned seed = 1;
+    double old_total = 0, new_total = 0;
+    int n_mismatches = 0;
+    old_init_lut();
+    printf("data_codewords,corr_codewords,old_setup_ns,old_ns,new_ns,speedup\n");
+    for (int level = 0; level < 4; level++) {
+        for (int version = 1; version <= 40; version++) {
+            int n_blocks = TOTAL_BLOCKS[level][version];
+            int n_corr_codewords = CORR_CODEWORDS_PER_BLOCK[level][version];
+            int small_block_len = TOTAL_AVAILABLE_MODULES[version] / 8 / n_blocks - n_corr_codewords;
+            for (int block_len = small_block_len; block_len <= small_block_len + 1; block_len++) {
+                if (seen[block_len][n_corr_codewords])
+                    continue;
+                seen[block_len][n_corr_codewords] = 1;
+                for (int i = 0; i < block_len; i++) {
+                    seed = seed * 1103515245 + 12345;
+                    msg[i] = seed >> 16;
+                }
+                old_encode(msg, block_len, n_corr_codewords, expected);
+                compute_corr_codewords(msg, block_len, n_corr_codewords, actual);
+                if (memcmp(expected, actual, n_corr_codewords) != 0) {
+                    fprintf(stderr, "mismatch for %d data and %d correction codewords\n", block_len,
+                            n_corr_codewords);
+                    n_mismatches++;
+                }
+                double old_setup_ns = time_encoder(old_setup, msg, block_len, n_corr_codewords);
+                double old_ns = time_encoder(old_encode, msg, block_len, n_corr_codewords);
+                double new_ns = time_encoder(compute_corr_codewords, msg, block_len, n_corr_codewords);
+                old_total += old_ns;
+                new_total += new_ns;
+                printf("%d,%d,%.1f,%.1f,%.1f,%.2f\n", block_len, n_corr_codewords, old_setup_ns, old_ns, new_ns,
+                       old_ns / new_ns);
+            }
+        }
+    }
+    fprintf(stderr, "total: old %.0f ns, new %.0f ns, speedup %.2f\n", old_total, new_total, old_total / new_total);
+    return n_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
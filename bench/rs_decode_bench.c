@@ -0,0 +1,145 @@
+// checks and times the Reed-Solomon decoder on every block shape used by QR codes
+// every shape is corrupted with every split of the correction capacity between errors and erasures
+// (2 * errors + erasures = correction codewords) and must decode back to the original block
+// output: CSV with one row per error correction level and kind of damage, blocks_per_s is the decoding throughput
+// over all of the level's block shapes (clean blocks only compute the syndromes)
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+
+#include "../reed_solomon.h"
+#include "../tables.h"
+
+#define MIN_NS 20000000.0
+
+enum damage_t {
+    DAMAGE_NONE,
+    DAMAGE_ERRORS,
+    DAMAGE_ERASURES,
+    N_DAMAGES,
+};
+
+typedef struct shape_t {
+    int block_len;
+    int n_corr_codewords;
+} shape_t;
+
+static unsigned seed = 1;
+
+static unsigned next_random(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// a random block of the shape with its correction codewords
+static void make_block(const shape_t *shape, uint8_t *block) {
+    int data_len = shape->block_len - shape->n_corr_codewords;
+    for (int i = 0; i < data_len; i++)
+        block[i] = next_random();
+    compute_corr_codewords(block, data_len, shape->n_corr_codewords, block + data_len);
+}
+
+// changes n_errors + n_erasures distinct random codewords, the positions of the erased ones go to erasures
+static void damage(uint8_t *block, int block_len, int n_errors, int n_erasures, int *erasures) {
+    int taken[MAX_N] = {0};
+    for (int i = 0; i < n_errors + n_erasures; i++) {
+        int pos;
+        do {
+            pos = next_random() % block_len;
+        } while (taken[pos]);
+        taken[pos] = 1;
+        block[pos] ^= 1 + next_random() % MAX_N;
+        if (i < n_erasures)
+            erasures[i] = pos;
+    }
+}
+
+// corrupts the block with every split of the correction capacity, returns the number of failures
+static int check_shape(const shape_t *shape) {
+    uint8_t block[MAX_N], damaged[MAX_N];
+    int erasures[MAX_DEGREE];
+    int n_failures = 0;
+    make_block(shape, block);
+    for (int n_erasures = 0; n_erasures <= shape->n_corr_codewords; n_erasures++) {
+        for (int n_errors = 0; 2 * n_errors + n_erasures <= shape->n_corr_codewords; n_errors++) {
+            memcpy(damaged, block, shape->block_len);
+            damage(damaged, shape->block_len, n_errors, n_erasures, erasures);
+            int n_corrected = correct_block(damaged, shape->block_len, shape->n_corr_codewords, erasures, n_erasures);
+            if (n_corrected == -1 || n_corrected > n_errors + n_erasures ||
+                memcmp(damaged, block, shape->block_len) != 0) {
+                fprintf(stderr, "failed for %d codewords (%d correction) with %d errors and %d erasures\n",
+                        shape->block_len, shape->n_corr_codewords, n_errors, n_erasures);
+                n_failures++;
+            }
+        }
+    }
+    return n_failures;
+}
+
+static volatile int sink;
+
+// blocks decoded per second, cycling through the shapes with the given damage at the correction limit
+static double time_decoder(const shape_t *shapes, int n_shapes, enum damage_t kind) {
+    static uint8_t blocks[41 * 2][MAX_N], damaged[MAX_N];
+    static int erasures[41 * 2][MAX_DEGREE];
+    int n_erasures[41 * 2];
+    for (int i = 0; i < n_shapes; i++) {
+        make_block(&shapes[i], blocks[i]);
+        int n_corr_codewords = shapes[i].n_corr_codewords;
+        n_erasures[i] = (kind == DAMAGE_ERASURES ? n_corr_codewords : 0);
+        if (kind != DAMAGE_NONE)
+            damage(blocks[i], shapes[i].block_len, kind == DAMAGE_ERRORS ? n_corr_codewords / 2 : 0, n_erasures[i],
+                   erasures[i]);
+    }
+    long n_blocks = 0;
+    double start = now_ns(), elapsed;
+    do {
+        for (int i = 0; i < n_shapes; i++) {
+            memcpy(damaged, blocks[i], shapes[i].block_len);
+            sink += correct_block(damaged, shapes[i].block_len, shapes[i].n_corr_codewords, erasures[i],
+                                  n_erasures[i]);
+        }
+        n_blocks += n_shapes;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_NS);
+    return n_blocks / (elapsed / 1e9);
+}
+
+int main(void) {
+    static const char *level_names[4] = {"L", "M", "Q", "H"};
+    static const char *damage_names[N_DAMAGES] = {"none", "errors", "erasures"};
+    int n_failures = 0;
+    printf("level,shapes,damage,blocks_per_s\n");
+    for (int level = 0; level < 4; level++) {
+        // every distinct (block length, number of correction codewords) pair of the level, short and long blocks
+        static int seen[MAX_N + 2][MAX_DEGREE];
+        shape_t shapes[41 * 2];
+        int n_shapes = 0;
+        memset(seen, 0, sizeof(seen));
+        for (int version = 1; version <= 40; version++) {
+            int n_blocks = TOTAL_BLOCKS[level][version];
+            int n_corr_codewords = CORR_CODEWORDS_PER_BLOCK[level][version];
+            int n_all_codewords = TOTAL_AVAILABLE_MODULES[version] / 8;
+            int small_block_len = n_all_codewords / n_blocks;
+            int n_big_blocks = n_all_codewords % n_blocks;
+            for (int block_len = small_block_len; block_len <= small_block_len + (n_big_blocks > 0); block_len++) {
+                if (seen[block_len][n_corr_codewords])
+                    continue;
+                seen[block_len][n_corr_codewords] = 1;
+                shapes[n_shapes] = (shape_t){.block_len = block_len, .n_corr_codewords = n_corr_codewords};
+                n_failures += check_shape(&shapes[n_shapes]);
+                n_shapes++;
+            }
+        }
+        for (int kind = 0; kind < N_DAMAGES; kind++)
+            printf("%s,%d,%s,%.0f\n", level_names[level], n_shapes, damage_names[kind],
+                   time_decoder(shapes, n_shapes, kind));
+    }
+    return n_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
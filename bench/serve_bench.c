@@ -0,0 +1,162 @@
+// load generator for `quer --serve`: every connection sends its share of the requests (URL-like payloads rendered as
+// PNGs), keeping up to `window` of them in flight, and the latency of every request is measured from sending it
+// to receiving its response
+// usage: serve_bench.out [socket], without a socket it starts ./quer.out --serve on a temporary one
+// output: CSV with one row per number of connections and window
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../serve.h"
+
+#define N_REQUESTS 20000
+
+typedef struct client_t {
+    const char *path;
+    int window;
+    int n_requests;
+    // the first request has this id, so that the payloads differ between the connections
+    int first_id;
+    int64_t *latencies;
+    int is_failed;
+} client_t;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_int64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int run_client(void *arg) {
+    static const uint8_t png_signature[4] = {0x89, 'P', 'N', 'G'};
+    client_t *client = arg;
+    int64_t *sent_at = malloc(client->n_requests * sizeof(int64_t));
+    int fd = serve_connect(client->path);
+    if (sent_at == NULL || fd == -1) {
+        free(sent_at);
+        client->is_failed = 1;
+        return 0;
+    }
+    serve_response_t resp = {0};
+    size_t body_cap = 0;
+    char payload[64];
+    int n_sent = 0, n_received = 0;
+    while (n_received < client->n_requests) {
+        while (n_sent < client->n_requests && n_sent - n_received < client->window) {
+            int id = client->first_id + n_sent;
+            int len = snprintf(payload, sizeof(payload), "https://example.com/items/%08d?ref=label", id * 7919);
+            serve_request_t req = {.id = n_sent, .corr_level = QUER_CORR_M, .ppm = 4, .payload = payload,
+                                   .payload_len = len};
+            sent_at[n_sent++] = now_ns();
+            if (serve_send(fd, &req) == -1)
+                client->is_failed = 1;
+        }
+        if (client->is_failed || serve_receive(fd, &resp, &body_cap) == -1 || resp.status != 0 ||
+            resp.id >= (uint32_t)n_sent || resp.body_len < sizeof(png_signature) ||
+            memcmp(resp.body, png_signature, sizeof(png_signature)) != 0) {
+            client->is_failed = 1;
+            break;
+        }
+        client->latencies[n_received++] = now_ns() - sent_at[resp.id];
+    }
+    close(fd);
+    free(resp.body);
+    free(sent_at);
+    return 0;
+}
+
+static int run(const char *path, int n_conns, int window) {
+    int per_conn = N_REQUESTS / n_conns, n_requests = per_conn * n_conns;
+    int64_t *latencies = malloc(n_requests * sizeof(int64_t));
+    client_t clients[64];
+    thrd_t threads[64];
+    if (latencies == NULL)
+        return -1;
+    int64_t start = now_ns();
+    for (int i = 0; i < n_conns; i++) {
+        clients[i] = (client_t){.path = path, .window = window, .n_requests = per_conn, .first_id = i * per_conn,
+                                .latencies = latencies + i * per_conn};
+        if (thrd_create(&threads[i], run_client, &clients[i]) != thrd_success)
+            return -1;
+    }
+    int is_failed = 0;
+    for (int i = 0; i < n_conns; i++) {
+        thrd_join(threads[i], NULL);
+        is_failed |= clients[i].is_failed;
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+    if (is_failed) {
+        free(latencies);
+        return -1;
+    }
+    qsort(latencies, n_requests, sizeof(int64_t), cmp_int64);
+    printf("%d,%d,%d,%.0f,%.1f,%.1f,%.1f\n", n_conns, window, n_requests, n_requests / elapsed,
+           latencies[n_requests / 2] / 1e3, latencies[(long)n_requests * 99 / 100] / 1e3,
+           latencies[n_requests - 1] / 1e3);
+    free(latencies);
+    return 0;
+}
+
+// starts ./quer.out --serve path and waits (up to 5 s) until it accepts connections, returns its pid or -1
+static pid_t start_server(const char *path) {
+    pid_t pid = fork();
+    if (pid == -1)
+        return -1;
+    if (pid == 0) {
+        execl("./quer.out", "quer.out", "--serve", path, "-e", "fast", (char *)NULL);
+        _exit(127);
+    }
+    for (int i = 0; i < 500; i++) {
+        int fd = serve_connect(path);
+        if (fd != -1) {
+            close(fd);
+            return pid;
+        }
+        nanosleep(&(struct timespec){.tv_nsec = 10000000}, NULL);
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    static const struct {
+        int n_conns;
+        int window;
+    } configs[] = {{1, 1}, {1, 16}, {4, 1}, {4, 16}, {16, 16}, {64, 4}};
+    char path[64];
+    pid_t server = -1;
+    if (argc > 1) {
+        snprintf(path, sizeof(path), "%s", argv[1]);
+    } else {
+        snprintf(path, sizeof(path), "/tmp/quer_serve_bench_%d.sock", (int)getpid());
+        if ((server = start_server(path)) == -1) {
+            fprintf(stderr, "unable to start ./quer.out --serve %s\n", path);
+            return 1;
+        }
+    }
+    int n_failed = 0;
+    printf("connections,window,requests,codes_per_s,p50_us,p99_us,max_us\n");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        if (run(path, configs[i].n_conns, configs[i].window) == -1) {
+            fprintf(stderr, "FAILED: %d connections, window %d\n", configs[i].n_conns, configs[i].window);
+            n_failed++;
+        }
+    }
+    if (server != -1) {
+        kill(server, SIGTERM);
+        waitpid(server, NULL, 0);
+    }
+    return n_failed == 0 ? 0 : 1;
+}
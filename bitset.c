@@ -4,11 +4,19 @@ int arena_init(arena_t* arena, size_t size) {
     arena->size = size;
     arena->offset = 0;
     arena->start = malloc(size);
+    arena->owned = 1;
     if (arena->start == NULL)
         return -1;
     return 0;
 }
 
+void arena_init_from_buffer(arena_t* arena, void* buf, size_t size) {
+    arena->size = size;
+    arena->offset = 0;
+    arena->start = buf;
+    arena->owned = 0;
+}
+
 void* arena_alloc(arena_t* arena, size_t n_bytes) {
     if (arena->offset + n_bytes > arena->size)
         return NULL;
@@ -16,66 +24,121 @@ void* arena_alloc(arena_t* arena, size_t n_bytes) {
     return (char*)(arena->start) + arena->offset - n_bytes;
 }
 
-void arena_free(arena_t* arena) { free(arena->start); }
+void arena_free(arena_t* arena) {
+    if (arena->owned)
+        free(arena->start);
+}
 
 int bitset_init(bitset_t* bset, int width, int height) {
-    bset->width = width;
-    bset->height = height;
-    bset->arr_w = (width + CELL_SIZE - 1) / CELL_SIZE;
-    bset->arr_h = (height + CELL_SIZE - 1) / CELL_SIZE;
     if (arena_init(&bset->arena, ARENA_SIZE) == -1)
         return -1;
-    bset->arr = (uint16_t**)arena_alloc(&bset->arena, bset->arr_h * sizeof(uint16_t*));
-    if (bset->arr == NULL) {
+    if (bitset_reset(bset, width, height) == -1) {
         arena_free(&bset->arena);
         return -1;
     }
-    for (int i = 0; i < bset->arr_h; i++) {
-        bset->arr[i] = (uint16_t*)arena_alloc(&bset->arena, bset->arr_w * sizeof(uint16_t));
-        if (bset->arr[i] == NULL) {
-            arena_free(&bset->arena);
-            return -1;
-        }
-        for (int j = 0; j < bset->arr_w; j++)
-            bset->arr[i][j] = 0;
-    }
     return 0;
 }
 
-int bitset_get(bitset_t* bset, int r, int c) {
-    int arr_r = r / CELL_SIZE;
-    int arr_c = c / CELL_SIZE;
-    int cell_r = r % CELL_SIZE;
-    int cell_c = c % CELL_SIZE;
-    int bit = CELL_SIZE * cell_r + cell_c;
-    return (bset->arr[arr_r][arr_c] & (1 << bit)) > 0;
-}
-
-void bitset_set(bitset_t* bset, int r, int c) {
-    int arr_r = r / CELL_SIZE;
-    int arr_c = c / CELL_SIZE;
-    int cell_r = r % CELL_SIZE;
-    int cell_c = c % CELL_SIZE;
-    int bit = CELL_SIZE * cell_r + cell_c;
-    bset->arr[arr_r][arr_c] |= (1 << bit);
-}
-
-void bitset_unset(bitset_t* bset, int r, int c) {
-    int arr_r = r / CELL_SIZE;
-    int arr_c = c / CELL_SIZE;
-    int cell_r = r % CELL_SIZE;
-    int cell_c = c % CELL_SIZE;
-    int bit = CELL_SIZE * cell_r + cell_c;
-    bset->arr[arr_r][arr_c] &= (UINT16_MAX - (1 << bit));
-}
-
-void bitset_negate(bitset_t* bset, int r, int c) {
-    int arr_r = r / CELL_SIZE;
-    int arr_c = c / CELL_SIZE;
-    int cell_r = r % CELL_SIZE;
-    int cell_c = c % CELL_SIZE;
-    int bit = CELL_SIZE * cell_r + cell_c;
-    bset->arr[arr_r][arr_c] ^= (1 << bit);
+int bitset_init_from_buffer(bitset_t* bset, int width, int height, void* buf, size_t size) {
+    arena_init_from_buffer(&bset->arena, buf, size);
+    return bitset_reset(bset, width, height);
+}
+
+size_t bitset_size(int width, int height) {
+    size_t stride = (width + WORD_BITS - 1) / WORD_BITS;
+    return stride * height * sizeof(uint64_t);
+}
+
+int bitset_reset(bitset_t* bset, int width, int height) {
+    bset->width = width;
+    bset->height = height;
+    bset->stride = (width + WORD_BITS - 1) / WORD_BITS;
+    bset->arena.offset = 0;
+    size_t n_bytes = bitset_size(width, height);
+    bset->words = (uint64_t*)arena_alloc(&bset->arena, n_bytes);
+    if (bset->words == NULL)
+        return -1;
+    memset(bset->words, 0, n_bytes);
+    return 0;
+}
+
+void bitset_copy(bitset_t* dst, const bitset_t* src) {
+    memcpy(dst->words, src->words, bitset_size(src->width, src->height));
+}
+
+void bitset_get_span(const bitset_t* bset, int r, int c, int n, uint64_t* dst) {
+    const uint64_t* row = bitset_const_row(bset, r);
+    int shift = c % WORD_BITS;
+    int first = c / WORD_BITS;
+    for (int i = 0; i * WORD_BITS < n; i++) {
+        uint64_t word = row[first + i] >> shift;
+        if (shift > 0 && first + i + 1 < bset->stride)
+            word |= row[first + i + 1] << (WORD_BITS - shift);
+        if (n - i * WORD_BITS < WORD_BITS)
+            word &= ((uint64_t)1 << (n - i * WORD_BITS)) - 1;
+        dst[i] = word;
+    }
+}
+
+void bitset_set_span(bitset_t* bset, int r, int c, int n, const uint64_t* src) {
+    uint64_t* row = bitset_row(bset, r);
+    int shift = c % WORD_BITS;
+    int first = c / WORD_BITS;
+    for (int i = 0; i * WORD_BITS < n; i++) {
+        int len = (n - i * WORD_BITS < WORD_BITS ? n - i * WORD_BITS : WORD_BITS);
+        uint64_t mask = (len == WORD_BITS ? UINT64_MAX : ((uint64_t)1 << len) - 1);
+        uint64_t word = src[i] & mask;
+        row[first + i] = (row[first + i] & ~(mask << shift)) | (word << shift);
+        if (shift > 0 && (mask >> (WORD_BITS - shift)) != 0)
+            row[first + i + 1] =
+                (row[first + i + 1] & ~(mask >> (WORD_BITS - shift))) | (word >> (WORD_BITS - shift));
+    }
+}
+
+void bitset_xor(bitset_t* dst, const bitset_t* src) {
+    size_t n_words = (size_t)src->stride * src->height;
+    for (size_t i = 0; i < n_words; i++)
+        dst->words[i] ^= src->words[i];
+}
+
+void bitset_xor_row(bitset_t* dst, int dst_r, const bitset_t* src, int src_r) {
+    uint64_t* dst_row = bitset_row(dst, dst_r);
+    const uint64_t* src_row = bitset_const_row(src, src_r);
+    for (int i = 0; i < dst->stride; i++)
+        dst_row[i] ^= src_row[i];
+}
+
+int bitset_popcount_row(const bitset_t* bset, int r) {
+    const uint64_t* row = bitset_const_row(bset, r);
+    int count = 0;
+    for (int i = 0; i < bset->stride; i++)
+        count += __builtin_popcountll(row[i]);
+    return count;
+}
+
+int bitset_next_run(const bitset_t* bset, int r, int c, int* end) {
+    if (c >= bset->width)
+        return -1;
+    const uint64_t* row = bitset_const_row(bset, r);
+    int i = c / WORD_BITS;
+    uint64_t word = row[i] & (~(uint64_t)0 << (c % WORD_BITS));
+    while (word == 0) {
+        if (++i == bset->stride)
+            return -1;
+        word = row[i];
+    }
+    int start = i * WORD_BITS + __builtin_ctzll(word);
+    // the fields outside of the width are zero, so a run can only reach the width if it's a multiple of 64
+    word = ~row[i] & (~(uint64_t)0 << (start % WORD_BITS));
+    while (word == 0) {
+        if (++i == bset->stride) {
+            *end = bset->width;
+            return start;
+        }
+        word = ~row[i];
+    }
+    *end = i * WORD_BITS + __builtin_ctzll(word);
+    return start;
 }
 
 void bitset_free(bitset_t* bset) { arena_free(&bset->arena); }
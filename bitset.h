@@ -4,8 +4,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#define CELL_SIZE 4
+#define WORD_BITS 64
 #define ARENA_SIZE (1 << 16)
 
 // arena allocator
@@ -13,25 +14,69 @@ typedef struct arena_t {
     size_t size;
     size_t offset;
     void* start;
+    // 0 if the memory was provided by the caller
+    int owned;
 } arena_t;
 
 // a 2D bitset (binary matrix) with width * height fields
-// to save memory, each 4x4 submatrix is stored as a single 16-bit integer
+// the rows are stored one after another, each as stride 64-bit words,
+// field (r, c) is bit c % 64 of word c / 64 of row r
+// so whole rows (or their spans) can be processed a word at a time
 typedef struct bitset_t {
     int width;
     int height;
-    int arr_w;
-    int arr_h;
-    uint16_t** arr;
+    int stride;
+    uint64_t* words;
     arena_t arena;
 } bitset_t;
 
 int bitset_init(bitset_t* bset, int width, int height);
-int bitset_get(bitset_t* bset, int r, int c);
-void bitset_set(bitset_t* bset, int r, int c);
-void bitset_unset(bitset_t* bset, int r, int c);
-void bitset_negate(bitset_t* bset, int r, int c);
+// like bitset_init, but the bitset lives in the given buffer (of at least bitset_size(width, height) bytes)
+// instead of allocating its own memory, such a bitset doesn't have to be freed
+int bitset_init_from_buffer(bitset_t* bset, int width, int height, void* buf, size_t size);
+// number of bytes needed to store a bitset with the given dimensions
+size_t bitset_size(int width, int height);
+// clear the bitset and change its dimensions, reusing the already allocated arena
+int bitset_reset(bitset_t* bset, int width, int height);
+// copy the contents of src into dst, which must have the same dimensions
+void bitset_copy(bitset_t* dst, const bitset_t* src);
 void bitset_free(bitset_t* bset);
 void bitset_print(bitset_t* bset);
 
+// bulk access to the rows
+// fields outside of the width of a row are always zero
+static inline uint64_t* bitset_row(bitset_t* bset, int r) { return bset->words + (size_t)r * bset->stride; }
+static inline const uint64_t* bitset_const_row(const bitset_t* bset, int r) {
+    return bset->words + (size_t)r * bset->stride;
+}
+// store the n fields starting at (r, c) in dst, field (r, c + i) as bit i % 64 of dst[i / 64]
+void bitset_get_span(const bitset_t* bset, int r, int c, int n, uint64_t* dst);
+// the inverse of bitset_get_span, overwrites the n fields starting at (r, c)
+void bitset_set_span(bitset_t* bset, int r, int c, int n, const uint64_t* src);
+// dst ^= src, both bitsets must have the same dimensions
+void bitset_xor(bitset_t* dst, const bitset_t* src);
+// row dst_r of dst ^= row src_r of src, both bitsets must have the same width
+void bitset_xor_row(bitset_t* dst, int dst_r, const bitset_t* src, int src_r);
+// number of set fields in row r
+int bitset_popcount_row(const bitset_t* bset, int r);
+// the first run of set fields in row r at or after column c: returns its start and stores its end in *end,
+// returns -1 if there's no such run
+int bitset_next_run(const bitset_t* bset, int r, int c, int* end);
+
+static inline int bitset_get(const bitset_t* bset, int r, int c) {
+    return (bitset_const_row(bset, r)[c / WORD_BITS] >> (c % WORD_BITS)) & 1;
+}
+
+static inline void bitset_set(bitset_t* bset, int r, int c) {
+    bitset_row(bset, r)[c / WORD_BITS] |= (uint64_t)1 << (c % WORD_BITS);
+}
+
+static inline void bitset_unset(bitset_t* bset, int r, int c) {
+    bitset_row(bset, r)[c / WORD_BITS] &= ~((uint64_t)1 << (c % WORD_BITS));
+}
+
+static inline void bitset_negate(bitset_t* bset, int r, int c) {
+    bitset_row(bset, r)[c / WORD_BITS] ^= (uint64_t)1 << (c % WORD_BITS);
+}
+
 #endif  // BITSET_H
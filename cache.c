@@ -0,0 +1,208 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the files start with the magic and the length of the key, then the key and the image
+#define MAGIC "QRC1"
+#define FILE_HEADER 8
+// the names of the files are their hashes in hex
+#define NAME_LEN 16
+// eviction goes down to 3/4 of max_bytes, so that it doesn't run again for every image stored
+#define EVICT_TO_NUM 3
+#define EVICT_TO_DEN 4
+
+typedef struct entry_t {
+    char name[NAME_LEN + 1];
+    // the time of the last hit (or of storing it)
+    struct timespec used;
+    int64_t size;
+} entry_t;
+
+// 64-bit FNV-1a
+static uint64_t hash(const uint8_t *key, size_t len) {
+    uint64_t h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < len; i++) {
+        h ^= key[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+static void entry_path(const render_cache_t *cache, const uint8_t *key, size_t key_len, char *path) {
+    snprintf(path, PATH_MAX, "%s/%016llx", cache->dir, (unsigned long long)hash(key, key_len));
+}
+
+static int is_entry_name(const char *name) {
+    return strlen(name) == NAME_LEN && strspn(name, "0123456789abcdef") == NAME_LEN;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// lists the images in the cache into *entries (to be freed), returns their number or -1 on error
+static long list_entries(const render_cache_t *cache, entry_t **entries) {
+    DIR *dir = opendir(cache->dir);
+    if (dir == NULL)
+        return -1;
+    long n = 0, cap = 0;
+    *entries = NULL;
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) != NULL) {
+        struct stat st;
+        if (!is_entry_name(dirent->d_name) || fstatat(dirfd(dir), dirent->d_name, &st, 0) == -1)
+            continue;
+        if (n == cap) {
+            cap = cap == 0 ? 256 : 2 * cap;
+            entry_t *new_entries = realloc(*entries, cap * sizeof(entry_t));
+            if (new_entries == NULL) {
+                free(*entries);
+                closedir(dir);
+                return -1;
+            }
+            *entries = new_entries;
+        }
+        entry_t *entry = &(*entries)[n++];
+        memcpy(entry->name, dirent->d_name, NAME_LEN + 1);
+        entry->used = st.st_mtim;
+        entry->size = st.st_size;
+    }
+    closedir(dir);
+    return n;
+}
+
+static int cmp_used(const void *a, const void *b) {
+    const struct timespec *x = &((const entry_t *)a)->used, *y = &((const entry_t *)b)->used;
+    if (x->tv_sec != y->tv_sec)
+        return x->tv_sec < y->tv_sec ? -1 : 1;
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+// counts the bytes taken by the images again (other processes may have added or removed some) and removes the least
+// recently used ones while they take more than max_bytes, called with the lock held
+static void evict(render_cache_t *cache) {
+    entry_t *entries;
+    long n = list_entries(cache, &entries);
+    if (n == -1)
+        return;
+    int64_t n_bytes = 0;
+    for (long i = 0; i < n; i++)
+        n_bytes += entries[i].size;
+    if (n_bytes > cache->max_bytes) {
+        qsort(entries, n, sizeof(entry_t), cmp_used);
+        int64_t target = cache->max_bytes / EVICT_TO_DEN * EVICT_TO_NUM;
+        char path[PATH_MAX];
+        for (long i = 0; i < n && n_bytes > target; i++) {
+            snprintf(path, PATH_MAX, "%s/%s", cache->dir, entries[i].name);
+            // one removed by another process counts as removed too
+            unlink(path);
+            n_bytes -= entries[i].size;
+        }
+    }
+    cache->n_bytes = n_bytes;
+    free(entries);
+}
+
+int cache_open(render_cache_t *cache, const char *dir, int64_t max_bytes) {
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+        return -1;
+    cache->dir = strdup(dir);
+    if (cache->dir == NULL)
+        return -1;
+    cache->max_bytes = max_bytes;
+    cache->n_bytes = 0;
+    entry_t *entries;
+    if (mtx_init(&cache->lock, mtx_plain) != thrd_success || list_entries(cache, &entries) == -1) {
+        free(cache->dir);
+        return -1;
+    }
+    free(entries);
+    evict(cache);
+    return 0;
+}
+
+int cache_get(render_cache_t *cache, const uint8_t *key, size_t key_len, cache_hit_t *hit) {
+    char path[PATH_MAX];
+    entry_path(cache, key, key_len, path);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)(FILE_HEADER + key_len)) {
+        close(fd);
+        return -1;
+    }
+    // the files are replaced (by rename) but never changed, so the mapping stays valid even if the image is evicted
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    const uint8_t *file = map;
+    uint32_t file_key_len;
+    memcpy(&file_key_len, file + 4, sizeof(file_key_len));
+    if (memcmp(file, MAGIC, 4) != 0 || file_key_len != key_len || memcmp(file + FILE_HEADER, key, key_len) != 0) {
+        munmap(map, st.st_size);
+        close(fd);
+        return -1;
+    }
+    // the modification time of a file is the time of its last hit
+    futimens(fd, NULL);
+    close(fd);
+    *hit = (cache_hit_t){.image = file + FILE_HEADER + key_len,
+                         .image_len = st.st_size - (FILE_HEADER + key_len),
+                         .map = map,
+                         .map_len = st.st_size};
+    return 0;
+}
+
+void cache_release(cache_hit_t *hit) { munmap(hit->map, hit->map_len); }
+
+void cache_put(render_cache_t *cache, const uint8_t *key, size_t key_len, const uint8_t *image, size_t image_len) {
+    char path[PATH_MAX], tmp_path[PATH_MAX];
+    entry_path(cache, key, key_len, path);
+    // written under a temporary name and renamed, so that readers never see a partial file
+    if (snprintf(tmp_path, PATH_MAX, "%s/.tmp-XXXXXX", cache->dir) >= PATH_MAX)
+        return;
+    int fd = mkstemp(tmp_path);
+    if (fd == -1)
+        return;
+    uint8_t header[FILE_HEADER];
+    uint32_t file_key_len = key_len;
+    memcpy(header, MAGIC, 4);
+    memcpy(header + 4, &file_key_len, sizeof(file_key_len));
+    int is_written = fchmod(fd, 0644) == 0 && write_full(fd, header, FILE_HEADER) == 0 &&
+                     write_full(fd, key, key_len) == 0 && write_full(fd, image, image_len) == 0;
+    if (close(fd) == -1)
+        is_written = 0;
+    if (!is_written || rename(tmp_path, path) == -1) {
+        unlink(tmp_path);
+        return;
+    }
+    mtx_lock(&cache->lock);
+    cache->n_bytes += FILE_HEADER + key_len + image_len;
+    if (cache->n_bytes > cache->max_bytes)
+        evict(cache);
+    mtx_unlock(&cache->lock);
+}
@@ -0,0 +1,43 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <threads.h>
+
+#include "quer.h"
+
+// the longest key of an image: a header with the options (set by the caller) and the data
+#define CACHE_KEY_HEADER 72
+#define CACHE_MAX_KEY (CACHE_KEY_HEADER + QUER_MAX_INPUT_LEN)
+
+// a directory of rendered images, each in a file named by the hash of its key (the data and everything that
+// changes the image), which holds the whole key (so that a collision is a miss) and the image
+// the least recently used images are removed once the files take more than max_bytes, it's safe to use from many
+// threads and processes at once
+typedef struct render_cache_t {
+    char *dir;
+    int64_t max_bytes;
+    // the bytes taken by the files, as last counted plus the ones written since then
+    int64_t n_bytes;
+    mtx_t lock;
+} render_cache_t;
+
+// an image found in the cache, mapped into memory until cache_release
+typedef struct cache_hit_t {
+    const uint8_t *image;
+    size_t image_len;
+    void *map;
+    size_t map_len;
+} cache_hit_t;
+
+// opens the cache in dir (creating the directory if needed), returns -1 on error
+int cache_open(render_cache_t *cache, const char *dir, int64_t max_bytes);
+// looks up the image of the key and marks it as used, returns 0 on a hit and -1 on a miss
+int cache_get(render_cache_t *cache, const uint8_t *key, size_t key_len, cache_hit_t *hit);
+void cache_release(cache_hit_t *hit);
+// stores the image of the key, evicting the least recently used images if the cache gets too large
+// failing to store it only means a miss the next time, so errors are ignored
+void cache_put(render_cache_t *cache, const uint8_t *key, size_t key_len, const uint8_t *image, size_t image_len);
+
+#endif  // CACHE_H
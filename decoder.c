@@ -0,0 +1,397 @@
+#include "decoder.h"
+
+#include "reed_solomon.h"
+#include "segments.h"
+#include "tables.h"
+#include "templates.h"
+
+#define FORMAT_INFO_MASK 0b101010000010010
+#define MICRO_FORMAT_INFO_MASK 0b100010001000101
+// the two copies of the format info of rMQR codes have masks of their own
+#define RMQR_FORMAT_INFO_MASK_0 0b011111101010110010
+#define RMQR_FORMAT_INFO_MASK_1 0b100000101001111011
+#define APPEND_MODE_INDICATOR 0b0011
+// the most bit errors the BCH codes of the format and version info can fix
+#define MAX_INFO_ERRORS 3
+
+static const uint8_t ALPHANUMERIC_CHARS[45] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+static const int CORR_LEVEL_BITS[4] = {0b01, 0b00, 0b11, 0b10};
+
+// the 5 bits of the info followed by the 10 bits of their BCH code
+static int bch_format_info(int info) {
+    int rem = info;
+    for (int i = 0; i < 10; i++)
+        rem = (rem << 1) ^ ((rem >> 9) * 0b10100110111);
+    return info << 10 | rem;
+}
+
+int format_info_bits(enum quer_corr_level_t corr_level, int mask) {
+    return bch_format_info(CORR_LEVEL_BITS[corr_level] << 3 | mask) ^ FORMAT_INFO_MASK;
+}
+
+int micro_format_info_bits(int version, enum quer_corr_level_t corr_level, int mask) {
+    return bch_format_info(MICRO_SYMBOL_NUMBER[corr_level][version] << 2 | mask) ^ MICRO_FORMAT_INFO_MASK;
+}
+
+// the 6 bits of the info followed by the 12 bits of their BCH code (the one of the version info of QR codes)
+static int bch_rmqr_format_info(int info) {
+    int rem = info;
+    for (int i = 0; i < 12; i++)
+        rem = (rem << 1) ^ ((rem >> 11) * 0b1111100100101);
+    return info << 12 | rem;
+}
+
+int rmqr_format_info_bits(int version, enum quer_corr_level_t corr_level, int copy) {
+    int info = bch_rmqr_format_info((corr_level == QUER_CORR_H) << 5 | (version - 1));
+    return info ^ (copy == 0 ? RMQR_FORMAT_INFO_MASK_0 : RMQR_FORMAT_INFO_MASK_1);
+}
+
+int read_rmqr_format_info(const bitset_t* code, int copy) {
+    int info = 0;
+    for (int i = 0; i < RMQR_FORMAT_INFO_BITS; i++) {
+        int r, c;
+        rmqr_format_info_module(code->width, code->height, copy, i, &r, &c);
+        info |= bitset_get(code, r, c) << i;
+    }
+    return info;
+}
+
+int read_micro_format_info(const bitset_t* code) {
+    int info = 0;
+    for (int i = 0; i < 8; i++)
+        info |= bitset_get(code, i + 1, 8) << i;
+    for (int i = 8; i < 15; i++)
+        info |= bitset_get(code, 8, 15 - i) << i;
+    return info;
+}
+
+int read_format_info(const bitset_t* code, int copy) {
+    int dim = code->width, info = 0;
+    if (copy == 0) {
+        for (int y = 0; y < 6; y++)
+            info |= bitset_get(code, y, 8) << y;
+        info |= bitset_get(code, 7, 8) << 6 | bitset_get(code, 8, 8) << 7 | bitset_get(code, 8, 7) << 8;
+        for (int x = 9; x < 15; x++)
+            info |= bitset_get(code, 8, 14 - x) << x;
+    } else {
+        for (int x = 0; x < 8; x++)
+            info |= bitset_get(code, 8, dim - 1 - x) << x;
+        for (int y = 0; y < 7; y++)
+            info |= bitset_get(code, dim - 1 - y, 8) << (14 - y);
+    }
+    return info;
+}
+
+int decode_format_info(int info, enum quer_corr_level_t* corr_level, int* mask) {
+    int best_distance = 16;
+    for (int level = QUER_CORR_L; level <= QUER_CORR_H; level++) {
+        for (int mask_i = 0; mask_i < N_MASKS; mask_i++) {
+            int distance = __builtin_popcount(info ^ format_info_bits(level, mask_i));
+            if (distance < best_distance) {
+                best_distance = distance;
+                *corr_level = level;
+                *mask = mask_i;
+            }
+        }
+    }
+    return best_distance;
+}
+
+int decode_version_info(const bitset_t* code, int copy) {
+    int dim = code->width, info = 0;
+    for (int y = 0; y < 6; y++) {
+        for (int x = 0; x < 3; x++) {
+            int bit = (copy == 0 ? bitset_get(code, y, dim - 11 + x) : bitset_get(code, dim - 11 + x, y));
+            info |= bit << (3 * y + x);
+        }
+    }
+    int best_version = -1, best_distance = MAX_INFO_ERRORS + 1;
+    for (int version = 7; version <= QUER_MAX_VERSION; version++) {
+        int distance = __builtin_popcount(info ^ VERSION_INFO[version]);
+        if (distance < best_distance) {
+            best_distance = distance;
+            best_version = version;
+        }
+    }
+    return best_version;
+}
+
+static int mask_bit(int mask, int i, int j) {
+    switch (mask) {
+        case 0:
+            return (i + j) % 2 == 0;
+        case 1:
+            return i % 2 == 0;
+        case 2:
+            return j % 3 == 0;
+        case 3:
+            return (i + j) % 3 == 0;
+        case 4:
+            return (i / 2 + j / 3) % 2 == 0;
+        case 5:
+            return (i * j) % 2 + (i * j) % 3 == 0;
+        case 6:
+            return ((i * j) % 2 + (i * j) % 3) % 2 == 0;
+        default:
+            return ((i + j) % 2 + (i * j) % 3) % 2 == 0;
+    }
+}
+
+int read_codewords(const bitset_t* code, const bitset_t* blocked, int mask, uint8_t* codewords, int n_bits) {
+    // every mask depends only on the row modulo 12 and the column modulo 6
+    uint8_t pattern[12][6];
+    for (int i = 0; i < 12; i++) {
+        for (int j = 0; j < 6; j++)
+            pattern[i][j] = mask_bit(mask, i, j);
+    }
+    int width = code->width, height = code->height, n_read = 0, up = 1;
+    unsigned codeword = 0, remainder = 0;
+    for (int col = width - 1; col >= 1; col -= 2, up ^= 1) {
+        if (col == timing_column(width, height))
+            col--;
+        for (int row = 0; row < height; row++) {
+            int y = up ? height - 1 - row : row;
+            const uint64_t* code_row = bitset_const_row(code, y);
+            const uint64_t* blocked_row = bitset_const_row(blocked, y);
+            const uint8_t* pattern_row = pattern[y % 12];
+            for (int x = col; x >= col - 1; x--) {
+                if ((blocked_row[x / WORD_BITS] >> (x % WORD_BITS)) & 1)
+                    continue;
+                unsigned bit = ((code_row[x / WORD_BITS] >> (x % WORD_BITS)) & 1) ^ pattern_row[x % 6];
+                if (n_read < n_bits) {
+                    codeword = codeword << 1 | bit;
+                    if (n_read % 8 == 7)
+                        codewords[n_read / 8] = codeword;
+                } else {
+                    remainder |= bit;
+                }
+                n_read++;
+            }
+        }
+    }
+    if (n_bits % 8 != 0)
+        codewords[n_bits / 8] = (codeword << (8 - n_bits % 8)) & 0xFF;
+    return remainder == 0 ? 0 : -1;
+}
+
+int read_blocks(const uint8_t* codewords, enum quer_corr_level_t corr_level, int version, int rmqr, int correct,
+                uint8_t* data) {
+    int level = corr_level;
+    int n_blocks = (rmqr ? RMQR_BLOCKS[level][version] : TOTAL_BLOCKS[level][version]);
+    int n_corr_codewords_per_block =
+        (rmqr ? RMQR_CORR_CODEWORDS_PER_BLOCK[level][version] : CORR_CODEWORDS_PER_BLOCK[level][version]);
+    int n_all_codewords = (rmqr ? RMQR_AVAILABLE_MODULES[version] : TOTAL_AVAILABLE_MODULES[version]) / 8;
+    int corr_offset = (rmqr ? RMQR_DATA_CODEWORDS[level][version] : TOTAL_DATA_CODEWORDS[level][version]);
+    int n_small_blocks = n_blocks - n_all_codewords % n_blocks;
+    int small_block_len = n_all_codewords / n_blocks - n_corr_codewords_per_block;
+
+    uint8_t block[MAX_N];
+    uint8_t syndromes[MAX_DEGREE];
+    int data_len = 0, n_corrected = 0;
+    for (int i = 0; i < n_blocks; i++) {
+        int block_len = (i < n_small_blocks ? small_block_len : small_block_len + 1);
+        for (int j = 0; j < block_len; j++) {
+            // the extra codewords of the big blocks come after the ones they share with the small blocks
+            int idx = (j < small_block_len ? i + n_blocks * j : n_blocks * small_block_len + i - n_small_blocks);
+            block[j] = codewords[idx];
+        }
+        for (int j = 0; j < n_corr_codewords_per_block; j++)
+            block[block_len + j] = codewords[corr_offset + i + n_blocks * j];
+        int total_len = block_len + n_corr_codewords_per_block;
+        if (correct) {
+            int n_block_corrected = correct_block(block, total_len, n_corr_codewords_per_block, NULL, 0);
+            if (n_block_corrected == -1)
+                return -1;
+            n_corrected += n_block_corrected;
+        } else if (!compute_syndromes(block, total_len, n_corr_codewords_per_block, syndromes)) {
+            return -1;
+        }
+        memcpy(data + data_len, block, block_len);
+        data_len += block_len;
+    }
+    return n_corrected;
+}
+
+typedef struct bit_reader_t {
+    const uint8_t* bytes;
+    int len_bits;
+    int pos;
+} bit_reader_t;
+
+// returns the next n_bits bits, or -1 if there aren't that many left
+static int read_bits(bit_reader_t* reader, int n_bits) {
+    if (reader->pos + n_bits > reader->len_bits)
+        return -1;
+    int value = 0;
+    for (int i = 0; i < n_bits; i++, reader->pos++)
+        value = value << 1 | ((reader->bytes[reader->pos / 8] >> (7 - reader->pos % 8)) & 1);
+    return value;
+}
+
+// decodes count characters of the segment into out
+static int decode_segment(bit_reader_t* reader, enum segment_mode_t mode, int count, uint8_t* out) {
+    static const int MAX_VALUE[4] = {1, 10, 100, 1000};
+    switch (mode) {
+        case MODE_NUMERIC:
+            for (int i = 0; i < count; i += 3) {
+                int n = count - i < 3 ? count - i : 3;
+                int value = read_bits(reader, 3 * n + 1);
+                if (value < 0 || value >= MAX_VALUE[n])
+                    return -1;
+                for (int k = n - 1; k >= 0; k--, value /= 10)
+                    out[i + k] = '0' + value % 10;
+            }
+            return 0;
+        case MODE_ALPHANUMERIC:
+            for (int i = 0; i < count; i += 2) {
+                if (i + 1 < count) {
+                    int value = read_bits(reader, 11);
+                    if (value < 0 || value >= 45 * 45)
+                        return -1;
+                    out[i] = ALPHANUMERIC_CHARS[value / 45];
+                    out[i + 1] = ALPHANUMERIC_CHARS[value % 45];
+                } else {
+                    int value = read_bits(reader, 6);
+                    if (value < 0 || value >= 45)
+                        return -1;
+                    out[i] = ALPHANUMERIC_CHARS[value];
+                }
+            }
+            return 0;
+        case MODE_KANJI:
+            for (int i = 0; i < count; i++) {
+                int value = read_bits(reader, 13);
+                if (value < 0)
+                    return -1;
+                int c = (value / 0xC0) << 8 | (value % 0xC0);
+                c += (c < 0x1F00 ? 0x8140 : 0xC140);
+                out[2 * i] = c >> 8;
+                out[2 * i + 1] = c & 0xFF;
+            }
+            return 0;
+        default:
+            for (int i = 0; i < count; i++) {
+                int value = read_bits(reader, 8);
+                if (value < 0)
+                    return -1;
+                out[i] = value;
+            }
+            return 0;
+    }
+}
+
+// Micro QR codes: whether the terminator (or as much of it as fits) comes next, skipping it if it does
+// (the mode indicators are shorter than the terminator and the numeric one is all zeros)
+static int skip_micro_terminator(bit_reader_t* reader, int group) {
+    int n_bits = terminator_bits(group);
+    if (reader->len_bits - reader->pos < n_bits)
+        n_bits = reader->len_bits - reader->pos;
+    int pos = reader->pos;
+    if (read_bits(reader, n_bits) == 0)
+        return 1;
+    reader->pos = pos;
+    return 0;
+}
+
+int decode_segments(const uint8_t* codewords, int n_bits, int group, uint8_t* out, int out_cap, int* eci,
+                    int* append, int* end_bits) {
+    static const int MODE_BYTES[N_SEGMENT_MODES] = {1, 1, 1, 2};
+    bit_reader_t reader = {.bytes = codewords, .len_bits = n_bits, .pos = 0};
+    int len = 0, micro = is_micro_group(group), indicator_bits = mode_indicator_bits(group);
+    *eci = 0;
+    *append = -1;
+    while (micro ? reader.pos < reader.len_bits : reader.len_bits - reader.pos >= indicator_bits) {
+        if (micro) {
+            if (skip_micro_terminator(&reader, group))
+                break;
+            // Micro QR codes have no ECI or Structured Append, their mode indicators are the indices of the modes
+            int mode = read_bits(&reader, mode_indicator_bits(group));
+            int count = (mode < 0 || mode >= N_SEGMENT_MODES || char_count_bits(mode, group) == 0
+                             ? -1
+                             : read_bits(&reader, char_count_bits(mode, group)));
+            if (count < 0 || len + (long)count * MODE_BYTES[mode] > out_cap ||
+                decode_segment(&reader, mode, count, out + len) == -1)
+                return -1;
+            len += count * MODE_BYTES[mode];
+            continue;
+        }
+        int indicator = read_bits(&reader, indicator_bits);
+        if (indicator == 0)
+            break;
+        // the Structured Append header comes before anything else (rMQR codes have none)
+        if (group < N_VERSION_GROUPS && indicator == APPEND_MODE_INDICATOR) {
+            if (reader.pos != 4 || (*append = read_bits(&reader, 16)) < 0)
+                return -1;
+            continue;
+        }
+        if (indicator == eci_mode_indicator(group)) {
+            int first = read_bits(&reader, 8);
+            if (first < 0 || *eci != 0 || len != 0)
+                return -1;
+            if ((first >> 7) == 0)
+                *eci = first;
+            else if ((first >> 6) == 0b10)
+                *eci = (first & 0x3F) << 8 | read_bits(&reader, 8);
+            else
+                *eci = (first & 0x1F) << 16 | read_bits(&reader, 16);
+            if (*eci <= 0)
+                return -1;
+            continue;
+        }
+        enum segment_mode_t mode = N_SEGMENT_MODES;
+        for (int m = 0; m < N_SEGMENT_MODES; m++) {
+            if (mode_indicator(m, group) == indicator)
+                mode = m;
+        }
+        if (mode == N_SEGMENT_MODES)
+            return -1;
+        int count = read_bits(&reader, char_count_bits(mode, group));
+        if (count < 0 || len + (long)count * MODE_BYTES[mode] > out_cap ||
+            decode_segment(&reader, mode, count, out + len) == -1)
+            return -1;
+        len += count * MODE_BYTES[mode];
+    }
+    *end_bits = reader.pos;
+    return len;
+}
+
+int decode_code(const bitset_t* code, uint8_t* out, int out_cap, decoded_info_t* info) {
+    uint8_t codewords[MAX_CODEWORDS];
+    uint8_t data_codewords[MAX_DATA_CODEWORDS];
+    int dim = code->width, version = (dim - 17) / 4;
+    if (code->height != dim || (dim - 17) % 4 != 0 || version < QUER_MIN_VERSION || version > QUER_MAX_VERSION)
+        return -1;
+
+    // the copy of the format info with fewer errors wins
+    enum quer_corr_level_t corr_level, other_corr_level;
+    int mask, other_mask;
+    int distance = decode_format_info(read_format_info(code, 0), &corr_level, &mask);
+    int other_distance = decode_format_info(read_format_info(code, 1), &other_corr_level, &other_mask);
+    if (other_distance < distance) {
+        distance = other_distance;
+        corr_level = other_corr_level;
+        mask = other_mask;
+    }
+    if (distance > MAX_INFO_ERRORS)
+        return -1;
+
+    const version_template_t* template = get_version_template(version);
+    // the remainder bits are ignored, a damaged code may have some of them flipped
+    read_codewords(code, &template->blocked, mask, codewords, TOTAL_AVAILABLE_MODULES[version] / 8 * 8);
+    int n_corrected = read_blocks(codewords, corr_level, version, 0, 1, data_codewords);
+    if (n_corrected == -1)
+        return -1;
+    int eci, append, end_bits;
+    int len = decode_segments(data_codewords, TOTAL_DATA_CODEWORDS[(int)corr_level][version] * 8,
+                              version_group(version), out, out_cap, &eci, &append, &end_bits);
+    if (len == -1)
+        return -1;
+    *info = (decoded_info_t){
+        .version = version, .corr_level = corr_level, .mask = mask, .eci = eci, .n_corrected = n_corrected};
+    if (append != -1) {
+        info->append_index = append >> 12;
+        info->append_total = (append >> 8 & 0xF) + 1;
+        info->append_parity = append & 0xFF;
+    }
+    return len;
+}
@@ -0,0 +1,69 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <stdint.h>
+
+#include "bitset.h"
+#include "quer.h"
+
+// TOTAL_AVAILABLE_MODULES[QUER_MAX_VERSION] / 8 and TOTAL_DATA_CODEWORDS[QUER_CORR_L][QUER_MAX_VERSION]
+#define MAX_CODEWORDS 3706
+#define MAX_DATA_CODEWORDS 2956
+
+// what was read from a code besides its data
+typedef struct decoded_info_t {
+    int version;
+    enum quer_corr_level_t corr_level;
+    int mask;
+    // 0 if there was no ECI header
+    int eci;
+    // number of codewords fixed by the error correction
+    int n_corrected;
+    // the Structured Append header (append_total is 0 if there was none)
+    int append_index;
+    int append_total;
+    int append_parity;
+} decoded_info_t;
+
+// the 15 bits of the format info (as stored in the code) for the error correction level and the mask
+int format_info_bits(enum quer_corr_level_t corr_level, int mask);
+// reads one of the two copies (0 next to the top left finder pattern, 1 split between the other two)
+int read_format_info(const bitset_t* code, int copy);
+// the same for Micro QR codes, whose format info holds the symbol number (the version and the level) and the mask,
+// in a single copy
+int micro_format_info_bits(int version, enum quer_corr_level_t corr_level, int mask);
+int read_micro_format_info(const bitset_t* code);
+// the same for rMQR codes, whose format info holds the version and the level (M or H) in 18 bits, with a copy next
+// to the finder pattern (copy 0) and one next to the sub-finder pattern (copy 1), each with a mask of its own
+int rmqr_format_info_bits(int version, enum quer_corr_level_t corr_level, int copy);
+int read_rmqr_format_info(const bitset_t* code, int copy);
+// finds the valid format info nearest to info, stores its level and mask and returns the number of differing bits
+int decode_format_info(int info, enum quer_corr_level_t* corr_level, int* mask);
+// reads the version info next to the top right (copy 0) or bottom left (copy 1) finder pattern, returns the
+// version of the nearest valid one, or -1 if more than 3 bits would have to be fixed
+int decode_version_info(const bitset_t* code, int copy);
+
+// follows the zigzag over the unmasked data modules (those not set in blocked), storing the first n_bits bits
+// as codewords (a last partial codeword in its most significant bits), mask is a QR code mask pattern
+// returns -1 if the remainder bits after them aren't zero
+int read_codewords(const bitset_t* code, const bitset_t* blocked, int mask, uint8_t* codewords, int n_bits);
+// splits the interleaved codewords into blocks and gathers their data codewords into data
+// (the blocks of an rMQR version if rmqr is set)
+// with correct set the blocks are fixed by the Reed-Solomon decoder, otherwise their syndromes must be zero
+// returns the number of corrected codewords, or -1 if a block is beyond repair
+int read_blocks(const uint8_t* codewords, enum quer_corr_level_t corr_level, int version, int rmqr, int correct,
+                uint8_t* data);
+// decodes the segments in the n_bits bits of the data codewords (planned for the group of versions) into out
+// (of out_cap bytes), Kanji characters as Shift JIS
+// stores the ECI assignment number (0 if there's none), the 16 bits of the Structured Append header after its mode
+// indicator (the index and count of the symbols and the parity, -1 if there's none)
+// and the position (in bits) right after the terminator
+// returns the length of the data, or -1 if the segments are malformed or don't fit in out
+int decode_segments(const uint8_t* codewords, int n_bits, int group, uint8_t* out, int out_cap, int* eci,
+                    int* append, int* end_bits);
+
+// decodes a sampled code (of any version, read from its version info or dimension), fixing the errors it can
+// returns the length of the data written to out, or -1 if the code can't be read
+int decode_code(const bitset_t* code, uint8_t* out, int out_cap, decoded_info_t* info);
+
+#endif  // DECODER_H
@@ -0,0 +1,451 @@
+#include "deflate.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define N_LITLEN 286
+#define N_DIST 30
+#define N_CODELEN 19
+#define END_OF_BLOCK 256
+#define MAX_CODE_BITS 15
+#define MAX_CODELEN_BITS 7
+// matches longer than this don't insert the positions they cover into the hash table
+#define MAX_INSERT_LEN 32
+#define ADLER_MOD 65521
+// the most bytes that can be summed before the Adler-32 sums could overflow 32 bits
+#define ADLER_NMAX 5552
+
+static const uint16_t LEN_BASE[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LEN_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                      2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DIST_BASE[N_DIST] = {1,    2,    3,    4,    5,    7,     9,     13,    17,    25,
+                                           33,   49,   65,   97,   129,  193,   257,   385,   513,   769,
+                                           1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+static const uint8_t DIST_EXTRA[N_DIST] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                           6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// the order in which the lengths of the code length code are stored
+static const uint8_t CODELEN_ORDER[N_CODELEN] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+uint32_t adler32_update(uint32_t adler, const uint8_t* data, size_t len) {
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (len > 0) {
+        size_t n = len < ADLER_NMAX ? len : ADLER_NMAX;
+        len -= n;
+        while (n-- > 0) {
+            a += *data++;
+            b += a;
+        }
+        a %= ADLER_MOD;
+        b %= ADLER_MOD;
+    }
+    return (b << 16) | a;
+}
+
+static void flush_out(deflate_t* deflate) {
+    if (deflate->out_len > 0)
+        deflate->sink(deflate->sink_ctx, deflate->out, deflate->out_len);
+    deflate->out_len = 0;
+}
+
+static void put_byte(deflate_t* deflate, uint8_t byte) {
+    if (deflate->out_len == DEFLATE_OUT_SIZE)
+        flush_out(deflate);
+    deflate->out[deflate->out_len++] = byte;
+}
+
+// deflate packs the bits starting from the least significant one
+static void put_bits(deflate_t* deflate, uint32_t value, int n_bits) {
+    deflate->bit_buf |= (uint64_t)value << deflate->bit_count;
+    deflate->bit_count += n_bits;
+    while (deflate->bit_count >= 8) {
+        put_byte(deflate, deflate->bit_buf & 0xFF);
+        deflate->bit_buf >>= 8;
+        deflate->bit_count -= 8;
+    }
+}
+
+static void align_to_byte(deflate_t* deflate) {
+    if (deflate->bit_count > 0)
+        put_bits(deflate, 0, 8 - deflate->bit_count);
+}
+
+static void write_stored_block(deflate_t* deflate, const uint8_t* data, int len, int final) {
+    put_bits(deflate, final, 1);
+    put_bits(deflate, 0, 2);
+    align_to_byte(deflate);
+    put_bits(deflate, len, 16);
+    put_bits(deflate, ~len & 0xFFFF, 16);
+    while (len > 0) {
+        if (deflate->out_len == DEFLATE_OUT_SIZE)
+            flush_out(deflate);
+        int n = DEFLATE_OUT_SIZE - deflate->out_len;
+        if (n > len)
+            n = len;
+        memcpy(deflate->out + deflate->out_len, data, n);
+        deflate->out_len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+// returns the index of the largest base that is <= value
+static int find_code(const uint16_t* base, int n, int value) {
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (base[mid] <= value)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+// a code with a single symbol is incomplete, which some decoders reject
+static void ensure_two_symbols(uint32_t* freq, int n) {
+    int n_used = 0;
+    for (int i = 0; i < n; i++)
+        n_used += freq[i] > 0;
+    for (int i = 0; n_used < 2 && i < n; i++) {
+        if (freq[i] == 0) {
+            freq[i] = 1;
+            n_used++;
+        }
+    }
+}
+
+// computes the lengths of a Huffman code for the used symbols, returns 0 if a length exceeds max_bits
+static int build_lengths_once(const uint32_t* freq, int n, int max_bits, uint8_t* lengths) {
+    int symbols[N_LITLEN], n_leaves = 0;
+    for (int i = 0; i < n; i++) {
+        lengths[i] = 0;
+        if (freq[i] > 0)
+            symbols[n_leaves++] = i;
+    }
+    if (n_leaves < 2) {
+        if (n_leaves == 1)
+            lengths[symbols[0]] = 1;
+        return 1;
+    }
+    for (int i = 1; i < n_leaves; i++) {
+        int symbol = symbols[i], j = i;
+        for (; j > 0 && freq[symbols[j - 1]] > freq[symbol]; j--)
+            symbols[j] = symbols[j - 1];
+        symbols[j] = symbol;
+    }
+
+    // two queues: the sorted leaves and the internal nodes, which are created in nondecreasing weight order
+    uint32_t weight[2 * N_LITLEN];
+    int parent[2 * N_LITLEN], depth[2 * N_LITLEN];
+    for (int i = 0; i < n_leaves; i++)
+        weight[i] = freq[symbols[i]];
+    int next_leaf = 0, next_node = n_leaves, n_nodes = n_leaves;
+    while (n_nodes < 2 * n_leaves - 1) {
+        int pair[2];
+        for (int k = 0; k < 2; k++) {
+            if (next_leaf < n_leaves && (next_node == n_nodes || weight[next_leaf] <= weight[next_node]))
+                pair[k] = next_leaf++;
+            else
+                pair[k] = next_node++;
+        }
+        weight[n_nodes] = weight[pair[0]] + weight[pair[1]];
+        parent[pair[0]] = parent[pair[1]] = n_nodes;
+        n_nodes++;
+    }
+    depth[n_nodes - 1] = 0;
+    for (int i = n_nodes - 2; i >= 0; i--)
+        depth[i] = depth[parent[i]] + 1;
+    for (int i = 0; i < n_leaves; i++) {
+        if (depth[i] > max_bits)
+            return 0;
+        lengths[symbols[i]] = depth[i];
+    }
+    return 1;
+}
+
+// flattens the frequencies until the code fits in max_bits
+static void build_lengths(const uint32_t* freq, int n, int max_bits, uint8_t* lengths) {
+    uint32_t weights[N_LITLEN];
+    memcpy(weights, freq, n * sizeof(uint32_t));
+    while (!build_lengths_once(weights, n, max_bits, lengths)) {
+        for (int i = 0; i < n; i++) {
+            if (weights[i] > 0)
+                weights[i] = (weights[i] >> 1) | 1;
+        }
+    }
+}
+
+// canonical codes, bit-reversed since deflate stores them starting from the most significant bit
+static void build_codes(const uint8_t* lengths, int n, uint16_t* codes) {
+    int bl_count[MAX_CODE_BITS + 1] = {0}, next_code[MAX_CODE_BITS + 1];
+    for (int i = 0; i < n; i++)
+        bl_count[lengths[i]]++;
+    bl_count[0] = 0;
+    int code = 0;
+    for (int bits = 1; bits <= MAX_CODE_BITS; bits++) {
+        code = (code + bl_count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+    for (int i = 0; i < n; i++) {
+        if (lengths[i] == 0)
+            continue;
+        int c = next_code[lengths[i]]++, reversed = 0;
+        for (int b = 0; b < lengths[i]; b++)
+            reversed |= ((c >> b) & 1) << (lengths[i] - 1 - b);
+        codes[i] = reversed;
+    }
+}
+
+// writes the buffered tokens as a block with dynamic Huffman codes
+static void write_block(deflate_t* deflate, int final) {
+    uint32_t litlen_freq[N_LITLEN] = {0}, dist_freq[N_DIST] = {0};
+    for (int i = 0; i < deflate->n_tokens; i++) {
+        if (deflate->token_len[i] == 0) {
+            litlen_freq[deflate->token_dist[i]]++;
+            continue;
+        }
+        litlen_freq[END_OF_BLOCK + 1 + find_code(LEN_BASE, 29, deflate->token_len[i])]++;
+        dist_freq[find_code(DIST_BASE, N_DIST, deflate->token_dist[i])]++;
+    }
+    litlen_freq[END_OF_BLOCK] = 1;
+    ensure_two_symbols(litlen_freq, N_LITLEN);
+    ensure_two_symbols(dist_freq, N_DIST);
+
+    uint8_t litlen_lengths[N_LITLEN], dist_lengths[N_DIST];
+    uint16_t litlen_codes[N_LITLEN], dist_codes[N_DIST];
+    build_lengths(litlen_freq, N_LITLEN, MAX_CODE_BITS, litlen_lengths);
+    build_lengths(dist_freq, N_DIST, MAX_CODE_BITS, dist_lengths);
+    build_codes(litlen_lengths, N_LITLEN, litlen_codes);
+    build_codes(dist_lengths, N_DIST, dist_codes);
+    int n_litlen = N_LITLEN, n_dist = N_DIST;
+    while (n_litlen > END_OF_BLOCK + 1 && litlen_lengths[n_litlen - 1] == 0)
+        n_litlen--;
+    while (n_dist > 1 && dist_lengths[n_dist - 1] == 0)
+        n_dist--;
+
+    // the code lengths of both codes form a single sequence, compressed with repeat symbols:
+    // 16 repeats the previous length 3-6 times, 17 repeats zero 3-10 times and 18 repeats zero 11-138 times
+    uint8_t lengths[N_LITLEN + N_DIST], cl_symbols[N_LITLEN + N_DIST], cl_extra[N_LITLEN + N_DIST];
+    int n_lengths = n_litlen + n_dist, n_cl_symbols = 0;
+    memcpy(lengths, litlen_lengths, n_litlen);
+    memcpy(lengths + n_litlen, dist_lengths, n_dist);
+    for (int i = 0; i < n_lengths;) {
+        int len = lengths[i], run = 1;
+        while (i + run < n_lengths && lengths[i + run] == len)
+            run++;
+        i += run;
+        if (len == 0) {
+            while (run >= 11) {
+                int r = run < 138 ? run : 138;
+                cl_symbols[n_cl_symbols] = 18;
+                cl_extra[n_cl_symbols++] = r - 11;
+                run -= r;
+            }
+            if (run >= 3) {
+                cl_symbols[n_cl_symbols] = 17;
+                cl_extra[n_cl_symbols++] = run - 3;
+                run = 0;
+            }
+        } else {
+            cl_symbols[n_cl_symbols++] = len;
+            run--;
+            while (run >= 3) {
+                int r = run < 6 ? run : 6;
+                cl_symbols[n_cl_symbols] = 16;
+                cl_extra[n_cl_symbols++] = r - 3;
+                run -= r;
+            }
+        }
+        for (; run > 0; run--)
+            cl_symbols[n_cl_symbols++] = len;
+    }
+    uint32_t cl_freq[N_CODELEN] = {0};
+    uint8_t cl_lengths[N_CODELEN];
+    uint16_t cl_codes[N_CODELEN];
+    for (int i = 0; i < n_cl_symbols; i++)
+        cl_freq[cl_symbols[i]]++;
+    ensure_two_symbols(cl_freq, N_CODELEN);
+    build_lengths(cl_freq, N_CODELEN, MAX_CODELEN_BITS, cl_lengths);
+    build_codes(cl_lengths, N_CODELEN, cl_codes);
+    int n_cl = N_CODELEN;
+    while (n_cl > 4 && cl_lengths[CODELEN_ORDER[n_cl - 1]] == 0)
+        n_cl--;
+
+    put_bits(deflate, final, 1);
+    put_bits(deflate, 2, 2);
+    put_bits(deflate, n_litlen - END_OF_BLOCK - 1, 5);
+    put_bits(deflate, n_dist - 1, 5);
+    put_bits(deflate, n_cl - 4, 4);
+    for (int i = 0; i < n_cl; i++)
+        put_bits(deflate, cl_lengths[CODELEN_ORDER[i]], 3);
+    for (int i = 0; i < n_cl_symbols; i++) {
+        int symbol = cl_symbols[i];
+        put_bits(deflate, cl_codes[symbol], cl_lengths[symbol]);
+        if (symbol == 16)
+            put_bits(deflate, cl_extra[i], 2);
+        else if (symbol == 17)
+            put_bits(deflate, cl_extra[i], 3);
+        else if (symbol == 18)
+            put_bits(deflate, cl_extra[i], 7);
+    }
+
+    for (int i = 0; i < deflate->n_tokens; i++) {
+        int len = deflate->token_len[i], dist = deflate->token_dist[i];
+        if (len == 0) {
+            put_bits(deflate, litlen_codes[dist], litlen_lengths[dist]);
+            continue;
+        }
+        int len_code = find_code(LEN_BASE, 29, len), dist_code = find_code(DIST_BASE, N_DIST, dist);
+        int symbol = END_OF_BLOCK + 1 + len_code;
+        put_bits(deflate, litlen_codes[symbol], litlen_lengths[symbol]);
+        put_bits(deflate, len - LEN_BASE[len_code], LEN_EXTRA[len_code]);
+        put_bits(deflate, dist_codes[dist_code], dist_lengths[dist_code]);
+        put_bits(deflate, dist - DIST_BASE[dist_code], DIST_EXTRA[dist_code]);
+    }
+    put_bits(deflate, litlen_codes[END_OF_BLOCK], litlen_lengths[END_OF_BLOCK]);
+    deflate->n_tokens = 0;
+}
+
+static void add_token(deflate_t* deflate, int len, int dist) {
+    deflate->token_len[deflate->n_tokens] = len;
+    deflate->token_dist[deflate->n_tokens] = dist;
+    if (++deflate->n_tokens == DEFLATE_MAX_TOKENS)
+        write_block(deflate, 0);
+}
+
+static uint32_t hash3(const uint8_t* p) {
+    uint32_t v = p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+    return (v * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+// turns the pending bytes into tokens, keeping MAX_MATCH bytes of lookahead unless it's the end of the stream
+static void compress(deflate_t* deflate, int flush) {
+    const uint8_t* window = deflate->window;
+    int end = flush ? deflate->window_end : deflate->window_end - MAX_MATCH;
+    while (deflate->window_pos < end) {
+        int pos = deflate->window_pos;
+        int max_len = deflate->window_end - pos < MAX_MATCH ? deflate->window_end - pos : MAX_MATCH;
+        // runs are the cheapest matches (distance 1 needs no extra bits), so the fast mode only takes a longer match
+        int best_len = 0, best_dist = 1;
+        if (pos > 0) {
+            while (best_len < max_len && window[pos + best_len] == window[pos - 1])
+                best_len++;
+        }
+        if (deflate->mode == DEFLATE_FAST && max_len >= MIN_MATCH) {
+            uint32_t h = hash3(window + pos);
+            int candidate = deflate->head[h];
+            deflate->head[h] = pos;
+            if (candidate >= 0 && pos - candidate <= DEFLATE_WINDOW_SIZE && best_len < max_len) {
+                int len = 0;
+                while (len < max_len && window[candidate + len] == window[pos + len])
+                    len++;
+                if (len > best_len) {
+                    best_len = len;
+                    best_dist = pos - candidate;
+                }
+            }
+        }
+
+        if (best_len < MIN_MATCH) {
+            add_token(deflate, 0, window[pos]);
+            deflate->window_pos++;
+            continue;
+        }
+        add_token(deflate, best_len, best_dist);
+        if (deflate->mode == DEFLATE_FAST && best_len <= MAX_INSERT_LEN) {
+            for (int i = pos + 1; i < pos + best_len && i + MIN_MATCH <= deflate->window_end; i++)
+                deflate->head[hash3(window + i)] = i;
+        }
+        deflate->window_pos += best_len;
+    }
+}
+
+// drops the older half of the window
+static void slide_window(deflate_t* deflate) {
+    memmove(deflate->window, deflate->window + DEFLATE_WINDOW_SIZE, deflate->window_end - DEFLATE_WINDOW_SIZE);
+    deflate->window_pos -= DEFLATE_WINDOW_SIZE;
+    deflate->window_end -= DEFLATE_WINDOW_SIZE;
+    if (deflate->mode != DEFLATE_FAST)
+        return;
+    for (int h = 0; h < (1 << DEFLATE_HASH_BITS); h++)
+        deflate->head[h] = deflate->head[h] >= DEFLATE_WINDOW_SIZE ? deflate->head[h] - DEFLATE_WINDOW_SIZE : -1;
+}
+
+int deflate_init(deflate_t* deflate) {
+    deflate->window = malloc(2 * DEFLATE_WINDOW_SIZE);
+    deflate->head = malloc((1 << DEFLATE_HASH_BITS) * sizeof(int32_t));
+    deflate->token_len = malloc(DEFLATE_MAX_TOKENS * sizeof(uint16_t));
+    deflate->token_dist = malloc(DEFLATE_MAX_TOKENS * sizeof(uint16_t));
+    if (deflate->window == NULL || deflate->head == NULL || deflate->token_len == NULL ||
+        deflate->token_dist == NULL) {
+        deflate_free(deflate);
+        return -1;
+    }
+    return 0;
+}
+
+void deflate_start(deflate_t* deflate, enum deflate_mode_t mode, deflate_sink_t sink, void* sink_ctx) {
+    deflate->mode = mode;
+    deflate->sink = sink;
+    deflate->sink_ctx = sink_ctx;
+    deflate->adler = 1;
+    deflate->window_pos = 0;
+    deflate->window_end = 0;
+    deflate->n_tokens = 0;
+    deflate->bit_buf = 0;
+    deflate->bit_count = 0;
+    deflate->out_len = 0;
+    if (mode == DEFLATE_FAST)
+        memset(deflate->head, 0xFF, (1 << DEFLATE_HASH_BITS) * sizeof(int32_t));
+    // deflate with a 32K window, no preset dictionary, and a check value that makes the header a multiple of 31
+    put_byte(deflate, 0x78);
+    put_byte(deflate, 0x01);
+}
+
+void deflate_write(deflate_t* deflate, const uint8_t* data, size_t len) {
+    deflate->adler = adler32_update(deflate->adler, data, len);
+    // stored blocks use the first half of the window as a buffer
+    size_t limit = deflate->mode == DEFLATE_STORED ? DEFLATE_WINDOW_SIZE : 2 * DEFLATE_WINDOW_SIZE;
+    while (len > 0) {
+        size_t n = limit - deflate->window_end;
+        if (n > len)
+            n = len;
+        memcpy(deflate->window + deflate->window_end, data, n);
+        deflate->window_end += n;
+        data += n;
+        len -= n;
+        if (deflate->mode == DEFLATE_STORED) {
+            if ((size_t)deflate->window_end == limit) {
+                write_stored_block(deflate, deflate->window, deflate->window_end, 0);
+                deflate->window_end = 0;
+            }
+            continue;
+        }
+        compress(deflate, 0);
+        if ((size_t)deflate->window_end == limit)
+            slide_window(deflate);
+    }
+}
+
+void deflate_finish(deflate_t* deflate) {
+    if (deflate->mode == DEFLATE_STORED) {
+        write_stored_block(deflate, deflate->window, deflate->window_end, 1);
+    } else {
+        compress(deflate, 1);
+        write_block(deflate, 1);
+    }
+    align_to_byte(deflate);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        put_byte(deflate, (deflate->adler >> shift) & 0xFF);
+    flush_out(deflate);
+}
+
+void deflate_free(deflate_t* deflate) {
+    free(deflate->window);
+    free(deflate->head);
+    free(deflate->token_len);
+    free(deflate->token_dist);
+}
@@ -0,0 +1,56 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFLATE_WINDOW_SIZE (1 << 15)
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_MAX_TOKENS (1 << 14)
+#define DEFLATE_OUT_SIZE (1 << 14)
+
+enum deflate_mode_t {
+    // no compression, only stored blocks
+    DEFLATE_STORED,
+    // only runs of repeated bytes (matches at distance 1), plus dynamic Huffman codes
+    DEFLATE_RLE,
+    // greedy LZ77 with a single hash candidate, plus dynamic Huffman codes
+    DEFLATE_FAST,
+};
+
+// receives the compressed stream in pieces
+typedef void (*deflate_sink_t)(void* ctx, const uint8_t* data, size_t len);
+
+// a zlib stream (RFC 1950) wrapping a deflate stream (RFC 1951), written incrementally
+typedef struct deflate_t {
+    enum deflate_mode_t mode;
+    deflate_sink_t sink;
+    void* sink_ctx;
+    uint32_t adler;
+    // the last DEFLATE_WINDOW_SIZE bytes already compressed, then the pending ones
+    uint8_t* window;
+    int window_pos;
+    int window_end;
+    // the latest window position of each hash of 3 bytes, -1 if none
+    int32_t* head;
+    // tokens of the current block, len 0 means that dist is a literal byte
+    uint16_t* token_len;
+    uint16_t* token_dist;
+    int n_tokens;
+    uint64_t bit_buf;
+    int bit_count;
+    uint8_t out[DEFLATE_OUT_SIZE];
+    int out_len;
+} deflate_t;
+
+int deflate_init(deflate_t* deflate);
+// writes the zlib header, the state can be reused for multiple streams
+void deflate_start(deflate_t* deflate, enum deflate_mode_t mode, deflate_sink_t sink, void* sink_ctx);
+void deflate_write(deflate_t* deflate, const uint8_t* data, size_t len);
+// writes the final block and the zlib trailer
+void deflate_finish(deflate_t* deflate);
+void deflate_free(deflate_t* deflate);
+
+uint32_t adler32_update(uint32_t adler, const uint8_t* data, size_t len);
+
+#endif  // DEFLATE_H
@@ -0,0 +1,157 @@
+#include "formats.h"
+
+#include <ctype.h>
+
+int write_svg(const bitset_t* code, int ppm, int padding, FILE* file) {
+    int width = code->width + 2 * padding, height = code->height + 2 * padding;
+    fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(file,
+            "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%lld\" height=\"%lld\" viewBox=\"0 0 %d %d\" "
+            "shape-rendering=\"crispEdges\">\n",
+            (long long)width * ppm, (long long)height * ppm, width, height);
+    fprintf(file, "<rect width=\"%d\" height=\"%d\" fill=\"#fff\"/>\n<path fill=\"#000\" d=\"", width, height);
+    for (int y = 0; y < code->height; y++) {
+        int x = 0, run_end;
+        while ((x = bitset_next_run(code, y, x, &run_end)) != -1) {
+            fprintf(file, "M%d %dh%dv1h-%dz", padding + x, padding + y, run_end - x, run_end - x);
+            x = run_end;
+        }
+    }
+    fprintf(file, "\"/>\n</svg>\n");
+    return ferror(file) ? -1 : 0;
+}
+
+int write_eps(const bitset_t* code, int ppm, int padding, FILE* file) {
+    int width = code->width + 2 * padding, height = code->height + 2 * padding;
+    fprintf(file, "%%!PS-Adobe-3.0 EPSF-3.0\n%%%%BoundingBox: 0 0 %lld %lld\n%%%%EndComments\n",
+            (long long)width * ppm, (long long)height * ppm);
+    fprintf(file, "/r { 1 rectfill } bind def\n%d %d scale\n1 setgray 0 0 %d %d rectfill\n0 setgray\n", ppm, ppm,
+            width, height);
+    // PostScript's y axis points up
+    for (int y = 0; y < code->height; y++) {
+        int x = 0, run_end;
+        while ((x = bitset_next_run(code, y, x, &run_end)) != -1) {
+            fprintf(file, "%d %d %d r\n", padding + x, height - 1 - padding - y, run_end - x);
+            x = run_end;
+        }
+    }
+    fprintf(file, "showpage\n%%%%EOF\n");
+    return ferror(file) ? -1 : 0;
+}
+
+int write_raw(const bitset_t* code, FILE* file) {
+    int row_bytes = (code->width + 7) / 8;
+    uint8_t* row = malloc(row_bytes);
+    if (row == NULL)
+        return -1;
+    for (int y = 0; y < code->height; y++) {
+        memset(row, 0, row_bytes);
+        int x = 0, run_end;
+        while ((x = bitset_next_run(code, y, x, &run_end)) != -1) {
+            for (; x < run_end; x++)
+                row[x / 8] |= 0x80 >> (x % 8);
+        }
+        if (fwrite(row, 1, row_bytes, file) != (size_t)row_bytes) {
+            free(row);
+            return -1;
+        }
+    }
+    free(row);
+    return 0;
+}
+
+int write_pbm(const raster_t* raster, FILE* file) {
+    uint8_t* chunk = malloc(RASTER_CHUNK_BYTES);
+    if (chunk == NULL)
+        return -1;
+    fprintf(file, "P4\n%d %d\n", raster->width, raster->height);
+    int prev = -2;
+    for (int y = 0; y < raster->height && !ferror(file); y++) {
+        int module_row = raster_module_row(raster, y);
+        for (size_t start = 0; start < (size_t)raster->row_bytes; start += RASTER_CHUNK_BYTES) {
+            size_t len = raster_chunk_len(raster, start);
+            // a row that fits in one chunk is only rendered once for all its repetitions
+            if (module_row != prev || len < (size_t)raster->row_bytes)
+                raster_render(raster, module_row, start, len, chunk);
+            fwrite(chunk, 1, len, file);
+        }
+        prev = module_row;
+    }
+    free(chunk);
+    return ferror(file) ? -1 : 0;
+}
+
+int write_pgm(const raster_t* raster, FILE* file) {
+    uint8_t* chunk = malloc(RASTER_CHUNK_BYTES);
+    uint8_t* pixels = malloc(8 * RASTER_CHUNK_BYTES);
+    if (chunk == NULL || pixels == NULL) {
+        free(chunk);
+        free(pixels);
+        return -1;
+    }
+    fprintf(file, "P5\n%d %d\n255\n", raster->width, raster->height);
+    for (int y = 0; y < raster->height && !ferror(file); y++) {
+        int module_row = raster_module_row(raster, y);
+        for (size_t start = 0; start < (size_t)raster->row_bytes; start += RASTER_CHUNK_BYTES) {
+            size_t len = raster_chunk_len(raster, start);
+            size_t n_pixels = (size_t)raster->width - 8 * start < 8 * len ? (size_t)raster->width - 8 * start : 8 * len;
+            raster_render(raster, module_row, start, len, chunk);
+            for (size_t x = 0; x < n_pixels; x++)
+                pixels[x] = (chunk[x / 8] >> (7 - x % 8)) & 1 ? 0 : 255;
+            fwrite(pixels, 1, n_pixels, file);
+        }
+    }
+    free(chunk);
+    free(pixels);
+    return ferror(file) ? -1 : 0;
+}
+
+// the next number of a PNM header (after whitespace and comments), -1 if there's none
+static long read_pnm_number(const uint8_t* file, size_t len, size_t* pos) {
+    while (*pos < len && (isspace(file[*pos]) || file[*pos] == '#')) {
+        if (file[*pos] == '#') {
+            while (*pos < len && file[*pos] != '\n')
+                (*pos)++;
+        } else {
+            (*pos)++;
+        }
+    }
+    if (*pos == len || !isdigit(file[*pos]))
+        return -1;
+    long n = 0;
+    for (; *pos < len && isdigit(file[*pos]) && n <= PNM_MAX_DIM; (*pos)++)
+        n = 10 * n + (file[*pos] - '0');
+    return n;
+}
+
+int read_pnm(const uint8_t* file, size_t len, quer_image_t* image) {
+    if (len < 2 || file[0] != 'P' || (file[1] != '4' && file[1] != '5'))
+        return -1;
+    int is_pbm = (file[1] == '4');
+    size_t pos = 2;
+    long width = read_pnm_number(file, len, &pos), height = read_pnm_number(file, len, &pos);
+    long max_value = is_pbm ? 1 : read_pnm_number(file, len, &pos);
+    if (width <= 0 || height <= 0 || width > PNM_MAX_DIM || height > PNM_MAX_DIM || max_value <= 0 ||
+        max_value > 255 || pos == len || !isspace(file[pos]))
+        return -1;
+    // a single whitespace character separates the header from the pixels
+    pos++;
+    size_t row_bytes = is_pbm ? (width + 7) / 8 : width;
+    if ((len - pos) / row_bytes < (size_t)height)
+        return -1;
+    uint8_t* pixels = malloc((size_t)width * height);
+    if (pixels == NULL)
+        return -1;
+    for (long y = 0; y < height; y++) {
+        const uint8_t* row = file + pos + y * row_bytes;
+        for (long x = 0; x < width; x++) {
+            // PBM stores dark pixels as 1 bits, the leftmost pixel in the most significant bit
+            if (is_pbm)
+                pixels[y * width + x] = (row[x / 8] >> (7 - x % 8)) & 1 ? 0 : 255;
+            else
+                pixels[y * width + x] = row[x] * 255 / max_value;
+        }
+    }
+    *image = (quer_image_t){.pixels = pixels, .width = width, .height = height, .stride = width};
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef FORMATS_H
+#define FORMATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bitset.h"
+#include "quer.h"
+#include "raster.h"
+
+// the largest width and height of the images accepted by read_pnm
+#define PNM_MAX_DIM 16384
+
+// writers of the output formats other than PNG
+// the vector and raw formats are generated straight from the modules, so their cost doesn't depend on ppm
+
+// SVG with a single path, one subpath per horizontal run of dark modules, ppm units per module
+int write_svg(const bitset_t* code, int ppm, int padding, FILE* file);
+// Encapsulated PostScript, one rectangle per horizontal run of dark modules, ppm points per module
+int write_eps(const bitset_t* code, int ppm, int padding, FILE* file);
+// the modules without the quiet zone, one bit per module (1 for dark), each row padded to whole bytes,
+// the leftmost module in the most significant bit
+int write_raw(const bitset_t* code, FILE* file);
+// binary PBM (P4), the raster must use dark_bit 1
+int write_pbm(const raster_t* raster, FILE* file);
+// binary PGM (P5), 8 bits per pixel, the raster must use dark_bit 1
+int write_pgm(const raster_t* raster, FILE* file);
+
+// parses a binary PBM (P4) or PGM (P5, up to 8 bits per pixel) file of len bytes into an 8-bit grayscale image,
+// its pixels are allocated and must be freed by the caller, returns -1 if the file is malformed
+int read_pnm(const uint8_t* file, size_t len, quer_image_t* image);
+
+#endif  // FORMATS_H
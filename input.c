@@ -0,0 +1,99 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "input.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// maps the rest of the file from its current offset (e.g. of stdin redirected from a file that was read in part)
+static int map_fd(input_t *input, int fd) {
+    input_release(input);
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+        return -1;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (offset == -1)
+        return -1;
+    input->data = "";
+    if (offset >= st.st_size)
+        return 0;
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return -1;
+    // batches are scanned from start to end
+    posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+    input->map = map;
+    input->map_len = st.st_size;
+    input->data = (const char *)map + offset;
+    input->len = st.st_size - offset;
+    return 0;
+}
+
+// reads until the end of the stream (pipes return it in pieces) or until max_len + 1 bytes
+static int read_fd(input_t *input, int fd, size_t max_len) {
+    input_release(input);
+    size_t len = 0, limit = (max_len == SIZE_MAX ? SIZE_MAX : max_len + 1);
+    while (len < limit) {
+        if (len == input->buf_cap) {
+            size_t new_cap = input->buf_cap == 0 ? 4096 : 2 * input->buf_cap;
+            char *new_buf = realloc(input->buf, new_cap);
+            if (new_buf == NULL)
+                return -1;
+            input->buf = new_buf;
+            input->buf_cap = new_cap;
+        }
+        size_t n_wanted = input->buf_cap - len;
+        if (n_wanted > limit - len)
+            n_wanted = limit - len;
+        ssize_t n = read(fd, input->buf + len, n_wanted);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+        if (n == 0)
+            break;
+        len += n;
+    }
+    input->data = (input->buf == NULL ? "" : input->buf);
+    input->len = len;
+    return 0;
+}
+
+int input_map(input_t *input, FILE *stream) { return map_fd(input, fileno(stream)); }
+
+int input_read(input_t *input, FILE *stream, size_t max_len) {
+    int fd = fileno(stream);
+    if (map_fd(input, fd) == 0)
+        return 0;
+    return read_fd(input, fd, max_len);
+}
+
+int input_read_file(input_t *input, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    int status = (map_fd(input, fd) == 0 ? 0 : read_fd(input, fd, SIZE_MAX));
+    close(fd);
+    return status;
+}
+
+void input_release(input_t *input) {
+    if (input->map != NULL)
+        munmap(input->map, input->map_len);
+    input->map = NULL;
+    input->map_len = 0;
+    input->data = "";
+    input->len = 0;
+}
+
+void input_free(input_t *input) {
+    input_release(input);
+    free(input->buf);
+    input->buf = NULL;
+    input->buf_cap = 0;
+}
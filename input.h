@@ -0,0 +1,32 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// the contents of a file or a stream: mapped into memory if it's a regular file (so it's never copied), read in
+// a loop otherwise, data holds exactly len bytes (NULs included)
+typedef struct input_t {
+    const char *data;
+    size_t len;
+    // the mapping, NULL if the input was read (or is empty)
+    void *map;
+    size_t map_len;
+    // the buffer the input was read into, reused by the next read
+    char *buf;
+    size_t buf_cap;
+} input_t;
+
+// maps the rest of the stream if it's a regular file, returns -1 if it isn't (or can't be mapped)
+// the stream is used through its file descriptor, so nothing of it may be buffered by stdio
+int input_map(input_t *input, FILE *stream);
+// maps or reads the rest of the stream, reading stops after max_len + 1 bytes (so that a longer input can be
+// told apart without reading all of it), returns -1 on error
+int input_read(input_t *input, FILE *stream, size_t max_len);
+// maps or reads the whole file, returns -1 on error
+int input_read_file(input_t *input, const char *path);
+// unmaps the input, the buffer is kept for the next one
+void input_release(input_t *input);
+void input_free(input_t *input);
+
+#endif  // INPUT_H
@@ -1,10 +1,26 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+#ifndef QUER_NO_LIBPNG
 #include <png.h>
+#endif
 
 #include "bitset.h"
-#include "bitstream.h"
-#include "reed_solomon.h"
+#include "cache.h"
+#include "formats.h"
+#include "input.h"
+#include "png_writer.h"
+#include "quer.h"
+#include "raster.h"
+#include "serve.h"
+#include "templates.h"
 
 #define ERR_AND_DIE(...)                                                                         \
     (fprintf(stderr, "fatal error: %s:%d - ", __FILE__, __LINE__), fprintf(stderr, __VA_ARGS__), \
@@ -13,94 +29,255 @@
     "quer [-i input_file (default: stdin)] [-o output_file (default: stdout)] [-[l]ow/-[m]edium/-[q]uartile/-[h]igh " \
     "(error correction level, "                                                                                       \
     "default: "                                                                                                       \
-    "-l)] [-p pixels_per_module (default: 20)]"
-
-// data capacity (in bytes) for given error correction level and version
-static const int CAPACITY[4][41] = {
-    {0,    17,   32,   53,   78,   106,  134,  154,  190,  226,  262,  321,  367,  419,
-     461,  523,  589,  647,  714,  792,  858,  929,  1003, 1091, 1171, 1273, 1367, 1465,
-     1528, 1628, 1732, 1840, 1952, 2068, 2188, 2303, 2431, 2563, 2699, 2809, 2953},
-    {0,    14,   26,   42,   62,   84,   106,  122,  152,  180,  213,  251,  287,  331,
-     362,  412,  450,  504,  560,  624,  666,  711,  779,  857,  911,  997,  1059, 1125,
-     1190, 1264, 1370, 1452, 1538, 1628, 1722, 1809, 1911, 1989, 2099, 2213, 2331},
-    {0,   11,  20,  32,  46,  60,  74,  86,  108, 130, 151,  177,  203,  241,  258,  292,  322,  364,  394,  442, 482,
-     509, 565, 611, 661, 715, 751, 805, 868, 908, 982, 1030, 1112, 1168, 1228, 1283, 1351, 1423, 1499, 1579, 1663},
-    {0,   7,   14,  24,  34,  44,  58,  64,  84,  98,  119, 137, 155, 177, 194, 220,  250,  280,  310,  338, 382,
-     403, 439, 461, 511, 535, 593, 625, 658, 698, 742, 790, 842, 898, 958, 983, 1051, 1093, 1139, 1219, 1273}};
-static const int MAX_CAPACITY = 2953;
-
-// total number of data codewords for given error correction level and version
-static const int TOTAL_DATA_CODEWORDS[4][41] = {
-    {0,    19,   34,   55,   80,   108,  136,  156,  194,  232,  274,  324,  370,  428,
-     461,  523,  589,  647,  721,  795,  861,  932,  1006, 1094, 1174, 1276, 1370, 1468,
-     1531, 1631, 1735, 1843, 1955, 2071, 2191, 2306, 2434, 2566, 2702, 2812, 2956},
-    {0,    16,   28,   44,   64,   86,   108,  124,  154,  182,  216,  254,  290,  334,
-     365,  415,  453,  507,  563,  627,  669,  714,  782,  860,  914,  1000, 1062, 1128,
-     1193, 1267, 1373, 1455, 1541, 1631, 1725, 1812, 1914, 1992, 2102, 2216, 2334},
-    {0,   13,  22,  34,  48,  62,  76,  88,  110, 132, 154,  180,  206,  244,  261,  295,  325,  367,  397,  445, 485,
-     512, 568, 614, 664, 718, 754, 808, 871, 911, 985, 1033, 1115, 1171, 1231, 1286, 1354, 1426, 1502, 1582, 1666},
-    {0,   9,   16,  26,  36,  46,  60,  66,  86,  100, 122, 140, 158, 180, 197, 223,  253,  283,  313,  341, 385,
-     406, 442, 464, 514, 538, 596, 628, 661, 701, 745, 793, 845, 901, 961, 986, 1054, 1096, 1142, 1222, 1276}};
-
-// number of modules (bits) available in the entire code (excluding function patterns) for given version
-static const int TOTAL_AVAILABLE_MODULES[41] = {
-    0,     208,   359,   567,   807,   1079,  1383,  1568,  1936,  2336,  2768,  3232,  3728,  4256,
-    4651,  5243,  5867,  6523,  7211,  7931,  8683,  9252,  10068, 10916, 11796, 12708, 13652, 14628,
-    15371, 16411, 17483, 18587, 19723, 20891, 22091, 23008, 24272, 25568, 26896, 28256, 29648};
-
-static const int CORR_CODEWORDS_PER_BLOCK[4][41] = {
-    {0,  7,  10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28,
-     28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
-    {0,  10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26,
-     26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28},
-    {0,  13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30,
-     28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
-    {0,  17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28,
-     30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
-};
+    "-l)] [-p pixels_per_module (default: 20)] [-b lines/netstrings/manifest (batch mode)] "                          \
+    "[-t threads (for the mask selection, default: 1)] [-e libpng/stored/rle/fast (PNG encoder)] "                    \
+    "[-z zlib_level (0-9, libpng only)] [-f none/sub/up/avg/paeth/all (PNG row filter, libpng only)] "                \
+    "[-F png/svg/eps/pbm/pgm/raw (output format, default: png)] "                                                     \
+    "[-E eci_assignment_number (character set of the input, e.g. 26 for UTF-8)] [-k (the input is Shift JIS)] "       \
+    "[-v/--verify (decode every code back and compare it with the input)] "                                          \
+    "[-r/--read (decode the QR code in a PNG/PBM/PGM input image instead, write its data to the output)] "           \
+    "[--stats (print the time spent on each stage, summed over all the codes, to stderr)] "                          \
+    "[--plan (write the version, blocks and image size of the code(s) instead of encoding them)] "                 \
+    "[-a/--append (split data too long for one code into up to 16 Structured Append symbols, written to files with " \
+    "-1, -2, ... before the extension)] "                                                                             \
+    "[--max-version version (with --plan, choose the highest error correction level that fits in it, with --append, " \
+    "the largest version of the symbols)] "                                                                          \
+    "[-M/--micro (make a Micro QR code, M1-M4, if the data fits in one)] "                                           \
+    "[-R/--rmqr (make an rMQR code, R7x43-R17x139, if the data fits in one)] "                                        \
+    "[--serve socket (render the requests sent to a Unix domain socket, see serve.h)] "                              \
+    "[--workers n (the threads rendering the requests of --serve, default: one per core)] "                         \
+    "[--connect socket (let the server on the socket render the input instead)] "                                    \
+    "[--cache directory (reuse the images rendered before, stored in the directory)] "                               \
+    "[--cache-size MiB (the most the cached images take before the least recently used ones are removed, "         \
+    "default: 256)]"
 
-static const int TOTAL_BLOCKS[4][41] = {
-    {0, 1, 1, 1,  1,  1,  2,  2,  2,  2,  4,  4,  4,  4,  4,  6,  6,  6,  6,  7, 8,
-     8, 9, 9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},
-    {0,  1,  1,  1,  2,  2,  4,  4,  4,  5,  5,  5,  8,  9,  9,  10, 10, 11, 13, 14, 16,
-     17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},
-    {0,  1,  1,  2,  2,  4,  4,  6,  6,  8,  8,  8,  10, 12, 16, 12, 17, 16, 18, 21, 20,
-     23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},
-    {0,  1,  1,  2,  4,  4,  4,  5,  6,  8,  8,  11, 11, 16, 16, 18, 16, 19, 21, 25, 25,
-     25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},
+// how the records of a batch are delimited
+enum batch_mode_t {
+    BATCH_LINES,
+    BATCH_NETSTRINGS,
+    BATCH_MANIFEST,
 };
 
-// lookup table for encoded version information
-static const int VERSION_INFO[41] = {0,       0,       0,       0,       0,       0,       0,       0x07C94, 0x085BC,
-                                     0x09A99, 0x0A4D3, 0x0BBF6, 0x0C762, 0x0D847, 0x0E60D, 0x0F928, 0x10B78, 0x1145D,
-                                     0x12A17, 0x13532, 0x149A6, 0x15683, 0x168C9, 0x177EC, 0x18EC4, 0x191E1, 0x1AFAB,
-                                     0x1B08E, 0x1CC1A, 0x1D33F, 0x1ED75, 0x1F250, 0x209D5, 0x216F0, 0x228BA, 0x2379F,
-                                     0x24B0B, 0x2542E, 0x26A64, 0x27541, 0x28C69};
-
-int mask0(int i, int j) { return ((i + j) % 2) == 0; }
-int mask1(int i, int j) {
-    (void)j;
-    return (i % 2) == 0;
-}
-int mask2(int i, int j) {
-    (void)i;
-    return (j % 3) == 0;
-}
-int mask3(int i, int j) { return ((i + j) % 3) == 0; }
-int mask4(int i, int j) { return ((i / 2 + j / 3) % 2) == 0; }
-int mask5(int i, int j) { return ((i * j) % 2 + (i * j) % 3) == 0; }
-int mask6(int i, int j) { return (((i * j) % 2 + (i * j) % 3) % 2) == 0; }
-int mask7(int i, int j) { return (((i + j) % 2 + (i * j) % 3) % 2) == 0; }
-static int (*masks[8])(int, int) = {mask0, mask1, mask2, mask3, mask4, mask5, mask6, mask7};
-
-enum corr_level_t {
-    CORR_L,
-    CORR_M,
-    CORR_Q,
-    CORR_H,
+enum output_format_t {
+    FORMAT_PNG,
+    FORMAT_SVG,
+    FORMAT_EPS,
+    FORMAT_PBM,
+    FORMAT_PGM,
+    FORMAT_RAW,
 };
 
-int save_as_png(bitset_t *code, int ppm, int padding, FILE *file) {
+// how the PNG images are written: by libpng or by the built-in encoder with the given deflate mode
+// libpng's compression settings, -1 means libpng's default
+typedef struct png_options_t {
+    int use_libpng;
+    enum deflate_mode_t deflate_mode;
+    int compression_level;
+    int filter;
+} png_options_t;
+
+typedef struct output_options_t {
+    enum output_format_t format;
+    int ppm;
+    png_options_t png;
+} output_options_t;
+
+// the versions counted by the stats, the Micro QR ones after the QR ones and the rMQR ones after those
+#define N_STATS_VERSIONS (QUER_MAX_VERSION + QUER_MAX_MICRO_VERSION + QUER_MAX_RMQR_VERSION + 1)
+
+// what was done for all the codes encoded so far (--stats)
+typedef struct run_stats_t {
+    // filled in by quer_encode for every code
+    quer_stats_t last;
+    long n_codes;
+    long n_codes_of_version[N_STATS_VERSIONS];
+    // the blocks of each version (which depend only on the version with a fixed error correction level)
+    quer_blocks_t blocks[N_STATS_VERSIONS];
+    // and its dimensions in modules
+    int widths[N_STATS_VERSIONS];
+    int heights[N_STATS_VERSIONS];
+    long n_chosen[8];
+    int64_t penalty_sums[8];
+    // the same for the 4 masks of the Micro QR codes, scored the other way around
+    long n_micro_codes;
+    long n_micro_chosen[4];
+    int64_t micro_score_sums[4];
+    // rMQR codes have a single mask, nothing is scored
+    long n_rmqr_codes;
+    int64_t segments_ns;
+    int64_t rs_ns;
+    int64_t placement_ns;
+    int64_t masks_ns;
+    int64_t verify_ns;
+    // rasterizing and writing the images
+    int64_t output_ns;
+    int64_t output_bytes;
+    // the images written to streams that can't tell their position (e.g. pipes)
+    long n_unknown_bytes;
+    // the images found in the render cache (--cache) and written from it, and the ones that had to be encoded
+    long n_cache_hits;
+    long n_cache_misses;
+    int64_t cache_bytes;
+} run_stats_t;
+
+// buffers reused between consecutive images
+typedef struct encoder_t {
+    void *scratch;
+    size_t scratch_size;
+    quer_code_t code;
+    raster_t raster;
+    png_writer_t png_writer;
+    // libpng takes whole rows
+    uint8_t *row;
+    size_t row_cap;
+    // NULL unless --stats was given
+    run_stats_t *stats;
+    // NULL unless --cache was given
+    render_cache_t *cache;
+    // the key of the last image looked up in the cache (0 if it wasn't), and the image if it was there
+    uint8_t key[CACHE_MAX_KEY];
+    size_t key_len;
+    int is_hit;
+    cache_hit_t hit;
+} encoder_t;
+
+int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// adds the last encoded code to the stats
+void stats_add_code(run_stats_t *stats, const quer_code_t *code) {
+    const quer_stats_t *last = &stats->last;
+    int version = (code->micro  ? QUER_MAX_VERSION + code->version
+                   : code->rmqr ? QUER_MAX_VERSION + QUER_MAX_MICRO_VERSION + code->version
+                                : code->version);
+    stats->n_codes++;
+    stats->n_codes_of_version[version]++;
+    stats->blocks[version] = last->blocks;
+    stats->widths[version] = code->width;
+    stats->heights[version] = code->height;
+    if (code->rmqr) {
+        stats->n_rmqr_codes++;
+    } else if (code->micro) {
+        stats->n_micro_codes++;
+        stats->n_micro_chosen[code->mask]++;
+        for (int i = 0; i < 4; i++)
+            stats->micro_score_sums[i] += last->penalties[i];
+    } else {
+        stats->n_chosen[code->mask]++;
+        for (int i = 0; i < 8; i++)
+            stats->penalty_sums[i] += last->penalties[i];
+    }
+    stats->segments_ns += last->segments_ns;
+    stats->rs_ns += last->rs_ns;
+    stats->placement_ns += last->placement_ns;
+    stats->masks_ns += last->masks_ns;
+    stats->verify_ns += last->verify_ns;
+}
+
+// adds the stats of another run (e.g. of another thread)
+void stats_merge(run_stats_t *stats, const run_stats_t *other) {
+    stats->n_codes += other->n_codes;
+    stats->n_micro_codes += other->n_micro_codes;
+    stats->n_rmqr_codes += other->n_rmqr_codes;
+    for (int version = QUER_MIN_VERSION; version < N_STATS_VERSIONS; version++) {
+        if (other->n_codes_of_version[version] > 0) {
+            stats->blocks[version] = other->blocks[version];
+            stats->widths[version] = other->widths[version];
+            stats->heights[version] = other->heights[version];
+        }
+        stats->n_codes_of_version[version] += other->n_codes_of_version[version];
+    }
+    for (int i = 0; i < 8; i++) {
+        stats->n_chosen[i] += other->n_chosen[i];
+        stats->penalty_sums[i] += other->penalty_sums[i];
+    }
+    for (int i = 0; i < 4; i++) {
+        stats->n_micro_chosen[i] += other->n_micro_chosen[i];
+        stats->micro_score_sums[i] += other->micro_score_sums[i];
+    }
+    stats->segments_ns += other->segments_ns;
+    stats->rs_ns += other->rs_ns;
+    stats->placement_ns += other->placement_ns;
+    stats->masks_ns += other->masks_ns;
+    stats->verify_ns += other->verify_ns;
+    stats->output_ns += other->output_ns;
+    stats->output_bytes += other->output_bytes;
+    stats->n_unknown_bytes += other->n_unknown_bytes;
+    stats->n_cache_hits += other->n_cache_hits;
+    stats->n_cache_misses += other->n_cache_misses;
+    stats->cache_bytes += other->cache_bytes;
+}
+
+// the sizes of the blocks in data codewords, e.g. `2x15+2x16` (2 blocks of 15 and 2 of 16)
+void print_blocks(const quer_blocks_t *blocks, FILE *file) {
+    int n_big_blocks = blocks->n_blocks - blocks->n_small_blocks;
+    fprintf(file, "%dx%d", blocks->n_small_blocks, blocks->small_block_len);
+    if (n_big_blocks > 0)
+        fprintf(file, "+%dx%d", n_big_blocks, blocks->small_block_len + 1);
+}
+
+void stats_print(const run_stats_t *stats, enum quer_corr_level_t corr_level, FILE *file) {
+    static const char level_names[] = "LMQH";
+    long n = stats->n_codes;
+    fprintf(file, "codes: %ld (error correction level %c)\n", n, level_names[corr_level]);
+    if (stats->n_cache_hits + stats->n_cache_misses > 0)
+        fprintf(file, "cache: %ld hits (%" PRId64 " bytes written from the cache), %ld misses\n", stats->n_cache_hits,
+                stats->cache_bytes, stats->n_cache_misses);
+    if (n == 0)
+        return;
+#ifndef QUER_NO_STATS
+    for (int version = QUER_MIN_VERSION; version < N_STATS_VERSIONS; version++) {
+        if (stats->n_codes_of_version[version] == 0)
+            continue;
+        const quer_blocks_t *blocks = &stats->blocks[version];
+        int width = stats->widths[version], height = stats->heights[version];
+        if (version > QUER_MAX_VERSION + QUER_MAX_MICRO_VERSION)
+            fprintf(file, "version R%dx%d", height, width);
+        else if (version > QUER_MAX_VERSION)
+            fprintf(file, "version M%d", version - QUER_MAX_VERSION);
+        else
+            fprintf(file, "version %d", version);
+        fprintf(file, " (%dx%d): %ld codes, blocks of ", width, height, stats->n_codes_of_version[version]);
+        print_blocks(blocks, file);
+        fprintf(file, " data and %d error correction codewords\n", blocks->n_corr_codewords_per_block);
+    }
+    long n_qr = n - stats->n_micro_codes - stats->n_rmqr_codes;
+    for (int i = 0; i < 8 && n_qr > 0; i++)
+        fprintf(file, "mask %d: mean penalty %.1f, chosen %ld times\n", i, (double)stats->penalty_sums[i] / n_qr,
+                stats->n_chosen[i]);
+    for (int i = 0; i < 4 && stats->n_micro_codes > 0; i++)
+        fprintf(file, "micro mask %d: mean score %.1f, chosen %ld times\n", i,
+                (double)stats->micro_score_sums[i] / stats->n_micro_codes, stats->n_micro_chosen[i]);
+#else
+    // the library keeps no counters, only the output is measured here
+    fprintf(file, "versions, masks and encoding stages: not measured (built with QUER_NO_STATS)\n");
+#endif
+    const struct {
+        const char *name;
+        int64_t ns;
+    } stages[] = {
+#ifndef QUER_NO_STATS
+        {"segments", stats->segments_ns}, {"rs", stats->rs_ns},         {"placement", stats->placement_ns},
+        {"masks", stats->masks_ns},       {"verify", stats->verify_ns},
+#endif
+        {"output", stats->output_ns},
+    };
+    fprintf(file, "%-10s %12s %12s\n", "stage", "total_ms", "per_code_us");
+    for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++)
+        fprintf(file, "%-10s %12.3f %12.1f\n", stages[i].name, stages[i].ns / 1e6, stages[i].ns / 1e3 / n);
+    long n_known = n - stats->n_unknown_bytes;
+    if (n_known > 0)
+        fprintf(file, "output bytes: %" PRId64 " (%.0f per code)\n", stats->output_bytes,
+                (double)stats->output_bytes / n_known);
+    if (stats->n_unknown_bytes > 0)
+        fprintf(file, "output bytes: unknown for %ld codes (not written to a regular file)\n", stats->n_unknown_bytes);
+}
+
+#ifndef QUER_NO_LIBPNG
+int save_as_png(const raster_t *raster, const png_options_t *png_options, uint8_t *row, FILE *file) {
     png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (png_ptr == NULL)
         return -1;
@@ -114,31 +291,25 @@ int save_as_png(bitset_t *code, int ppm, int padding, FILE *file) {
         return -1;
     }
 
-    int width = (code->width + 2 * padding) * ppm;
-    int height = (code->height + 2 * padding) * ppm;
     png_init_io(png_ptr, file);
-    png_set_IHDR(png_ptr, info_ptr, width, height, 1, PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE,
+    // libpng refuses images wider or taller than a million pixels by default, raster_init has checked the size
+    png_set_user_limits(png_ptr, RASTER_MAX_DIM, RASTER_MAX_DIM);
+    if (png_options->compression_level != -1)
+        png_set_compression_level(png_ptr, png_options->compression_level);
+    if (png_options->filter != -1)
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, png_options->filter);
+    png_set_IHDR(png_ptr, info_ptr, raster->width, raster->height, 1, PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE,
                  PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
     png_write_info(png_ptr, info_ptr);
-    png_set_packing(png_ptr);
-    png_set_invert_mono(png_ptr);
-
-    unsigned char image_row[width];
-    memset(image_row, 0, width * sizeof(unsigned char));
-    for (int i = 0; i < padding * ppm; i++) {
-        png_write_row(png_ptr, image_row);
-    }
-    for (int y = 0; y < code->height * ppm; y++) {
-        int x = 0;
-        for (int i = padding * ppm; i < width - padding * ppm; i++) {
-            image_row[i] = bitset_get(code, y / ppm, x / ppm);
-            x++;
-        }
-        png_write_row(png_ptr, image_row);
-    }
-    memset(image_row, 0, width * sizeof(unsigned char));
-    for (int i = 0; i < padding * ppm; i++) {
-        png_write_row(png_ptr, image_row);
+
+    // the rows are rendered packed (with dark pixels as 0 bits), once for all the repetitions of a module row
+    int prev = -2;
+    for (int y = 0; y < raster->height; y++) {
+        int module_row = raster_module_row(raster, y);
+        for (size_t start = 0; module_row != prev && start < (size_t)raster->row_bytes; start += RASTER_CHUNK_BYTES)
+            raster_render(raster, module_row, start, raster_chunk_len(raster, start), row + start);
+        png_write_row(png_ptr, row);
+        prev = module_row;
     }
 
     png_write_end(png_ptr, NULL);
@@ -146,487 +317,870 @@ int save_as_png(bitset_t *code, int ppm, int padding, FILE *file) {
     return 0;
 }
 
-void fill_data(bitstream_t *bitstream, char *data, int data_len, enum corr_level_t corr_level, int version) {
-    add_bits_to_stream(bitstream, 0b0100, 4);
-    add_bits_to_stream(bitstream, data_len, (version <= 9 ? 8 : 16));
-    for (int i = 0; i < data_len; i++) {
-        add_bits_to_stream(bitstream, data[i], 8);
-    }
-    int total_bits = TOTAL_DATA_CODEWORDS[(int)corr_level][version] * 8;
-    int terminator_bits = (total_bits - bitstream->len_bits >= 4 ? 4 : total_bits - bitstream->len_bits);
-    add_bits_to_stream(bitstream, 0, terminator_bits);
-    if (bitstream->len_bits % 8 > 0)
-        add_bits_to_stream(bitstream, 0, 8 - (bitstream->len_bits % 8));
-    int pad_byte = 0b11101100;
-    while (bitstream->len_bits < total_bits) {
-        add_bits_to_stream(bitstream, pad_byte, 8);
-        pad_byte ^= (0b11101100 ^ 0b00010001);
-    }
-}
-
-void add_error_correction_and_interleave(bitstream_t *bitstream, enum corr_level_t corr_level, int version,
-                                         uint8_t *res) {
-    int n_blocks = TOTAL_BLOCKS[(int)corr_level][version];
-    int n_corr_codewords_per_block = CORR_CODEWORDS_PER_BLOCK[(int)corr_level][version];
-    int n_all_codewords = TOTAL_AVAILABLE_MODULES[version] / 8;
-    int corr_offset = TOTAL_DATA_CODEWORDS[(int)corr_level][version];
-    int n_small_blocks = n_blocks - n_all_codewords % n_blocks;
-    int small_block_len = n_all_codewords / n_blocks - n_corr_codewords_per_block;
-    int big_block_len = small_block_len + 1;
-    init_lut();
-
-    int gen_poly[MAX_DEGREE];
-    uint8_t corr_codewords[n_corr_codewords_per_block];
-    compute_generator_poly(n_corr_codewords_per_block, gen_poly);
-
-    int block_start = 0;
-    for (int i = 0; i < n_blocks; i++) {
-        int block_len = (i < n_small_blocks ? small_block_len : big_block_len);
-        compute_corr_codewords(gen_poly, bitstream->values, block_start, block_len, n_corr_codewords_per_block,
-                               corr_codewords);
-        int idx = i;
-        for (int j = 0; j < block_len; j++) {
-            // so that we don't leave empty spaces
-            if (j == big_block_len - 1)
-                idx -= n_small_blocks;
-            res[idx] = bitstream->values[block_start + j];
-            idx += n_blocks;
-        }
-        for (int j = 0; j < n_corr_codewords_per_block; j++) {
-            res[corr_offset + i + n_blocks * j] = corr_codewords[j];
-        }
-        block_start += block_len;
+// decodes a PNG file (of any color type and bit depth) into an 8-bit grayscale image with allocated pixels
+int load_png(const uint8_t *file, size_t len, quer_image_t *image) {
+    png_image png = {.version = PNG_IMAGE_VERSION};
+    if (!png_image_begin_read_from_memory(&png, file, len))
+        return -1;
+    // transparent pixels are composed over a white background
+    png.format = PNG_FORMAT_GRAY;
+    png_color background = {255, 255, 255};
+    uint8_t *pixels = malloc(PNG_IMAGE_SIZE(png));
+    if (pixels == NULL) {
+        png_image_free(&png);
+        return -1;
     }
+    if (!png_image_finish_read(&png, &background, pixels, 0, NULL)) {
+        free(pixels);
+        return -1;
+    }
+    *image = (quer_image_t){.pixels = pixels, .width = png.width, .height = png.height, .stride = png.width};
+    return 0;
 }
+#endif
 
-void draw_separator(bitset_t *code, int sx, int sy, bitset_t *blocked) {
-    for (int y = 0; y < 8; y++) {
-        for (int x = 0; x < 8; x++) {
-            bitset_unset(code, sy + y, sx + x);
-            bitset_set(blocked, sy + y, sx + x);
-        }
+int encoder_init(encoder_t *enc) {
+    enc->scratch_size = quer_scratch_size();
+    enc->scratch = malloc(enc->scratch_size);
+    if (enc->scratch == NULL)
+        return -1;
+    if (png_writer_init(&enc->png_writer) == -1) {
+        free(enc->scratch);
+        return -1;
     }
+    enc->row = NULL;
+    enc->row_cap = 0;
+    enc->stats = NULL;
+    enc->cache = NULL;
+    enc->key_len = 0;
+    enc->is_hit = 0;
+    return 0;
 }
 
-void draw_finder_pattern(bitset_t *code, int sx, int sy, bitset_t *blocked) {
-    for (int y = 0; y < 7; y++) {
-        for (int x = 0; x < 7; x++) {
-            bitset_set(code, sy + y, sx + x);
-            bitset_set(blocked, sy + y, sx + x);
-        }
+void encoder_free(encoder_t *enc) {
+    free(enc->scratch);
+    png_writer_free(&enc->png_writer);
+    free(enc->row);
+}
+
+// some padding so that scanners can distinguish the code from its surroundings
+// 20% of the QR code's width seems to be good enough, without making the image too large
+// Micro QR codes (smaller than 21x21) and rMQR codes (the only ones that aren't square) need only 2 modules
+int image_padding(int width, int height) { return width < 21 || width != height ? 2 : width / 5; }
+
+// writes the last encoded code in the chosen format
+int write_image(encoder_t *enc, const output_options_t *output, FILE *out_stream) {
+    int padding = image_padding(enc->code.width, enc->code.height);
+    int dark_bit = output->format == FORMAT_PBM || output->format == FORMAT_PGM;
+    if (output->format != FORMAT_SVG && output->format != FORMAT_EPS && output->format != FORMAT_RAW &&
+        raster_init(&enc->raster, enc->code.modules, output->ppm, padding, dark_bit) == -1) {
+        fprintf(stderr, "the image would be larger than %d x %d pixels\n", RASTER_MAX_DIM, RASTER_MAX_DIM);
+        return -1;
     }
-    for (int y = 0; y < 5; y++) {
-        for (int x = 0; x < 5; x++) {
-            bitset_unset(code, sy + y + 1, sx + x + 1);
-            bitset_set(blocked, sy + y + 1, sx + x + 1);
-        }
+    switch (output->format) {
+        case FORMAT_SVG:
+            return write_svg(enc->code.modules, output->ppm, padding, out_stream);
+        case FORMAT_EPS:
+            return write_eps(enc->code.modules, output->ppm, padding, out_stream);
+        case FORMAT_RAW:
+            return write_raw(enc->code.modules, out_stream);
+        case FORMAT_PBM:
+            return write_pbm(&enc->raster, out_stream);
+        case FORMAT_PGM:
+            return write_pgm(&enc->raster, out_stream);
+        case FORMAT_PNG:
+            break;
     }
-    for (int y = 0; y < 3; y++) {
-        for (int x = 0; x < 3; x++) {
-            bitset_set(code, sy + y + 2, sx + x + 2);
-            bitset_set(blocked, sy + y + 2, sx + x + 2);
-        }
+
+    const png_options_t *png_options = &output->png;
+    if (!png_options->use_libpng)
+        return png_writer_write(&enc->png_writer, &enc->raster, png_options->deflate_mode, out_stream);
+#ifndef QUER_NO_LIBPNG
+    if ((size_t)enc->raster.row_bytes > enc->row_cap) {
+        uint8_t *row = realloc(enc->row, enc->raster.row_bytes);
+        if (row == NULL)
+            return -1;
+        enc->row = row;
+        enc->row_cap = enc->raster.row_bytes;
     }
+    return save_as_png(&enc->raster, png_options, enc->row, out_stream);
+#else
+    return -1;
+#endif
 }
 
-void draw_timing_patterns(bitset_t *code, int sx, int sy, bitset_t *blocked) {
-    int x = sx + 7 + 1;
-    int y = sy + 7 - 1;
-    int flip = 1;
-    for (; x < code->width - 7 - 1; x++) {
-        if (flip == 1)
-            bitset_set(code, y, x);
-        else
-            bitset_unset(code, y, x);
-        bitset_set(blocked, y, x);
-        flip ^= 1;
-    }
-    x = sx + 7 - 1;
-    y = sy + 7 + 1;
-    flip = 1;
-    for (; y < code->height - 7 - 1; y++) {
-        if (flip == 1)
-            bitset_set(code, y, x);
-        else
-            bitset_unset(code, y, x);
-        bitset_set(blocked, y, x);
-        flip ^= 1;
-    }
+// write_image, measuring its time and output size for the stats
+int output_image(encoder_t *enc, const output_options_t *output, FILE *out_stream) {
+    if (enc->stats == NULL)
+        return write_image(enc, output, out_stream);
+    run_stats_t *stats = enc->stats;
+    off_t start = ftello(out_stream);
+    int64_t start_ns = now_ns();
+    int status = write_image(enc, output, out_stream);
+    if (fflush(out_stream))
+        status = -1;
+    stats->output_ns += now_ns() - start_ns;
+    off_t end = ftello(out_stream);
+    if (start == -1 || end == -1)
+        stats->n_unknown_bytes++;
+    else
+        stats->output_bytes += end - start;
+    return status;
 }
 
-int get_alignment_pattern_positions(int version, int positions[7]) {
-    if (version == 1)
-        return 0;
-    int count = version / 7 + 2;
-    int delta = (version * 8 + count * 3 + 5) / (count * 4 - 4) * 2;
-    int pos = version * 4 + 10;
-    for (int i = count - 1; i >= 1; i--) {
-        positions[i] = pos;
-        pos -= delta;
-    }
-    positions[0] = 6;
-    return count;
-}
-
-void draw_alignment_patterns(bitset_t *code, int version, bitset_t *blocked) {
-    int pos[7];
-    int count = get_alignment_pattern_positions(version, pos);
-    for (int i = 0; i < count; i++) {
-        for (int j = 0; j < count; j++) {
-            // these ones would overlap with the finder patterns
-            // so we can't draw them
-            if ((i == 0 && j == 0) || (i == 0 && j == count - 1) || (i == count - 1 && j == 0))
-                continue;
-
-            for (int y = pos[i] - 2; y <= pos[i] + 2; y++) {
-                for (int x = pos[j] - 2; x <= pos[j] + 2; x++) {
-                    bitset_set(code, y, x);
-                    bitset_set(blocked, y, x);
-                }
-            }
-            for (int y = pos[i] - 1; y <= pos[i] + 1; y++) {
-                for (int x = pos[j] - 1; x <= pos[j] + 1; x++) {
-                    bitset_unset(code, y, x);
-                    bitset_set(blocked, y, x);
-                }
-            }
-            bitset_set(code, pos[i], pos[j]);
-            bitset_set(blocked, pos[i], pos[j]);
-        }
-    }
+// the key of the image of the data in the render cache: everything that changes the image (the quiet zone depends
+// only on the version, if that changes the tag must change too) and the data
+// verify is a part of it too, so that the images read back before they were stored are the only ones used with -v
+size_t cache_key(const char *data, size_t data_len, const quer_options_t *options, const output_options_t *output,
+                 uint8_t *key) {
+    const png_options_t *png = &output->png;
+    int32_t fields[(CACHE_KEY_HEADER - 8) / 4] = {
+        options->corr_level,    options->eci,          options->kanji,       options->verify,
+        options->micro,         options->min_version,  options->append_index, options->append_total,
+        options->append_parity, output->format,        output->ppm,          png->use_libpng,
+        png->deflate_mode,      png->compression_level, png->filter,         options->rmqr,
+    };
+    memcpy(key, "quer-v1\n", 8);
+    memcpy(key + 8, fields, sizeof(fields));
+    memcpy(key + CACHE_KEY_HEADER, data, data_len);
+    return CACHE_KEY_HEADER + data_len;
 }
 
-void draw_version_pattern(bitset_t *code, int version, int dim, bitset_t *blocked) {
-    int version_info = VERSION_INFO[version];
-    for (int y = 0; y < 6; y++) {
-        for (int x = 0; x < 3; x++) {
-            int b = 3 * y + x;
-            if ((version_info & (1 << b)) == 0) {
-                bitset_unset(code, dim - 11 + x, y);
-                bitset_unset(code, y, dim - 11 + x);
-            } else {
-                bitset_set(code, dim - 11 + x, y);
-                bitset_set(code, y, dim - 11 + x);
-            }
-            bitset_set(blocked, dim - 11 + x, y);
-            bitset_set(blocked, y, dim - 11 + x);
+// encodes the data into enc->code, unless its image is in the render cache (enc->is_hit is set then, and the image
+// is written by output_cached), returns the status of quer_encode
+int encode_cached(encoder_t *enc, const char *data, size_t data_len, const quer_options_t *options,
+                  const output_options_t *output) {
+    enc->key_len = 0;
+    enc->is_hit = 0;
+    if (enc->cache != NULL && data_len <= QUER_MAX_INPUT_LEN) {
+        enc->key_len = cache_key(data, data_len, options, output, enc->key);
+        enc->is_hit = (cache_get(enc->cache, enc->key, enc->key_len, &enc->hit) == 0);
+        if (enc->stats != NULL) {
+            enc->stats->n_cache_hits += enc->is_hit;
+            enc->stats->n_cache_misses += !enc->is_hit;
         }
+        if (enc->is_hit)
+            return QUER_OK;
     }
+    int status = quer_encode(data, data_len, options, enc->scratch, enc->scratch_size, &enc->code);
+    if (status == QUER_OK && enc->stats != NULL)
+        stats_add_code(enc->stats, &enc->code);
+    return status;
 }
 
-void block_format_info(int dim, bitset_t *blocked) {
-    for (int x = 0; x < 9; x++)
-        bitset_set(blocked, 8, x);
-    for (int y = 0; y < 9; y++)
-        bitset_set(blocked, y, 8);
-    for (int x = 0; x < 8; x++)
-        bitset_set(blocked, 8, dim - 1 - x);
-    for (int y = 0; y < 7; y++)
-        bitset_set(blocked, dim - 1 - y, 8);
-}
-
-void draw_functional_patterns(bitset_t *code, int version, int dim, bitset_t *blocked) {
-    int separator_coords_x[3] = {0, dim - 8, 0};
-    int separator_coords_y[3] = {0, 0, dim - 8};
-    for (int i = 0; i < 3; i++)
-        draw_separator(code, separator_coords_x[i], separator_coords_y[i], blocked);
-    int finder_coords_x[3] = {0, dim - 7, 0};
-    int finder_coords_y[3] = {0, 0, dim - 7};
-    for (int i = 0; i < 3; i++)
-        draw_finder_pattern(code, finder_coords_x[i], finder_coords_y[i], blocked);
-    draw_timing_patterns(code, finder_coords_x[0], finder_coords_y[0], blocked);
-    draw_alignment_patterns(code, version, blocked);
-    if (version >= 7)
-        draw_version_pattern(code, version, dim, blocked);
-    // format info (just block, will be filled in later)
-    block_format_info(dim, blocked);
-    // that single black module in the lower left corner
-    bitset_set(code, dim - 8, 8);
-    bitset_set(blocked, dim - 8, 8);
-}
-
-void draw_data(bitset_t *code, uint8_t *data, int data_len, int dim, bitset_t *blocked) {
-    int bit = 7, byte = 0;
-    for (int col = dim - 1; col >= 1; col -= 2) {
-        // the "parity" changes after column 6 (a column fully devoted to function patterns)
-        if (col == 6)
-            col = 5;
-        for (int row = 0; row < dim; row++) {
-            for (int side = 0; side <= 1; side++) {
-                int x = col - side;
-                // 0 = down, 1 = up
-                int dir = ((col + 1) % 4 == 0 || (col + 1) % 4 == 1) ? 1 : 0;
-                int y = (dir == 0) ? row : dim - 1 - row;
-                if (bitset_get(blocked, y, x))
-                    continue;
-                if ((data[byte] & (1 << bit)) > 0)
-                    bitset_set(code, y, x);
-                bit--;
-                if (bit < 0) {
-                    bit = 7;
-                    byte++;
-                }
-                if (byte == data_len)
-                    return;
-            }
-        }
+// writes the image of the data given to encode_cached: straight from the render cache on a hit, and on a miss
+// it's rendered into memory to be stored in the cache as well
+int output_cached(encoder_t *enc, const output_options_t *output, FILE *out_stream) {
+    if (enc->is_hit) {
+        enc->is_hit = 0;
+        int status = (fwrite(enc->hit.image, 1, enc->hit.image_len, out_stream) == enc->hit.image_len ? 0 : -1);
+        if (enc->stats != NULL)
+            enc->stats->cache_bytes += enc->hit.image_len;
+        cache_release(&enc->hit);
+        return status;
+    }
+    if (enc->key_len == 0)
+        return output_image(enc, output, out_stream);
+    char *image = NULL;
+    size_t image_len = 0;
+    FILE *image_stream = open_memstream(&image, &image_len);
+    if (image_stream == NULL)
+        return -1;
+    int status = output_image(enc, output, image_stream);
+    if (fclose(image_stream))
+        status = -1;
+    if (status == 0) {
+        status = (fwrite(image, 1, image_len, out_stream) == image_len ? 0 : -1);
+        cache_put(enc->cache, enc->key, enc->key_len, (const uint8_t *)image, image_len);
     }
-    // we ignore remainder bits because they've already been zeroed by default
+    free(image);
+    return status;
 }
 
-void apply_mask(bitset_t *code, int dim, bitset_t *blocked, int mask_i) {
-    for (int y = 0; y < dim; y++) {
-        for (int x = 0; x < dim; x++) {
-            if (!bitset_get(blocked, y, x)) {
-                if (masks[mask_i](y, x) > 0) {
-                    bitset_negate(code, y, x);
-                }
-            }
-        }
-    }
+// releases the image found by encode_cached if it won't be written after all
+void drop_cached(encoder_t *enc) {
+    if (enc->is_hit)
+        cache_release(&enc->hit);
+    enc->is_hit = 0;
 }
 
-void draw_format_info(bitset_t *code, int dim, int mask_i, enum corr_level_t corr_level) {
-    int corr_level_i;
-    switch (corr_level) {
-        case CORR_L:
-            corr_level_i = 0b01;
-            break;
-        case CORR_M:
-            corr_level_i = 0b00;
-            break;
-        case CORR_Q:
-            corr_level_i = 0b11;
-            break;
-        default:
-            corr_level_i = 0b10;
+// the path of Structured Append symbol i: the output path with `-i` inserted before its extension
+// (`qr.png` becomes `qr-1.png`, `qr-2.png`, ...), returns -1 if it's too long
+int symbol_path(const char *path, int i, char *symbol) {
+    const char *name = strrchr(path, '/'), *extension = strrchr(name == NULL ? path : name, '.');
+    int stem_len = (extension == NULL ? (int)strlen(path) : (int)(extension - path));
+    int len = snprintf(symbol, PATH_MAX, "%.*s-%d%s", stem_len, path, i, extension == NULL ? "" : extension);
+    return len < PATH_MAX ? 0 : -1;
+}
+
+// one symbol of a Structured Append, encoded and written by its own thread
+typedef struct symbol_job_t {
+    encoder_t enc;
+    run_stats_t stats;
+    const char *data;
+    size_t data_len;
+    quer_options_t options;
+    const output_options_t *output;
+    char path[PATH_MAX];
+    // what went wrong, NULL if nothing
+    const char *error;
+} symbol_job_t;
+
+int encode_symbol(void *arg) {
+    symbol_job_t *job = arg;
+    encoder_t *enc = &job->enc;
+    int status = encode_cached(enc, job->data, job->data_len, &job->options, job->output);
+    if (status != QUER_OK) {
+        job->error = quer_strerror(status);
+        return 0;
     }
-    int info_code = (corr_level_i << 3) | mask_i;
-    // magic values from the spec
-    int rem = info_code, gen_poly = 0b0000010100110111;
-    for (int i = 0; i < 10; i++) {
-        rem = (rem << 1) ^ ((rem >> 9) * gen_poly);
+    FILE *out_stream = fopen(job->path, "w");
+    if (out_stream == NULL) {
+        drop_cached(enc);
+        job->error = "unable to open the file for writing";
+        return 0;
     }
-    info_code = (info_code << 10 | rem) ^ 0b0101010000010010;
+    if (output_cached(enc, job->output, out_stream) == -1)
+        job->error = "unable to write the image";
+    if (fclose(out_stream))
+        job->error = "unable to close the file";
+    return 0;
+}
 
-    for (int y = 0; y < 6; y++) {
-        if ((info_code & (1 << y)) > 0)
-            bitset_set(code, y, 8);
-        else
-            bitset_unset(code, y, 8);
+// encodes the data into one code of at most max_version if it fits, or else splits it into Structured Append symbols
+// and encodes them in parallel (one thread each), writing them to the output path (stdout if it's NULL, only for
+// a single code) with the number of the symbol inserted (see symbol_path)
+// the error messages start with prefix, returns -1 on error
+int write_split(encoder_t *enc, const char *data, size_t data_len, const quer_options_t *options,
+                const output_options_t *output, int max_version, const char *output_path, const char *prefix) {
+    quer_split_t split;
+    int status = quer_split(data, data_len, options, max_version, &split);
+    if (status != QUER_OK) {
+        fprintf(stderr, "%s%s\n", prefix, quer_strerror(status));
+        return -1;
     }
-
-    if ((info_code & (1 << 6)) > 0)
-        bitset_set(code, 7, 8);
-    else
-        bitset_unset(code, 7, 8);
-    if ((info_code & (1 << 7)) > 0)
-        bitset_set(code, 8, 8);
-    else
-        bitset_unset(code, 8, 8);
-    if ((info_code & (1 << 8)) > 0)
-        bitset_set(code, 8, 7);
-    else
-        bitset_unset(code, 8, 7);
-
-    for (int x = 9; x < 15; x++) {
-        if ((info_code & (1 << x)) > 0)
-            bitset_set(code, 8, 14 - x);
-        else
-            bitset_unset(code, 8, 14 - x);
+    if (split.n_symbols == 1) {
+        status = encode_cached(enc, data, data_len, options, output);
+        if (status != QUER_OK) {
+            fprintf(stderr, "%s%s\n", prefix, quer_strerror(status));
+            return -1;
+        }
+        FILE *out_stream = (output_path == NULL ? stdout : fopen(output_path, "w"));
+        if (out_stream == NULL) {
+            drop_cached(enc);
+            fprintf(stderr, "%sunable to open file `%s` for writing\n", prefix, output_path);
+            return -1;
+        }
+        status = output_cached(enc, output, out_stream);
+        if (status == -1)
+            fprintf(stderr, "%sunable to write the image\n", prefix);
+        if (out_stream != stdout && fclose(out_stream))
+            ERR_AND_DIE("fclose");
+        return status;
     }
-    for (int x = 0; x < 8; x++) {
-        if ((info_code & (1 << x)) > 0)
-            bitset_set(code, 8, dim - 1 - x);
-        else
-            bitset_unset(code, 8, dim - 1 - x);
+    if (output_path == NULL) {
+        fprintf(stderr, "%sthe data needs %d Structured Append symbols, which must be written to files (-o)\n", prefix,
+                split.n_symbols);
+        return -1;
     }
-    for (int y = 0; y < 7; y++) {
-        if ((info_code & (1 << (14 - y))) > 0)
-            bitset_set(code, dim - 1 - y, 8);
-        else
-            bitset_unset(code, dim - 1 - y, 8);
+
+    symbol_job_t *jobs = calloc(split.n_symbols, sizeof(symbol_job_t));
+    thrd_t threads[QUER_MAX_APPEND_SYMBOLS];
+    int started[QUER_MAX_APPEND_SYMBOLS] = {0};
+    if (jobs == NULL)
+        ERR_AND_DIE("calloc");
+    for (int i = 0; i < split.n_symbols; i++) {
+        symbol_job_t *job = &jobs[i];
+        if (encoder_init(&job->enc) == -1)
+            ERR_AND_DIE("encoder_init");
+        job->enc.cache = enc->cache;
+        job->data = data + split.starts[i];
+        job->data_len = split.starts[i + 1] - split.starts[i];
+        job->output = output;
+        job->options = *options;
+        job->options.min_version = split.version;
+        job->options.append_index = i;
+        job->options.append_total = split.n_symbols;
+        job->options.append_parity = split.parity;
+        job->options.stats = NULL;
+        if (enc->stats != NULL) {
+            job->enc.stats = &job->stats;
+            job->options.stats = &job->stats.last;
+        }
+        if (symbol_path(output_path, i + 1, job->path) == -1) {
+            job->error = "output path is too long";
+            continue;
+        }
+        started[i] = (thrd_create(&threads[i], encode_symbol, job) == thrd_success);
+        if (!started[i])
+            encode_symbol(job);
+    }
+    status = 0;
+    for (int i = 0; i < split.n_symbols; i++) {
+        if (started[i])
+            thrd_join(threads[i], NULL);
+        if (jobs[i].error != NULL) {
+            fprintf(stderr, "%ssymbol %d of %d: %s\n", prefix, i + 1, split.n_symbols, jobs[i].error);
+            status = -1;
+        }
+        if (enc->stats != NULL)
+            stats_merge(enc->stats, &jobs[i].stats);
+        encoder_free(&jobs[i].enc);
     }
+    free(jobs);
+    return status;
 }
 
-int check_finder_pattern_ver(bitset_t *code, int y, int x, int r, int dir) {
-    int pos = y;
-    for (int i = 0; i < r; i++) {
-        if (!bitset_get(code, pos, x))
-            return 0;
-        pos += dir;
-    }
-    for (int i = 0; i < r; i++) {
-        if (bitset_get(code, pos, x))
+// checks that the output pattern of a batch contains exactly one %d conversion (e.g. `qr_%04d.png`)
+int is_valid_pattern(const char *pattern) {
+    int n_conversions = 0;
+    for (const char *p = pattern; *p != '\0'; p++) {
+        if (*p != '%')
+            continue;
+        p++;
+        if (*p == '%')
+            continue;
+        while (*p >= '0' && *p <= '9')
+            p++;
+        if (*p != 'd')
             return 0;
-        pos += dir;
+        n_conversions++;
     }
-    for (int i = 0; i < 3 * r; i++) {
-        if (!bitset_get(code, pos, x))
-            return 0;
-        pos += dir;
+    return n_conversions == 1;
+}
+
+// decodes the QR code in a PNG, PBM or PGM image read from in_stream and writes its data to out_stream
+int run_read(FILE *in_stream, FILE *out_stream) {
+    static const uint8_t png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    input_t file = {0};
+    if (input_read(&file, in_stream, SIZE_MAX) == -1) {
+        input_free(&file);
+        fprintf(stderr, "unable to read the image\n");
+        return -1;
     }
-    for (int i = 0; i < r; i++) {
-        if (bitset_get(code, pos, x))
-            return 0;
-        pos += dir;
+    quer_image_t image;
+    int status = -1;
+    if (file.len >= 8 && memcmp(file.data, png_signature, 8) == 0) {
+#ifndef QUER_NO_LIBPNG
+        status = load_png((const uint8_t *)file.data, file.len, &image);
+#else
+        input_free(&file);
+        fprintf(stderr, "reading PNG images requires libpng\n");
+        return -1;
+#endif
+    } else {
+        status = read_pnm((const uint8_t *)file.data, file.len, &image);
     }
-    for (int i = 0; i < r; i++) {
-        if (!bitset_get(code, pos, x))
-            return 0;
-        pos += dir;
+    input_free(&file);
+    if (status == -1) {
+        fprintf(stderr, "the image isn't a valid PNG, PBM (P4) or PGM (P5) file\n");
+        return -1;
     }
-    return 1;
+
+    size_t scratch_size = quer_read_scratch_size(image.width, image.height), data_len;
+    void *scratch = malloc(scratch_size);
+    char *data = malloc(QUER_MAX_INPUT_LEN);
+    if (scratch == NULL || data == NULL)
+        ERR_AND_DIE("malloc");
+    status = quer_read(&image, scratch, scratch_size, data, QUER_MAX_INPUT_LEN, &data_len, NULL);
+    if (status == QUER_OK && fwrite(data, sizeof(char), data_len, out_stream) != data_len)
+        status = -1;
+    else if (status != QUER_OK)
+        fprintf(stderr, "%s\n", quer_strerror(status));
+    free((void *)image.pixels);
+    free(scratch);
+    free(data);
+    return status == QUER_OK ? 0 : -1;
 }
 
-int check_finder_pattern_hor(bitset_t *code, int y, int x, int r, int dir) {
-    int pos = x;
-    for (int i = 0; i < r; i++) {
-        if (!bitset_get(code, y, pos))
-            return 0;
-        pos += dir;
+// the records of a batch and the buffers they're read into
+typedef struct batch_t {
+    FILE *in_stream;
+    enum batch_mode_t mode;
+    // a regular file is mapped into memory and its records are scanned in place (from pos), other streams are read
+    // record by record into record
+    int is_mapped;
+    input_t input;
+    size_t pos;
+    char *record;
+    size_t record_cap;
+    // the input file of the last record of a manifest
+    input_t file;
+    // set after a malformed netstring, the rest of the input can't be split into records
+    int is_malformed;
+} batch_t;
+
+void batch_init(batch_t *batch, FILE *in_stream, enum batch_mode_t mode) {
+    *batch = (batch_t){.in_stream = in_stream, .mode = mode};
+    batch->is_mapped = (input_map(&batch->input, in_stream) == 0);
+}
+
+void batch_free(batch_t *batch) {
+    input_free(&batch->input);
+    input_free(&batch->file);
+    free(batch->record);
+}
+
+// reads the next record of a stream into batch->record
+long read_stream_record(batch_t *batch) {
+    if (batch->mode == BATCH_NETSTRINGS) {
+        long len;
+        char colon;
+        int n_read = fscanf(batch->in_stream, " %ld%c", &len, &colon);
+        if (n_read == EOF)
+            return -1;
+        // fscanf saturates lengths that don't fit in a long
+        if (n_read != 2 || colon != ':' || len < 0 || len == LONG_MAX)
+            return -2;
+        if ((size_t)len + 1 > batch->record_cap) {
+            char *new_record = realloc(batch->record, len + 1);
+            if (new_record == NULL)
+                ERR_AND_DIE("realloc");
+            batch->record = new_record;
+            batch->record_cap = len + 1;
+        }
+        if (fread(batch->record, sizeof(char), len, batch->in_stream) != (size_t)len ||
+            fgetc(batch->in_stream) != ',')
+            return -2;
+        batch->record[len] = '\0';
+        return len;
     }
-    for (int i = 0; i < r; i++) {
-        if (bitset_get(code, y, pos))
-            return 0;
-        pos += dir;
+    ssize_t len;
+    do {
+        len = getline(&batch->record, &batch->record_cap, batch->in_stream);
+        if (len == -1)
+            return -1;
+        if (len > 0 && batch->record[len - 1] == '\n')
+            batch->record[--len] = '\0';
+    } while (batch->mode == BATCH_MANIFEST && len == 0);
+    return len;
+}
+
+// finds the next record of a mapped input, without copying it
+long scan_record(batch_t *batch, const char **record) {
+    const char *data = batch->input.data;
+    size_t len = batch->input.len, pos = batch->pos;
+    if (batch->mode == BATCH_NETSTRINGS) {
+        while (pos < len && isspace((unsigned char)data[pos]))
+            pos++;
+        if (pos == len)
+            return -1;
+        size_t record_len = 0, start = pos;
+        while (pos < len && isdigit((unsigned char)data[pos]) && record_len <= len)
+            record_len = 10 * record_len + (data[pos++] - '0');
+        if (pos == start || pos == len || data[pos] != ':' || record_len >= len - pos - 1 ||
+            data[pos + 1 + record_len] != ',')
+            return -2;
+        *record = data + pos + 1;
+        batch->pos = pos + record_len + 2;
+        return record_len;
     }
-    for (int i = 0; i < 3 * r; i++) {
-        if (!bitset_get(code, y, pos))
-            return 0;
-        pos += dir;
+    size_t record_len;
+    do {
+        if (pos == len)
+            return -1;
+        const char *newline = memchr(data + pos, '\n', len - pos);
+        record_len = (newline == NULL ? len : (size_t)(newline - data)) - pos;
+        *record = data + pos;
+        pos += record_len + (newline != NULL);
+    } while (batch->mode == BATCH_MANIFEST && record_len == 0);
+    batch->pos = pos;
+    return record_len;
+}
+
+// reads the next record of a batch (pointed at by *record), returns its length, -1 if there are no more records or -2
+// if the next netstring is malformed (or cut short), after which there are no more records
+// lines: one payload per line
+// netstrings: `<length>:<payload>,`, so that payloads can contain newlines
+// manifest: `input_path<TAB>output_path` lines, the empty ones are skipped
+long read_record(batch_t *batch, const char **record) {
+    if (batch->is_malformed)
+        return -1;
+    long len;
+    if (batch->is_mapped) {
+        len = scan_record(batch, record);
+    } else {
+        len = read_stream_record(batch);
+        *record = batch->record;
     }
-    for (int i = 0; i < r; i++) {
-        if (bitset_get(code, y, pos))
-            return 0;
-        pos += dir;
+    if (len == -2)
+        batch->is_malformed = 1;
+    return len;
+}
+
+// reads record i of the batch and points *payload at its payload (the contents of the input file for a manifest),
+// the output path (from the manifest, or the output pattern if it isn't NULL) is stored in output_file
+// returns the length of the payload, -1 if there are no more records or -2 if the record is invalid (and reported)
+long next_payload(batch_t *batch, int i, const char *output_pattern, char *output_file, const char **payload) {
+    const char *record;
+    long len = read_record(batch, &record);
+    if (len == -1)
+        return -1;
+    if (len == -2) {
+        fprintf(stderr, "record %d: malformed netstring\n", i);
+        return -2;
     }
-    for (int i = 0; i < r; i++) {
-        if (!bitset_get(code, y, pos))
-            return 0;
-        pos += dir;
-    }
-    return 1;
-}
-
-int get_penalty(bitset_t *code, int dim) {
-    int penalty = 0;
-    // monochromatic streaks of >= 5 modules
-    for (int y = 0; y < dim; y++) {
-        int cur_streak = 1, prev_color = bitset_get(code, y, 0);
-        for (int x = 1; x < dim; x++) {
-            int cur_color = bitset_get(code, y, x);
-            if (cur_color == prev_color)
-                cur_streak++;
-            else {
-                if (cur_streak >= 5) {
-                    penalty += 3 + (cur_streak - 5);
-                }
-                cur_streak = 1;
-            }
-            prev_color = cur_color;
+    *payload = record;
+    if (batch->mode == BATCH_MANIFEST) {
+        // `input_path<TAB>output_path`
+        const char *tab = memchr(record, '\t', len);
+        if (tab == NULL) {
+            fprintf(stderr, "record %d: expected `input_path<TAB>output_path`\n", i);
+            return -2;
         }
-        if (cur_streak >= 5) {
-            penalty += 3 + (cur_streak - 5);
+        char input_path[PATH_MAX];
+        int input_path_len = tab - record, output_path_len = len - input_path_len - 1;
+        if (input_path_len >= PATH_MAX ||
+            snprintf(output_file, PATH_MAX, "%.*s", output_path_len, tab + 1) >= PATH_MAX) {
+            fprintf(stderr, "record %d: path is too long\n", i);
+            return -2;
         }
+        memcpy(input_path, record, input_path_len);
+        input_path[input_path_len] = '\0';
+        if (input_read_file(&batch->file, input_path) == -1) {
+            fprintf(stderr, "record %d: unable to read file `%s`\n", i, input_path);
+            return -2;
+        }
+        *payload = batch->file.data;
+        len = batch->file.len;
+    } else if (output_pattern != NULL && snprintf(output_file, PATH_MAX, output_pattern, i) >= PATH_MAX) {
+        fprintf(stderr, "record %d: output path is too long\n", i);
+        return -2;
     }
-    for (int x = 0; x < dim; x++) {
-        int cur_streak = 1, prev_color = bitset_get(code, 0, x);
-        for (int y = 1; y < dim; y++) {
-            int cur_color = bitset_get(code, y, x);
-            if (cur_color == prev_color)
-                cur_streak++;
-            else {
-                if (cur_streak >= 5) {
-                    penalty += 3 + (cur_streak - 5);
-                }
-                cur_streak = 1;
-            }
-            prev_color = cur_color;
+    return len;
+}
+
+// encodes every record of the input stream, returns the number of records that failed
+// with append_max_version (0 for none) the records too long for one code are split into Structured Append symbols
+int run_batch(encoder_t *enc, FILE *in_stream, enum batch_mode_t mode, const char *output_pattern,
+              const quer_options_t *options, const output_options_t *output, int append_max_version) {
+    batch_t batch;
+    batch_init(&batch, in_stream, mode);
+    char output_file[PATH_MAX];
+    const char *payload;
+    int n_failed = 0;
+    long len;
+    for (int i = 0; (len = next_payload(&batch, i, output_pattern, output_file, &payload)) != -1; i++) {
+        if (len == -2) {
+            n_failed++;
+            continue;
         }
-        if (cur_streak >= 5) {
-            penalty += 3 + (cur_streak - 5);
+        if (append_max_version > 0) {
+            char prefix[32];
+            snprintf(prefix, sizeof(prefix), "record %d: ", i);
+            n_failed +=
+                (write_split(enc, payload, len, options, output, append_max_version, output_file, prefix) == -1);
+            continue;
         }
+        int status = encode_cached(enc, payload, len, options, output);
+        if (status != QUER_OK) {
+            fprintf(stderr, "record %d: %s\n", i, quer_strerror(status));
+            n_failed++;
+            continue;
+        }
+        FILE *out_stream = fopen(output_file, "w");
+        if (out_stream == NULL) {
+            drop_cached(enc);
+            fprintf(stderr, "record %d: unable to open file `%s` for writing\n", i, output_file);
+            n_failed++;
+            continue;
+        }
+        if (output_cached(enc, output, out_stream) == -1) {
+            fprintf(stderr, "record %d: unable to write the image\n", i);
+            n_failed++;
+        }
+        if (fclose(out_stream))
+            ERR_AND_DIE("fclose");
     }
+    batch_free(&batch);
+    return n_failed;
+}
 
-    // 2x2 monochromatic blocks
-    for (int y = 0; y < dim - 1; y++) {
-        for (int x = 0; x < dim - 1; x++) {
-            if (bitset_get(code, y, x) == bitset_get(code, y + 1, x) &&
-                bitset_get(code, y + 1, x) == bitset_get(code, y, x + 1) &&
-                bitset_get(code, y, x + 1) == bitset_get(code, y + 1, x + 1))
-                penalty += 3;
-        }
+// writes the plan of the data as one line of `key=value` pairs, with the size of the image in the chosen format
+// (in pixels, or in units/points for SVG/EPS and modules for raw) and without rendering it
+// with max_version the highest error correction level that fits in it is chosen
+// returns the status of the planning, reported on the line as `error=...`
+int print_plan(const char *data, long data_len, const quer_options_t *options, int max_version,
+               const output_options_t *output, void *scratch, FILE *out_stream) {
+    static const char level_names[] = "LMQH";
+    quer_plan_t plan;
+    int status = (max_version > 0 ? quer_plan_best_level(data, data_len, options, max_version, scratch,
+                                                         quer_plan_scratch_size(), &plan)
+                                  : quer_plan(data, data_len, options, scratch, quer_plan_scratch_size(), &plan));
+    if (status != QUER_OK) {
+        fprintf(out_stream, "error=\"%s\"\n", quer_strerror(status));
+        return status;
     }
+    const quer_blocks_t *blocks = &plan.blocks;
+    long long image_width = plan.width, image_height = plan.height;
+    if (output->format != FORMAT_RAW) {
+        int padding = image_padding(plan.width, plan.height);
+        image_width = (long long)(plan.width + 2 * padding) * output->ppm;
+        image_height = (long long)(plan.height + 2 * padding) * output->ppm;
+    }
+    // Micro QR versions are M1-M4, the capacity of M1 and M3 ends with a 4-bit codeword
+    int capacity_bits = blocks->n_data_codewords * 8;
+    if (plan.micro && plan.version % 2 == 1)
+        capacity_bits -= 4;
+    // rMQR versions are named by their height and width (R7x43), with both dimensions instead of dim
+    if (plan.rmqr)
+        fprintf(out_stream, "version=R%dx%d dim=%dx%d", plan.height, plan.width, plan.width, plan.height);
+    else
+        fprintf(out_stream, "version=%s%d dim=%d", plan.micro ? "M" : "", plan.version, plan.width);
+    fprintf(out_stream, " level=%c bits=%d capacity_bits=%d blocks=", level_names[plan.corr_level], plan.n_bits,
+            capacity_bits);
+    print_blocks(blocks, out_stream);
+    fprintf(out_stream, " corr_codewords_per_block=%d image=%lldx%lld\n", blocks->n_corr_codewords_per_block,
+            image_width, image_height);
+    return status;
+}
 
-    // 1:1:3:1:1 pattern preceded/followed by 4 light modules
-    for (int y = 0; y < dim; y++) {
-        for (int x = 0; x < dim; x++) {
-            if (y >= 4 && !(bitset_get(code, y, x) | bitset_get(code, y - 1, x) | bitset_get(code, y - 2, x) |
-                            bitset_get(code, y - 3, x))) {
-                int r = 1;
-                while (y - 3 - 7 * r >= 0) {
-                    if (check_finder_pattern_ver(code, y - 4, x, r, -1)) {
-                        penalty += 40;
-                        break;
-                    }
-                    r++;
-                }
-            }
-            if (y + 4 < dim && !(bitset_get(code, y, x) | bitset_get(code, y + 1, x) | bitset_get(code, y + 2, x) |
-                                 bitset_get(code, y + 3, x))) {
-                int r = 1;
-                while (y + 3 + 7 * r < dim) {
-                    if (check_finder_pattern_ver(code, y + 4, x, r, 1)) {
-                        penalty += 40;
-                        break;
-                    }
-                    r++;
-                }
-            }
-            if (x + 4 < dim && !(bitset_get(code, y, x) | bitset_get(code, y, x + 1) | bitset_get(code, y, x + 2) |
-                                 bitset_get(code, y, x + 3))) {
-                int r = 1;
-                while (x + 3 + 7 * r < dim) {
-                    if (check_finder_pattern_hor(code, y, x + 4, r, 1)) {
-                        penalty += 40;
-                        break;
-                    }
-                    r++;
-                }
-            }
-            if (x >= 4 && !(bitset_get(code, y, x) | bitset_get(code, y, x - 1) | bitset_get(code, y, x - 2) |
-                            bitset_get(code, y, x - 3))) {
-                int r = 1;
-                while (x - 3 - 7 * r >= 0) {
-                    if (check_finder_pattern_hor(code, y, x - 4, r, -1)) {
-                        penalty += 40;
-                        break;
-                    }
-                    r++;
-                }
+// plans the input (every record of it in batch mode) instead of encoding it, one line per record
+// returns the number of records that don't fit
+int run_plan(FILE *in_stream, int batch_mode, enum batch_mode_t mode, const quer_options_t *options,
+             int max_version, const output_options_t *output, FILE *out_stream) {
+    void *scratch = malloc(quer_plan_scratch_size());
+    if (scratch == NULL)
+        ERR_AND_DIE("malloc");
+    int n_failed = 0;
+    if (!batch_mode) {
+        input_t input = {0};
+        if (input_read(&input, in_stream, SIZE_MAX) == -1)
+            ERR_AND_DIE("input_read");
+        n_failed = print_plan(input.data, input.len, options, max_version, output, scratch, out_stream) != QUER_OK;
+        input_free(&input);
+    } else {
+        batch_t batch;
+        batch_init(&batch, in_stream, mode);
+        char output_file[PATH_MAX];
+        const char *payload;
+        long len;
+        for (int i = 0; (len = next_payload(&batch, i, NULL, output_file, &payload)) != -1; i++) {
+            fprintf(out_stream, "record=%d ", i);
+            if (len == -2) {
+                fprintf(out_stream, "error=\"invalid record\"\n");
+                n_failed++;
+            } else {
+                n_failed += print_plan(payload, len, options, max_version, output, scratch, out_stream) != QUER_OK;
             }
         }
+        batch_free(&batch);
     }
+    free(scratch);
+    return n_failed;
+}
+
+// what the workers of --serve share: the output options of the server, of which every request sets the format and
+// the ppm, and the render cache (NULL for none)
+typedef struct serve_config_t {
+    const output_options_t *output;
+    render_cache_t *cache;
+} serve_config_t;
+
+// the state of a worker of --serve
+typedef struct serve_worker_t {
+    encoder_t enc;
+    output_options_t output;
+} serve_worker_t;
 
-    // proportion of dark modules
-    int dark_count = 0;
-    for (int y = 0; y < dim; y++) {
-        for (int x = 0; x < dim; x++)
-            dark_count += bitset_get(code, y, x);
+void *serve_worker_init(void *arg) {
+    const serve_config_t *config = arg;
+    serve_worker_t *worker = malloc(sizeof(serve_worker_t));
+    if (worker == NULL)
+        return NULL;
+    if (encoder_init(&worker->enc) == -1) {
+        free(worker);
+        return NULL;
     }
-    int proportion = (int)((double)dark_count / (dim * dim) * 100);
-    penalty += 10 * abs(proportion - 50) / 5;
+    worker->enc.cache = config->cache;
+    worker->output = *config->output;
+    return worker;
+}
+
+void serve_worker_free(void *worker) {
+    encoder_free(&((serve_worker_t *)worker)->enc);
+    free(worker);
+}
 
-    return penalty;
+int serve_render(void *arg, const serve_request_t *req, FILE *out) {
+    serve_worker_t *worker = arg;
+    quer_options_t options = {
+        .corr_level = req->corr_level,
+        .eci = req->eci,
+        .micro = (req->flags & SERVE_FLAG_MICRO) != 0,
+        .rmqr = (req->flags & SERVE_FLAG_RMQR) != 0,
+        .kanji = (req->flags & SERVE_FLAG_KANJI) != 0,
+        .verify = (req->flags & SERVE_FLAG_VERIFY) != 0,
+    };
+    encoder_t *enc = &worker->enc;
+    worker->output.format = req->format;
+    worker->output.ppm = req->ppm;
+    int status = encode_cached(enc, req->payload, req->payload_len, &options, &worker->output);
+    if (status != QUER_OK)
+        return status;
+    // the images in the cache were checked before they were stored
+    int padding = image_padding(enc->code.width, enc->code.height);
+    int width = enc->code.width + 2 * padding, height = enc->code.height + 2 * padding;
+    if (!enc->is_hit && serve_image_bound(req->format, req->ppm, width, height) > SERVE_MAX_IMAGE)
+        return SERVE_ERR_TOO_LARGE;
+    return output_cached(enc, &worker->output, out) == -1 ? SERVE_ERR_OUTPUT : 0;
+}
+
+// serves the requests on a Unix domain socket until SIGINT or SIGTERM (--serve)
+// the templates of all the QR, Micro QR and rMQR versions are built up front, so that no request pays for them
+int run_serve(const char *path, int n_workers, const output_options_t *output, render_cache_t *cache) {
+    for (int version = QUER_MIN_VERSION; version <= QUER_MAX_VERSION; version++)
+        get_version_template(version);
+    for (int version = QUER_MIN_VERSION; version <= QUER_MAX_MICRO_VERSION; version++)
+        get_micro_template(version);
+    for (int version = QUER_MIN_VERSION; version <= QUER_MAX_RMQR_VERSION; version++)
+        get_rmqr_template(version);
+
+    serve_config_t config = {.output = output, .cache = cache};
+    serve_options_t serve_options = {
+        .n_workers = n_workers,
+        .worker_init = serve_worker_init,
+        .worker_free = serve_worker_free,
+        .render = serve_render,
+        .ctx = &config,
+    };
+    if (serve(path, &serve_options) == -1) {
+        fprintf(stderr, "unable to serve on `%s`: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// sends the input to a server (--connect) and writes the image it renders to out_stream
+int run_connect(const char *path, FILE *in_stream, const quer_options_t *options, const output_options_t *output,
+                FILE *out_stream) {
+    input_t input = {0};
+    if (input_read(&input, in_stream, QUER_MAX_INPUT_LEN) == -1)
+        ERR_AND_DIE("input_read");
+    if (input.len > QUER_MAX_INPUT_LEN) {
+        fprintf(stderr, "%s\n", quer_strerror(QUER_ERR_TOO_LONG));
+        input_free(&input);
+        return -1;
+    }
+    int fd = serve_connect(path);
+    if (fd == -1) {
+        fprintf(stderr, "unable to connect to `%s`: %s\n", path, strerror(errno));
+        input_free(&input);
+        return -1;
+    }
+    serve_request_t req = {
+        .corr_level = options->corr_level,
+        .format = output->format,
+        .flags = (options->micro ? SERVE_FLAG_MICRO : 0) | (options->kanji ? SERVE_FLAG_KANJI : 0) |
+                 (options->verify ? SERVE_FLAG_VERIFY : 0) | (options->rmqr ? SERVE_FLAG_RMQR : 0),
+        .ppm = output->ppm,
+        .eci = options->eci,
+        .payload = input.data,
+        .payload_len = input.len,
+    };
+    serve_response_t resp = {0};
+    size_t body_cap = 0;
+    int status = -1;
+    if (serve_send(fd, &req) == -1 || serve_receive(fd, &resp, &body_cap) == -1)
+        fprintf(stderr, "the connection to `%s` failed\n", path);
+    else if (resp.status != 0)
+        fprintf(stderr, "%.*s\n", (int)resp.body_len, (const char *)resp.body);
+    else if (fwrite(resp.body, 1, resp.body_len, out_stream) == resp.body_len)
+        status = 0;
+    close(fd);
+    free(resp.body);
+    input_free(&input);
+    return status;
+}
+
+// returns the libpng filter mask with the given name, or -1 if there's no such filter
+#ifndef QUER_NO_LIBPNG
+int parse_png_filter(const char *name) {
+    static const struct {
+        const char *name;
+        int filter;
+    } filters[] = {{"none", PNG_FILTER_NONE}, {"sub", PNG_FILTER_SUB},     {"up", PNG_FILTER_UP},
+                   {"avg", PNG_FILTER_AVG},   {"paeth", PNG_FILTER_PAETH}, {"all", PNG_ALL_FILTERS}};
+    for (size_t i = 0; i < sizeof(filters) / sizeof(filters[0]); i++) {
+        if (strcmp(name, filters[i].name) == 0)
+            return filters[i].filter;
+    }
+    return -1;
+}
+#else
+int parse_png_filter(const char *) {
+    return -1;
+}
+#endif
+
+// returns the output format with the given name, or -1 if there's no such format
+int parse_format(const char *name) {
+    static const char *formats[] = {
+        [FORMAT_PNG] = "png", [FORMAT_SVG] = "svg", [FORMAT_EPS] = "eps",
+        [FORMAT_PBM] = "pbm", [FORMAT_PGM] = "pgm", [FORMAT_RAW] = "raw",
+    };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        if (strcmp(name, formats[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// sets the PNG encoder with the given name, returns -1 if there's no such encoder
+int parse_png_encoder(const char *name, png_options_t *png_options) {
+    static const struct {
+        const char *name;
+        enum deflate_mode_t mode;
+    } modes[] = {{"stored", DEFLATE_STORED}, {"rle", DEFLATE_RLE}, {"fast", DEFLATE_FAST}};
+#ifndef QUER_NO_LIBPNG
+    if (strcmp(name, "libpng") == 0) {
+        png_options->use_libpng = 1;
+        return 0;
+    }
+#endif
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        if (strcmp(name, modes[i].name) == 0) {
+            png_options->use_libpng = 0;
+            png_options->deflate_mode = modes[i].mode;
+            return 0;
+        }
+    }
+    return -1;
 }
 
 int main(int argc, char **argv) {
-    int c, parse_err = 0, ppm = 20;
+    int c, parse_err = 0, batch = 0, read_mode = 0, print_stats = 0, plan_mode = 0, max_version = 0, append = 0;
+    int n_workers = 0, cache_mib = 0;
     char *input_file = NULL;
     char *output_file = NULL;
-    enum corr_level_t corr_level = CORR_L;
-    while ((c = getopt(argc, argv, "i:o:p:lmqh")) != -1) {
+    char *serve_path = NULL;
+    char *connect_path = NULL;
+    char *cache_dir = NULL;
+    quer_options_t options = {.corr_level = QUER_CORR_L};
+    output_options_t output = {.format = FORMAT_PNG, .ppm = 20, .png = {.compression_level = -1, .filter = -1}};
+    png_options_t *png_options = &output.png;
+#ifndef QUER_NO_LIBPNG
+    png_options->use_libpng = 1;
+#else
+    png_options->deflate_mode = DEFLATE_FAST;
+#endif
+    enum batch_mode_t batch_mode = BATCH_LINES;
+    static const struct option long_options[] = {
+        {"verify", no_argument, NULL, 'v'},
+        {"read", no_argument, NULL, 'r'},
+        {"stats", no_argument, NULL, 'S'},
+        {"plan", no_argument, NULL, 'P'},
+        {"append", no_argument, NULL, 'a'},
+        {"max-version", required_argument, NULL, 'V'},
+        {"micro", no_argument, NULL, 'M'},
+        {"rmqr", no_argument, NULL, 'R'},
+        {"serve", required_argument, NULL, 's'},
+        {"workers", required_argument, NULL, 'W'},
+        {"connect", required_argument, NULL, 'C'},
+        {"cache", required_argument, NULL, 'c'},
+        {"cache-size", required_argument, NULL, 'Z'},
+        {NULL, 0, NULL, 0}};
+    while ((c = getopt_long(argc, argv, "i:o:p:b:t:e:z:f:F:E:kvralmqhMR", long_options, NULL)) != -1) {
         switch (c) {
             case 'i':
                 input_file = optarg;
@@ -635,19 +1189,105 @@ int main(int argc, char **argv) {
                 output_file = optarg;
                 break;
             case 'p':
-                ppm = atoi(optarg);
+                output.ppm = atoi(optarg);
+                break;
+            case 'e':
+                if (parse_png_encoder(optarg, png_options) == -1)
+                    parse_err = 1;
+                break;
+            case 'z':
+                png_options->compression_level = atoi(optarg);
+                if (png_options->compression_level < 0 || png_options->compression_level > 9)
+                    parse_err = 1;
+                break;
+            case 'f':
+                png_options->filter = parse_png_filter(optarg);
+                if (png_options->filter == -1)
+                    parse_err = 1;
+                break;
+            case 'F':
+                output.format = parse_format(optarg);
+                if ((int)output.format == -1)
+                    parse_err = 1;
+                break;
+            case 't':
+                options.n_threads = atoi(optarg);
+                break;
+            case 'b':
+                batch = 1;
+                if (strcmp(optarg, "lines") == 0)
+                    batch_mode = BATCH_LINES;
+                else if (strcmp(optarg, "netstrings") == 0)
+                    batch_mode = BATCH_NETSTRINGS;
+                else if (strcmp(optarg, "manifest") == 0)
+                    batch_mode = BATCH_MANIFEST;
+                else
+                    parse_err = 1;
+                break;
+            case 'E':
+                options.eci = atoi(optarg);
+                if (options.eci < 1 || options.eci > QUER_MAX_ECI)
+                    parse_err = 1;
+                break;
+            case 'k':
+                options.kanji = 1;
+                break;
+            case 'v':
+                options.verify = 1;
+                break;
+            case 'r':
+                read_mode = 1;
+                break;
+            case 'S':
+                print_stats = 1;
+                break;
+            case 'P':
+                plan_mode = 1;
+                break;
+            case 'a':
+                append = 1;
+                break;
+            case 'M':
+                options.micro = 1;
+                break;
+            case 'R':
+                options.rmqr = 1;
+                break;
+            case 's':
+                serve_path = optarg;
+                break;
+            case 'W':
+                n_workers = atoi(optarg);
+                if (n_workers < 1)
+                    parse_err = 1;
+                break;
+            case 'C':
+                connect_path = optarg;
+                break;
+            case 'c':
+                cache_dir = optarg;
+                break;
+            case 'Z':
+                cache_mib = atoi(optarg);
+                if (cache_mib < 1)
+                    parse_err = 1;
+                break;
+            case 'V':
+                max_version = atoi(optarg);
+                if (max_version < QUER_MIN_VERSION || max_version > QUER_MAX_VERSION)
+                    parse_err = 1;
                 break;
             case 'l':
-                corr_level = CORR_L;
+                options.corr_level = QUER_CORR_L;
                 break;
             case 'm':
-                corr_level = CORR_M;
+                options.corr_level = QUER_CORR_M;
                 break;
             case 'q':
-                corr_level = CORR_Q;
+                options.corr_level = QUER_CORR_Q;
                 break;
             case 'h':
-                corr_level = CORR_H;
+                options.corr_level = QUER_CORR_H;
                 break;
             case ':':
                 fprintf(stderr, "option -%c requires an argument\n", optopt);
@@ -662,13 +1302,61 @@ int main(int argc, char **argv) {
         fprintf(stderr, "%s\n", USAGE_STR);
         return EXIT_FAILURE;
     }
-    if (ppm <= 0) {
+    if (output.ppm <= 0) {
         fprintf(stderr, "pixels-per-module (ppm) must be a positive integer\n");
         return EXIT_FAILURE;
     }
+    if (options.n_threads < 0 || options.n_threads > 8) {
+        fprintf(stderr, "the number of threads must be between 0 and 8 (0 is the same as 1)\n");
+        return EXIT_FAILURE;
+    }
+    if (max_version > 0 && !plan_mode && !append) {
+        fprintf(stderr, "--max-version requires --plan or --append\n");
+        return EXIT_FAILURE;
+    }
+    if (append && plan_mode) {
+        fprintf(stderr, "--append can't be combined with --plan\n");
+        return EXIT_FAILURE;
+    }
+    if ((serve_path != NULL || connect_path != NULL) && (batch || read_mode || plan_mode || append)) {
+        fprintf(stderr, "--serve and --connect can't be combined with -b, -r, --plan or --append\n");
+        return EXIT_FAILURE;
+    }
+    if (serve_path != NULL && connect_path != NULL) {
+        fprintf(stderr, "--serve can't be combined with --connect\n");
+        return EXIT_FAILURE;
+    }
+    if (n_workers > 0 && serve_path == NULL) {
+        fprintf(stderr, "--workers requires --serve\n");
+        return EXIT_FAILURE;
+    }
+    if (cache_dir != NULL && (read_mode || plan_mode || connect_path != NULL)) {
+        fprintf(stderr, "--cache can't be combined with -r, --plan or --connect\n");
+        return EXIT_FAILURE;
+    }
+    if (cache_mib > 0 && cache_dir == NULL) {
+        fprintf(stderr, "--cache-size requires --cache\n");
+        return EXIT_FAILURE;
+    }
+    static render_cache_t cache;
+    if (cache_dir != NULL && cache_open(&cache, cache_dir, (int64_t)(cache_mib > 0 ? cache_mib : 256) << 20) == -1) {
+        fprintf(stderr, "unable to open the cache in `%s`: %s\n", cache_dir, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    render_cache_t *render_cache = (cache_dir != NULL ? &cache : NULL);
+    if (serve_path != NULL) {
+        if (n_workers == 0)
+            n_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        int status = run_serve(serve_path, n_workers > 0 ? n_workers : 1, &output, render_cache);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    int append_max_version = (append ? (max_version > 0 ? max_version : QUER_MAX_VERSION) : 0);
+    if (batch && !plan_mode && batch_mode != BATCH_MANIFEST &&
+        (output_file == NULL || !is_valid_pattern(output_file))) {
+        fprintf(stderr, "batch mode requires an output pattern with a single %%d (e.g. `-o qr_%%04d.png`)\n");
+        return EXIT_FAILURE;
+    }
 
-    char data[MAX_CAPACITY];
-    memset(data, 0, MAX_CAPACITY * sizeof(char));
     FILE *in_stream = stdin;
     if (input_file != NULL) {
         in_stream = fopen(input_file, "r");
@@ -677,66 +1365,109 @@ int main(int argc, char **argv) {
             return EXIT_FAILURE;
         }
     }
-    if (fread(data, sizeof(char), MAX_CAPACITY, in_stream) == 0) {
-        fprintf(stderr, "no data provided for the QR code\n");
-        return EXIT_FAILURE;
+    if (read_mode) {
+        FILE *out_stream = stdout;
+        if (output_file != NULL && (out_stream = fopen(output_file, "w")) == NULL) {
+            fprintf(stderr, "unable to open file `%s` for writing\n", output_file);
+            return EXIT_FAILURE;
+        }
+        int status = run_read(in_stream, out_stream);
+        if (fclose(in_stream) || fclose(out_stream))
+            ERR_AND_DIE("fclose");
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (connect_path != NULL) {
+        FILE *out_stream = stdout;
+        if (output_file != NULL && (out_stream = fopen(output_file, "w")) == NULL) {
+            fprintf(stderr, "unable to open file `%s` for writing\n", output_file);
+            return EXIT_FAILURE;
+        }
+        int status = run_connect(connect_path, in_stream, &options, &output, out_stream);
+        if (fclose(in_stream) || fclose(out_stream))
+            ERR_AND_DIE("fclose");
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (plan_mode) {
+        FILE *out_stream = stdout;
+        if (output_file != NULL && (out_stream = fopen(output_file, "w")) == NULL) {
+            fprintf(stderr, "unable to open file `%s` for writing\n", output_file);
+            return EXIT_FAILURE;
+        }
+        int n_failed = run_plan(in_stream, batch, batch_mode, &options, max_version, &output, out_stream);
+        if (fclose(in_stream) || fclose(out_stream))
+            ERR_AND_DIE("fclose");
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    encoder_t enc;
+    if (encoder_init(&enc) == -1)
+        ERR_AND_DIE("encoder_init");
+    enc.cache = render_cache;
+    static run_stats_t stats;
+    if (print_stats) {
+        enc.stats = &stats;
+        options.stats = &stats.last;
+    }
+
+    if (batch) {
+        int n_failed = run_batch(&enc, in_stream, batch_mode, output_file, &options, &output, append_max_version);
+        if (print_stats)
+            stats_print(&stats, options.corr_level, stderr);
+        encoder_free(&enc);
+        if (fclose(in_stream))
+            ERR_AND_DIE("fclose");
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (append) {
+        input_t input = {0};
+        if (input_read(&input, in_stream, SIZE_MAX) == -1)
+            ERR_AND_DIE("input_read");
+        if (fclose(in_stream))
+            ERR_AND_DIE("fclose");
+        int status = write_split(&enc, input.data, input.len, &options, &output, append_max_version, output_file, "");
+        if (print_stats)
+            stats_print(&stats, options.corr_level, stderr);
+        input_free(&input);
+        encoder_free(&enc);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
+
+    // all the bytes of the input are encoded (NULs too), a pipe is read only up to one byte more than fits
+    input_t input = {0};
+    if (input_read(&input, in_stream, QUER_MAX_INPUT_LEN) == -1)
+        ERR_AND_DIE("input_read");
     if (fclose(in_stream))
         ERR_AND_DIE("fclose");
-
-    int data_len = strlen(data);
-    int version = 1;
-    while (version <= 40 && CAPACITY[(int)corr_level][version] < data_len)
-        version++;
-    if (version > 40) {
-        fprintf(stderr, "input is too long to be stored in a QR code with the specified error correction level\n");
+    if (input.len == 0) {
+        fprintf(stderr, "no data provided for the QR code\n");
         return EXIT_FAILURE;
     }
-
-    int dim = 4 * version + 17;
-    uint8_t values[TOTAL_AVAILABLE_MODULES[version] / 8 + 1];
-    bitstream_t bitstream = {.len_bytes = 0, .len_bits = 0, .values = values};
-    fill_data(&bitstream, data, data_len, corr_level, version);
-
-    int n_codewords = TOTAL_DATA_CODEWORDS[(int)corr_level][version] +
-                      TOTAL_BLOCKS[(int)corr_level][version] * CORR_CODEWORDS_PER_BLOCK[(int)corr_level][version];
-    uint8_t final_codewords[n_codewords];
-    add_error_correction_and_interleave(&bitstream, corr_level, version, final_codewords);
-    bitset_t code, blocked;
-    if (bitset_init(&code, dim, dim) == -1)
-        ERR_AND_DIE("bitset_init");
-    if (bitset_init(&blocked, dim, dim) == -1)
-        ERR_AND_DIE("bitset_init");
-    draw_functional_patterns(&code, version, dim, &blocked);
-    draw_data(&code, final_codewords, n_codewords, dim, &blocked);
-
-    int best_mask_i = 0, min_penalty = INT_MAX;
-    for (int mask_i = 0; mask_i < 8; mask_i++) {
-        apply_mask(&code, dim, &blocked, mask_i);
-        draw_format_info(&code, dim, mask_i, corr_level);
-        int penalty = get_penalty(&code, dim);
-        apply_mask(&code, dim, &blocked, mask_i);
-        if (penalty < min_penalty) {
-            best_mask_i = mask_i;
-            min_penalty = penalty;
-        }
+    if (input.len > QUER_MAX_INPUT_LEN) {
+        fprintf(stderr, "the input is longer than %d bytes, the most a QR code holds (-a splits it into symbols)\n",
+                QUER_MAX_INPUT_LEN);
+        return EXIT_FAILURE;
+    }
+    int status = encode_cached(&enc, input.data, input.len, &options, &output);
+    if (status != QUER_OK) {
+        fprintf(stderr, "%s\n", quer_strerror(status));
+        return EXIT_FAILURE;
     }
-    apply_mask(&code, dim, &blocked, best_mask_i);
-    draw_format_info(&code, dim, best_mask_i, corr_level);
 
     FILE *out_stream = stdout;
     if (output_file != NULL) {
         out_stream = fopen(output_file, "w");
         if (out_stream == NULL) {
+            drop_cached(&enc);
             fprintf(stderr, "unable to open file `%s` for writing\n", output_file);
             return EXIT_FAILURE;
         }
     }
-    // some padding so that scanners can distinguish the code from its surroundings
-    // 20% of the QR code's width seems to be good enough, without making the image too large
-    save_as_png(&code, ppm, dim / 5, out_stream);
-    bitset_free(&code);
-    bitset_free(&blocked);
+    if (output_cached(&enc, &output, out_stream) == -1)
+        ERR_AND_DIE("write_image");
+    if (print_stats)
+        stats_print(&stats, options.corr_level, stderr);
+    encoder_free(&enc);
+    input_free(&input);
     if (fclose(out_stream))
         ERR_AND_DIE("fclose");
 
@@ -0,0 +1,124 @@
+#include "penalty.h"
+
+#define MAX_DIM 177
+#define MAX_WORDS ((MAX_DIM + 63) / 64)
+
+// the code is scored on whole 64-bit words, each row (and each column, transposed) is stored as
+// MAX_WORDS words, with module x at bit x % 64 of word x / 64
+typedef uint64_t line_t[MAX_WORDS];
+
+// transposes a 64x64 bit matrix in place, bit j of a[i] becomes bit i of a[j] (Hacker's Delight, 7-3)
+static void transpose64(uint64_t a[64]) {
+    uint64_t m = 0x00000000FFFFFFFFULL;
+    for (int j = 32; j != 0; j >>= 1, m ^= m << j) {
+        for (int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+            uint64_t t = ((a[k] >> j) ^ a[k | j]) & m;
+            a[k | j] ^= t;
+            a[k] ^= t << j;
+        }
+    }
+}
+
+static void load_lines(const bitset_t* code, int dim, line_t* rows, line_t* cols) {
+    int n_words = (dim + 63) / 64;
+    for (int y = 0; y < dim; y++)
+        memcpy(rows[y], bitset_const_row(code, y), n_words * sizeof(uint64_t));
+    // the columns are the rows transposed in 64x64 blocks
+    uint64_t block[64];
+    for (int i = 0; i < n_words; i++) {
+        for (int j = 0; j < n_words; j++) {
+            for (int k = 0; k < 64; k++)
+                block[k] = (i * 64 + k < dim ? rows[i * 64 + k][j] : 0);
+            transpose64(block);
+            for (int k = 0; k < 64 && j * 64 + k < dim; k++)
+                cols[j * 64 + k][i] = block[k];
+        }
+    }
+}
+
+// splits a line of n modules into runs of the same color, returns the number of runs
+// the colors alternate, so only the color of the first run is returned
+static int get_runs(const line_t line, int n, int* run_len, int* first_color) {
+    int n_runs = 0, run_start = 0;
+    *first_color = line[0] & 1;
+    for (int i = 0; i * 64 < n; i++) {
+        // bit x is set if module x differs from module x - 1
+        uint64_t carry = (i == 0 ? line[0] & 1 : line[i - 1] >> 63);
+        uint64_t transitions = line[i] ^ ((line[i] << 1) | carry);
+        if (n - i * 64 < 64)
+            transitions &= ((uint64_t)1 << (n - i * 64)) - 1;
+        while (transitions != 0) {
+            int x = i * 64 + __builtin_ctzll(transitions);
+            run_len[n_runs++] = x - run_start;
+            run_start = x;
+            transitions &= transitions - 1;
+        }
+    }
+    run_len[n_runs++] = n - run_start;
+    return n_runs;
+}
+
+// monochromatic streaks of >= 5 modules and 1:1:3:1:1 patterns preceded/followed by 4 light modules
+static int get_line_penalty(const line_t line, int n) {
+    int run_len[MAX_DIM], first_color;
+    int n_runs = get_runs(line, n, run_len, &first_color);
+    int penalty = 0;
+    for (int i = 0; i < n_runs; i++) {
+        int r = run_len[i];
+        if (r >= 5)
+            penalty += 3 + (r - 5);
+        // the pattern starts (or ends) with a dark run which determines its scale
+        if ((i % 2 == 0) != (first_color == 1))
+            continue;
+        if (i >= 1 && i + 4 < n_runs && run_len[i - 1] >= 4 && run_len[i + 1] == r && run_len[i + 2] == 3 * r &&
+            run_len[i + 3] == r && run_len[i + 4] >= r)
+            penalty += 40;
+        if (i >= 4 && i + 1 < n_runs && run_len[i + 1] >= 4 && run_len[i - 1] == r && run_len[i - 2] == 3 * r &&
+            run_len[i - 3] == r && run_len[i - 4] >= r)
+            penalty += 40;
+    }
+    return penalty;
+}
+
+// number of 2x2 monochromatic blocks with their top left corner in the given row
+static int count_blocks(const line_t top, const line_t bottom, int n) {
+    int count = 0, n_words = (n + 63) / 64;
+    for (int i = 0; i * 64 < n - 1; i++) {
+        uint64_t top_next = (top[i] >> 1) | (i + 1 < n_words ? top[i + 1] << 63 : 0);
+        uint64_t bottom_next = (bottom[i] >> 1) | (i + 1 < n_words ? bottom[i + 1] << 63 : 0);
+        uint64_t same = ~(top[i] ^ bottom[i]) & ~(top[i] ^ top_next) & ~(bottom[i] ^ bottom_next);
+        if (n - 1 - i * 64 < 64)
+            same &= ((uint64_t)1 << (n - 1 - i * 64)) - 1;
+        count += __builtin_popcountll(same);
+    }
+    return count;
+}
+
+int get_penalty(const bitset_t* code, int dim) {
+    line_t rows[MAX_DIM], cols[MAX_DIM];
+    load_lines(code, dim, rows, cols);
+
+    int penalty = 0, dark_count = 0;
+    for (int i = 0; i < dim; i++) {
+        penalty += get_line_penalty(rows[i], dim);
+        penalty += get_line_penalty(cols[i], dim);
+    }
+    for (int y = 0; y < dim - 1; y++)
+        penalty += 3 * count_blocks(rows[y], rows[y + 1], dim);
+
+    // proportion of dark modules
+    for (int y = 0; y < dim; y++)
+        dark_count += bitset_popcount_row(code, y);
+    int proportion = (int)((double)dark_count / (dim * dim) * 100);
+    penalty += 10 * abs(proportion - 50) / 5;
+
+    return penalty;
+}
+
+int get_micro_score(const bitset_t* code, int dim) {
+    int right = 0;
+    for (int y = 1; y < dim; y++)
+        right += bitset_get(code, y, dim - 1);
+    int bottom = bitset_popcount_row(code, dim - 1) - bitset_get(code, dim - 1, 0);
+    return right <= bottom ? 16 * right + bottom : 16 * bottom + right;
+}
@@ -0,0 +1,14 @@
+#ifndef PENALTY_H
+#define PENALTY_H
+
+#include "bitset.h"
+
+// penalty score of a (masked) dim x dim code, as defined by the QR code spec
+// the lower, the easier the code is to scan
+int get_penalty(const bitset_t* code, int dim);
+// score of a (masked) dim x dim Micro QR code, as defined by the spec: the dark modules along its right and bottom
+// edges (without the timing patterns), the fewer dark modules on the emptier edge, the lower the score
+// the higher, the easier the code is to scan
+int get_micro_score(const bitset_t* code, int dim);
+
+#endif  // PENALTY_H
@@ -0,0 +1,27 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <stdio.h>
+
+#include "deflate.h"
+#include "raster.h"
+
+// a PNG encoder for 1-bit grayscale images, independent of libpng
+// the ppm - 1 repetitions of a row use the Up filter, so they become runs of zeros
+typedef struct png_writer_t {
+    deflate_t deflate;
+    FILE* file;
+    int error;
+    // RASTER_CHUNK_BYTES each: a piece of the row being rendered and a piece of a repeated row after filtering
+    uint8_t* chunk;
+    uint8_t* zeros;
+} png_writer_t;
+
+int png_writer_init(png_writer_t* writer);
+// writes the raster (with dark pixels as 0 bits) as a PNG image
+int png_writer_write(png_writer_t* writer, const raster_t* raster, enum deflate_mode_t mode, FILE* file);
+void png_writer_free(png_writer_t* writer);
+
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len);
+
+#endif  // PNG_WRITER_H
@@ -0,0 +1,813 @@
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+
+#include "bitset.h"
+#include "bitstream.h"
+#include "decoder.h"
+#include "penalty.h"
+#include "quer.h"
+#include "reader.h"
+#include "reed_solomon.h"
+#include "segments.h"
+#include "tables.h"
+#include "templates.h"
+#include "verify.h"
+
+#define SCRATCH_ALIGN 16
+#define MAX_DIM (4 * QUER_MAX_VERSION + 17)
+// the longest data that fits in a Micro QR code (digits, in M4 with level L)
+#define MAX_MICRO_INPUT_LEN 35
+// and in an rMQR code (digits, in R17x139 with level M)
+#define MAX_RMQR_INPUT_LEN 361
+
+// the kinds of codes, each with its own versions numbered from 1
+enum symbol_kind_t { SYMBOL_QR, SYMBOL_MICRO, SYMBOL_RMQR };
+
+// the rMQR versions from the one with the fewest modules up (the first one in case of a tie)
+static const int RMQR_BY_AREA[QUER_MAX_RMQR_VERSION] = {11, 1,  17, 6,  2,  12, 7,  3,  18, 23, 13,
+                                                         4,  8,  28, 19, 14, 24, 9,  5,  20, 29, 15,
+                                                         25, 10, 21, 30, 26, 16, 31, 22, 27, 32};
+
+// bits of the headers before the segments (Structured Append and ECI) in the group of versions
+static int header_bits(const quer_options_t *options, int group) {
+    return (options->append_total > 0 ? APPEND_HEADER_BITS : 0) + eci_bits(options->eci, group);
+}
+
+// the level a code of the kind gets for the one asked for: rMQR codes have only levels M and H
+static enum quer_corr_level_t symbol_corr_level(enum symbol_kind_t kind, enum quer_corr_level_t corr_level) {
+    if (kind != SYMBOL_RMQR)
+        return corr_level;
+    return corr_level == QUER_CORR_L ? QUER_CORR_M : corr_level == QUER_CORR_Q ? QUER_CORR_H : corr_level;
+}
+
+// the data capacity of a version in bits, 0 if it's a Micro QR or rMQR version without the level
+static int data_bits(enum quer_corr_level_t corr_level, enum symbol_kind_t kind, int version) {
+    switch (kind) {
+        case SYMBOL_MICRO:
+            return MICRO_DATA_BITS[(int)corr_level][version];
+        case SYMBOL_RMQR:
+            return RMQR_DATA_CODEWORDS[(int)corr_level][version] * 8;
+        default:
+            return TOTAL_DATA_CODEWORDS[(int)corr_level][version] * 8;
+    }
+}
+
+static int symbol_width(enum symbol_kind_t kind, int version) {
+    switch (kind) {
+        case SYMBOL_MICRO:
+            return 2 * version + 9;
+        case SYMBOL_RMQR:
+            return RMQR_WIDTH[version];
+        default:
+            return 4 * version + 17;
+    }
+}
+
+static int symbol_height(enum symbol_kind_t kind, int version) {
+    return kind == SYMBOL_RMQR ? RMQR_HEIGHT[version] : symbol_width(kind, version);
+}
+
+static int symbol_group(enum symbol_kind_t kind, int version) {
+    switch (kind) {
+        case SYMBOL_MICRO:
+            return micro_version_group(version);
+        case SYMBOL_RMQR:
+            return rmqr_version_group(version);
+        default:
+            return version_group(version);
+    }
+}
+
+// writes the headers and the segments, followed by the terminator and the padding
+// corr_level is the level of the code (see symbol_corr_level)
+static void fill_data(bitstream_t *bitstream, const uint8_t *data, int data_len, const uint8_t *modes,
+                      const quer_options_t *options, enum quer_corr_level_t corr_level, enum symbol_kind_t kind,
+                      int version) {
+    if (options->append_total > 0)
+        write_append_header(bitstream, options->append_index, options->append_total, options->append_parity);
+    int group = symbol_group(kind, version);
+    write_segments(bitstream, data, data_len, modes, group, options->eci);
+    int total_bits = data_bits(corr_level, kind, version);
+    int n_terminator_bits = terminator_bits(group);
+    if (n_terminator_bits > total_bits - bitstream->len_bits)
+        n_terminator_bits = total_bits - bitstream->len_bits;
+    add_bits_to_stream(bitstream, 0, n_terminator_bits);
+    // zeros up to a whole codeword (the last data codeword of M1 and M3 is only 4 bits long)
+    int zero_bits = (8 - bitstream->len_bits % 8) % 8;
+    if (zero_bits > total_bits - bitstream->len_bits)
+        zero_bits = total_bits - bitstream->len_bits;
+    add_bits_to_stream(bitstream, 0, zero_bits);
+    int pad_byte = 0b11101100;
+    while (bitstream->len_bits + 8 <= total_bits) {
+        add_bits_to_stream(bitstream, pad_byte, 8);
+        pad_byte ^= (0b11101100 ^ 0b00010001);
+    }
+    // a 4-bit last codeword is padded with zeros
+    add_bits_to_stream(bitstream, 0, total_bits - bitstream->len_bits);
+}
+
+// whether a Micro QR code may be chosen for the data (they have no ECI and Structured Append)
+static int allows_micro(const quer_options_t *options, int data_len) {
+    return options->micro && options->eci == 0 && options->append_total == 0 && options->min_version == 0 &&
+           data_len <= MAX_MICRO_INPUT_LEN;
+}
+
+// whether an rMQR code may be chosen for the data (they have no Structured Append)
+static int allows_rmqr(const quer_options_t *options, int data_len) {
+    return options->rmqr && options->append_total == 0 && options->min_version == 0 && data_len <= MAX_RMQR_INPUT_LEN;
+}
+
+// plans the segments for each group of versions (with its own widths of the character count fields),
+// returns the smallest version (not below options->min_version) that fits them (storing their length in bits,
+// with the headers, in *n_bits) or -1 if there's none
+// the Micro QR versions (each one a group of its own) come first if they're allowed, then the rMQR ones (likewise)
+// from the one with the fewest modules, *kind is set to the kind of the chosen version
+static int pick_version(const uint8_t *data, int data_len, const quer_options_t *options, uint8_t *segments_mem,
+                        uint8_t *modes, int *n_bits, enum symbol_kind_t *kind) {
+    *kind = SYMBOL_MICRO;
+    for (int version = QUER_MIN_VERSION; allows_micro(options, data_len) && version <= QUER_MAX_MICRO_VERSION;
+         version++) {
+        int capacity = MICRO_DATA_BITS[(int)options->corr_level][version];
+        if (capacity == 0)
+            continue;
+        *n_bits = plan_segments(data, data_len, micro_version_group(version), options->kanji, segments_mem, modes);
+        if (*n_bits <= capacity)
+            return version;
+    }
+    *kind = SYMBOL_RMQR;
+    enum quer_corr_level_t rmqr_level = symbol_corr_level(SYMBOL_RMQR, options->corr_level);
+    for (int i = 0; allows_rmqr(options, data_len) && i < QUER_MAX_RMQR_VERSION; i++) {
+        int version = RMQR_BY_AREA[i], group = rmqr_version_group(version);
+        *n_bits = plan_segments(data, data_len, group, options->kanji, segments_mem, modes) +
+                  header_bits(options, group);
+        if (*n_bits <= RMQR_DATA_CODEWORDS[(int)rmqr_level][version] * 8)
+            return version;
+    }
+    *kind = SYMBOL_QR;
+    for (int group = 0; group < N_VERSION_GROUPS; group++) {
+        int first_version = version_group_start(group);
+        int last_version = group + 1 < N_VERSION_GROUPS ? version_group_start(group + 1) - 1 : QUER_MAX_VERSION;
+        if (last_version < options->min_version)
+            continue;
+        if (first_version < options->min_version)
+            first_version = options->min_version;
+        *n_bits =
+            plan_segments(data, data_len, group, options->kanji, segments_mem, modes) + header_bits(options, group);
+        for (int version = first_version; version <= last_version; version++) {
+            if (*n_bits <= TOTAL_DATA_CODEWORDS[(int)options->corr_level][version] * 8)
+                return version;
+        }
+    }
+    return -1;
+}
+
+// whether the options other than the error correction level are valid
+static int valid_options(const quer_options_t *options) {
+    if (options->eci < 0 || options->eci > QUER_MAX_ECI || options->min_version < 0 ||
+        options->min_version > QUER_MAX_VERSION)
+        return 0;
+    return options->append_total == 0 ||
+           (options->append_total >= 2 && options->append_total <= QUER_MAX_APPEND_SYMBOLS &&
+            options->append_index >= 0 && options->append_index < options->append_total &&
+            options->append_parity >= 0 && options->append_parity <= 0xFF);
+}
+
+static quer_blocks_t get_blocks(enum quer_corr_level_t corr_level, enum symbol_kind_t kind, int version) {
+    if (kind == SYMBOL_MICRO) {
+        int n_data_codewords = (MICRO_DATA_BITS[(int)corr_level][version] + 7) / 8;
+        return (quer_blocks_t){.n_data_codewords = n_data_codewords,
+                               .n_blocks = 1,
+                               .n_small_blocks = 1,
+                               .small_block_len = n_data_codewords,
+                               .n_corr_codewords_per_block = MICRO_CORR_CODEWORDS[(int)corr_level][version]};
+    }
+    int rmqr = (kind == SYMBOL_RMQR), level = corr_level;
+    int n_blocks = (rmqr ? RMQR_BLOCKS[level][version] : TOTAL_BLOCKS[level][version]);
+    int n_corr_codewords_per_block =
+        (rmqr ? RMQR_CORR_CODEWORDS_PER_BLOCK[level][version] : CORR_CODEWORDS_PER_BLOCK[level][version]);
+    int n_all_codewords = (rmqr ? RMQR_AVAILABLE_MODULES[version] : TOTAL_AVAILABLE_MODULES[version]) / 8;
+    return (quer_blocks_t){
+        .n_data_codewords = (rmqr ? RMQR_DATA_CODEWORDS[level][version] : TOTAL_DATA_CODEWORDS[level][version]),
+        .n_blocks = n_blocks,
+        .n_small_blocks = n_blocks - n_all_codewords % n_blocks,
+        .small_block_len = n_all_codewords / n_blocks - n_corr_codewords_per_block,
+        .n_corr_codewords_per_block = n_corr_codewords_per_block,
+    };
+}
+
+// returns the number of bytes of res
+static int add_error_correction_and_interleave(bitstream_t *bitstream, const quer_blocks_t *blocks, uint8_t *res) {
+    int n_blocks = blocks->n_blocks;
+    int n_corr_codewords_per_block = blocks->n_corr_codewords_per_block;
+    int corr_offset = blocks->n_data_codewords;
+    int n_small_blocks = blocks->n_small_blocks;
+    int small_block_len = blocks->small_block_len;
+    int big_block_len = small_block_len + 1;
+
+    uint8_t corr_codewords[n_corr_codewords_per_block];
+
+    int block_start = 0;
+    for (int i = 0; i < n_blocks; i++) {
+        int block_len = (i < n_small_blocks ? small_block_len : big_block_len);
+        compute_corr_codewords(bitstream->values + block_start, block_len, n_corr_codewords_per_block, corr_codewords);
+        int idx = i;
+        for (int j = 0; j < block_len; j++) {
+            // so that we don't leave empty spaces
+            if (j == big_block_len - 1)
+                idx -= n_small_blocks;
+            res[idx] = bitstream->values[block_start + j];
+            idx += n_blocks;
+        }
+        for (int j = 0; j < n_corr_codewords_per_block; j++) {
+            res[corr_offset + i + n_blocks * j] = corr_codewords[j];
+        }
+        block_start += block_len;
+    }
+    return corr_offset + n_blocks * n_corr_codewords_per_block;
+}
+
+// Micro QR codes have a single block, whose error correction codewords follow the data bits right after the 4-bit
+// last data codeword of M1 and M3 (which is the high half of a byte for the error correction)
+// returns the number of bytes of res
+static int add_micro_error_correction(bitstream_t *bitstream, enum quer_corr_level_t corr_level, int version,
+                                      uint8_t *res) {
+    int n_data_bits = MICRO_DATA_BITS[(int)corr_level][version];
+    int n_corr_codewords = MICRO_CORR_CODEWORDS[(int)corr_level][version];
+    int n_data_codewords = (n_data_bits + 7) / 8, shift = n_data_bits % 8;
+    if (shift != 0)
+        bitstream->values[n_data_codewords - 1] <<= 8 - shift;
+
+    uint8_t corr_codewords[n_corr_codewords];
+
+    compute_corr_codewords(bitstream->values, n_data_codewords, n_corr_codewords, corr_codewords);
+    memcpy(res, bitstream->values, n_data_codewords);
+    for (int j = 0; j < n_corr_codewords; j++) {
+        int k = n_data_codewords + j;
+        if (shift == 0) {
+            res[k] = corr_codewords[j];
+        } else {
+            res[k - 1] |= corr_codewords[j] >> shift;
+            res[k] = corr_codewords[j] << (8 - shift);
+        }
+    }
+    return n_data_codewords + n_corr_codewords;
+}
+
+static void apply_mask(bitset_t *code, const version_template_t *template, int mask_i) {
+    bitset_xor(code, &template->masks[mask_i]);
+}
+
+static void draw_format_info(bitset_t *code, int dim, int mask_i, enum quer_corr_level_t corr_level) {
+    int corr_level_i;
+    switch (corr_level) {
+        case QUER_CORR_L:
+            corr_level_i = 0b01;
+            break;
+        case QUER_CORR_M:
+            corr_level_i = 0b00;
+            break;
+        case QUER_CORR_Q:
+            corr_level_i = 0b11;
+            break;
+        default:
+            corr_level_i = 0b10;
+    }
+    int info_code = (corr_level_i << 3) | mask_i;
+    // magic values from the spec
+    int rem = info_code, gen_poly = 0b0000010100110111;
+    for (int i = 0; i < 10; i++) {
+        rem = (rem << 1) ^ ((rem >> 9) * gen_poly);
+    }
+    info_code = (info_code << 10 | rem) ^ 0b0101010000010010;
+
+    for (int y = 0; y < 6; y++) {
+        if ((info_code & (1 << y)) > 0)
+            bitset_set(code, y, 8);
+        else
+            bitset_unset(code, y, 8);
+    }
+
+    if ((info_code & (1 << 6)) > 0)
+        bitset_set(code, 7, 8);
+    else
+        bitset_unset(code, 7, 8);
+    if ((info_code & (1 << 7)) > 0)
+        bitset_set(code, 8, 8);
+    else
+        bitset_unset(code, 8, 8);
+    if ((info_code & (1 << 8)) > 0)
+        bitset_set(code, 8, 7);
+    else
+        bitset_unset(code, 8, 7);
+
+    for (int x = 9; x < 15; x++) {
+        if ((info_code & (1 << x)) > 0)
+            bitset_set(code, 8, 14 - x);
+        else
+            bitset_unset(code, 8, 14 - x);
+    }
+    for (int x = 0; x < 8; x++) {
+        if ((info_code & (1 << x)) > 0)
+            bitset_set(code, 8, dim - 1 - x);
+        else
+            bitset_unset(code, 8, dim - 1 - x);
+    }
+    for (int y = 0; y < 7; y++) {
+        if ((info_code & (1 << (14 - y))) > 0)
+            bitset_set(code, dim - 1 - y, 8);
+        else
+            bitset_unset(code, dim - 1 - y, 8);
+    }
+}
+
+static void draw_micro_format_info(bitset_t *code, int version, int mask_i, enum quer_corr_level_t corr_level) {
+    int info_code = micro_format_info_bits(version, corr_level, mask_i);
+    for (int i = 0; i < 8; i++) {
+        if ((info_code & (1 << i)) > 0)
+            bitset_set(code, i + 1, 8);
+        else
+            bitset_unset(code, i + 1, 8);
+    }
+    for (int i = 8; i < 15; i++) {
+        if ((info_code & (1 << i)) > 0)
+            bitset_set(code, 8, 15 - i);
+        else
+            bitset_unset(code, 8, 15 - i);
+    }
+}
+
+// rMQR codes store both copies of their format info with masks of their own, and have a single mask for the data
+static void draw_rmqr_format_info(bitset_t *code, int version, enum quer_corr_level_t corr_level) {
+    for (int copy = 0; copy < 2; copy++) {
+        int info_code = rmqr_format_info_bits(version, corr_level, copy);
+        for (int i = 0; i < RMQR_FORMAT_INFO_BITS; i++) {
+            int r, c;
+            rmqr_format_info_module(code->width, code->height, copy, i, &r, &c);
+            if ((info_code & (1 << i)) > 0)
+                bitset_set(code, r, c);
+            else
+                bitset_unset(code, r, c);
+        }
+    }
+}
+
+// evaluates the masks first_mask, first_mask + mask_step, ... on its own copy of the (unmasked) code
+typedef struct mask_worker_t {
+    bitset_t code;
+    const version_template_t *template;
+    int dim;
+    enum quer_corr_level_t corr_level;
+    int first_mask;
+    int mask_step;
+    int *penalties;
+} mask_worker_t;
+
+static int evaluate_masks(void *arg) {
+    mask_worker_t *worker = arg;
+    for (int mask_i = worker->first_mask; mask_i < N_MASKS; mask_i += worker->mask_step) {
+        apply_mask(&worker->code, worker->template, mask_i);
+        draw_format_info(&worker->code, worker->dim, mask_i, worker->corr_level);
+        worker->penalties[mask_i] = get_penalty(&worker->code, worker->dim);
+        apply_mask(&worker->code, worker->template, mask_i);
+    }
+    return 0;
+}
+
+// returns the mask with the lowest penalty (the lowest index in case of a tie, no matter how many threads are used)
+// worker_mem has room for N_MASKS - 1 bitsets of bitset_bytes each, the copies of the code for the extra threads
+// the penalties of all masks are stored in penalties
+static int pick_best_mask(bitset_t *code, int dim, const version_template_t *template,
+                          enum quer_corr_level_t corr_level, int n_threads, char *worker_mem, size_t bitset_bytes,
+                          int *penalties) {
+    mask_worker_t workers[N_MASKS];
+    thrd_t threads[N_MASKS];
+    int started[N_MASKS] = {0};
+    if (n_threads < 1)
+        n_threads = 1;
+    if (n_threads > N_MASKS)
+        n_threads = N_MASKS;
+    int n_workers = n_threads, status = 0;
+    for (int i = 0; i < n_threads; i++) {
+        workers[i] = (mask_worker_t){.code = *code,
+                                     .template = template,
+                                     .dim = dim,
+                                     .corr_level = corr_level,
+                                     .first_mask = i,
+                                     .mask_step = n_threads,
+                                     .penalties = penalties};
+        // the calling thread works on the original code, the others on their own copies
+        if (i > 0) {
+            if (bitset_init_from_buffer(&workers[i].code, dim, dim, worker_mem + (i - 1) * bitset_bytes,
+                                        bitset_bytes) == -1) {
+                n_workers = i;
+                status = -1;
+                break;
+            }
+            bitset_copy(&workers[i].code, code);
+            started[i] = (thrd_create(&threads[i], evaluate_masks, &workers[i]) == thrd_success);
+        }
+    }
+    if (status == 0)
+        evaluate_masks(&workers[0]);
+    // the threads started before an error still work on workers, which live in this frame
+    for (int i = 1; i < n_workers; i++) {
+        if (started[i])
+            thrd_join(threads[i], NULL);
+        else if (status == 0)
+            evaluate_masks(&workers[i]);
+    }
+    if (status == -1)
+        return -1;
+
+    int best_mask_i = 0;
+    for (int mask_i = 1; mask_i < N_MASKS; mask_i++) {
+        if (penalties[mask_i] < penalties[best_mask_i])
+            best_mask_i = mask_i;
+    }
+    return best_mask_i;
+}
+
+// returns the mask of a Micro QR code with the highest score (the lowest index in case of a tie),
+// storing the scores of all masks in scores
+static int pick_best_micro_mask(bitset_t *code, const version_template_t *template, int *scores) {
+    int best_mask_i = 0;
+    for (int mask_i = 0; mask_i < N_MICRO_MASKS; mask_i++) {
+        apply_mask(code, template, mask_i);
+        scores[mask_i] = get_micro_score(code, code->width);
+        apply_mask(code, template, mask_i);
+        if (scores[mask_i] > scores[best_mask_i])
+            best_mask_i = mask_i;
+    }
+    return best_mask_i;
+}
+
+// the current time in ns, only read for the stats
+static int64_t stats_clock(const quer_stats_t *stats) {
+    struct timespec ts;
+    if (stats == NULL || timespec_get(&ts, TIME_UTC) != TIME_UTC)
+        return 0;
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t align_up(size_t n) { return (n + SCRATCH_ALIGN - 1) / SCRATCH_ALIGN * SCRATCH_ALIGN; }
+
+size_t quer_scratch_size(void) {
+    // the code itself, two codeword buffers, the copies of the code for the threads evaluating the masks
+    // and the memory of the segmentation (its working memory and the mode of every byte)
+    return align_up(sizeof(bitset_t)) + N_MASKS * align_up(bitset_size(MAX_DIM, MAX_DIM)) +
+           2 * align_up(TOTAL_AVAILABLE_MODULES[QUER_MAX_VERSION] / 8 + 1) +
+           align_up(SEGMENTS_MEM_SIZE(QUER_MAX_INPUT_LEN)) + align_up(QUER_MAX_INPUT_LEN);
+}
+
+int quer_encode(const char *data, size_t data_len, const quer_options_t *options, void *scratch, size_t scratch_size,
+                quer_code_t *code) {
+    if (options == NULL || code == NULL || (data == NULL && data_len > 0) || options->corr_level < QUER_CORR_L ||
+        options->corr_level > QUER_CORR_H || !valid_options(options))
+        return QUER_ERR_INVALID_ARG;
+    if (scratch == NULL || scratch_size < quer_scratch_size())
+        return QUER_ERR_SCRATCH;
+    if (data_len > QUER_MAX_INPUT_LEN)
+        return QUER_ERR_TOO_LONG;
+#ifndef QUER_NO_STATS
+    quer_stats_t *stats = options->stats;
+#else
+    quer_stats_t *stats = NULL;
+#endif
+    int64_t start_ns = stats_clock(stats);
+
+    size_t bitset_bytes = align_up(bitset_size(MAX_DIM, MAX_DIM));
+    size_t codeword_bytes = align_up(TOTAL_AVAILABLE_MODULES[QUER_MAX_VERSION] / 8 + 1);
+    bitset_t *modules = scratch;
+    char *mem = (char *)scratch + align_up(sizeof(bitset_t));
+    uint8_t *values = (uint8_t *)(mem + bitset_bytes);
+    uint8_t *final_codewords = (uint8_t *)(mem + bitset_bytes + codeword_bytes);
+    char *worker_mem = mem + bitset_bytes + 2 * codeword_bytes;
+    uint8_t *segments_mem = (uint8_t *)(worker_mem + (N_MASKS - 1) * bitset_bytes);
+    uint8_t *modes = segments_mem + align_up(SEGMENTS_MEM_SIZE(QUER_MAX_INPUT_LEN));
+
+    int n_bits;
+    enum symbol_kind_t kind;
+    int version = pick_version((const uint8_t *)data, data_len, options, segments_mem, modes, &n_bits, &kind);
+    if (version == -1)
+        return QUER_ERR_TOO_LONG;
+    enum quer_corr_level_t corr_level = symbol_corr_level(kind, options->corr_level);
+    int width = symbol_width(kind, version), height = symbol_height(kind, version);
+    if (bitset_init_from_buffer(modules, width, height, mem, bitset_bytes) == -1)
+        return QUER_ERR_SCRATCH;
+
+    bitstream_t bitstream = {.len_bytes = 0, .len_bits = 0, .values = values};
+    fill_data(&bitstream, (const uint8_t *)data, data_len, modes, options, corr_level, kind, version);
+    int64_t segments_end_ns = stats_clock(stats);
+    quer_blocks_t blocks = get_blocks(corr_level, kind, version);
+    int n_codewords;
+    if (kind == SYMBOL_MICRO)
+        n_codewords = add_micro_error_correction(&bitstream, corr_level, version, final_codewords);
+    else
+        n_codewords = add_error_correction_and_interleave(&bitstream, &blocks, final_codewords);
+    int64_t rs_end_ns = stats_clock(stats);
+    const version_template_t *template =
+        (kind == SYMBOL_MICRO  ? get_micro_template(version)
+         : kind == SYMBOL_RMQR ? get_rmqr_template(version)
+                               : get_version_template(version));
+    bitset_copy(modules, &template->code);
+    draw_data(modules, template, final_codewords, n_codewords);
+    int64_t placement_end_ns = stats_clock(stats);
+
+    // rMQR codes have a single mask, so nothing is scored
+    int penalties[N_MASKS] = {0};
+    int best_mask_i = 0;
+    if (kind == SYMBOL_MICRO)
+        best_mask_i = pick_best_micro_mask(modules, template, penalties);
+    else if (kind == SYMBOL_QR)
+        best_mask_i = pick_best_mask(modules, width, template, corr_level, options->n_threads, worker_mem,
+                                     bitset_bytes, penalties);
+    if (best_mask_i == -1)
+        return QUER_ERR_SCRATCH;
+    apply_mask(modules, template, best_mask_i);
+    if (kind == SYMBOL_MICRO)
+        draw_micro_format_info(modules, version, best_mask_i, corr_level);
+    else if (kind == SYMBOL_RMQR)
+        draw_rmqr_format_info(modules, version, corr_level);
+    else
+        draw_format_info(modules, width, best_mask_i, corr_level);
+    int64_t masks_end_ns = stats_clock(stats);
+
+    code->version = version;
+    code->micro = (kind == SYMBOL_MICRO);
+    code->rmqr = (kind == SYMBOL_RMQR);
+    code->width = width;
+    code->height = height;
+    code->mask = best_mask_i;
+    code->corr_level = corr_level;
+    code->modules = modules;
+    code->append_index = options->append_index;
+    code->append_total = options->append_total;
+    code->append_parity = options->append_parity;
+    int status = (options->verify ? quer_verify(code, data, data_len, options) : QUER_OK);
+    if (stats != NULL) {
+        *stats = (quer_stats_t){
+            .blocks = blocks,
+            .segments_ns = segments_end_ns - start_ns,
+            .rs_ns = rs_end_ns - segments_end_ns,
+            .placement_ns = placement_end_ns - rs_end_ns,
+            .masks_ns = masks_end_ns - placement_end_ns,
+            .verify_ns = (options->verify ? stats_clock(stats) - masks_end_ns : 0),
+        };
+        memcpy(stats->penalties, penalties, sizeof(penalties));
+    }
+    return status;
+}
+
+size_t quer_plan_scratch_size(void) {
+    return align_up(SEGMENTS_MEM_SIZE(QUER_MAX_INPUT_LEN)) + align_up(QUER_MAX_INPUT_LEN);
+}
+
+static int check_plan_args(const char *data, size_t data_len, const quer_options_t *options, void *scratch,
+                           size_t scratch_size, const quer_plan_t *plan) {
+    if (options == NULL || plan == NULL || (data == NULL && data_len > 0) || !valid_options(options))
+        return QUER_ERR_INVALID_ARG;
+    if (scratch == NULL || scratch_size < quer_plan_scratch_size())
+        return QUER_ERR_SCRATCH;
+    if (data_len > QUER_MAX_INPUT_LEN)
+        return QUER_ERR_TOO_LONG;
+    return QUER_OK;
+}
+
+// corr_level is the level asked for, the plan gets the one of the code
+static void make_plan(enum quer_corr_level_t corr_level, enum symbol_kind_t kind, int version, int n_bits,
+                      quer_plan_t *plan) {
+    corr_level = symbol_corr_level(kind, corr_level);
+    *plan = (quer_plan_t){.version = version,
+                          .micro = (kind == SYMBOL_MICRO),
+                          .rmqr = (kind == SYMBOL_RMQR),
+                          .width = symbol_width(kind, version),
+                          .height = symbol_height(kind, version),
+                          .corr_level = corr_level,
+                          .n_bits = n_bits,
+                          .blocks = get_blocks(corr_level, kind, version)};
+}
+
+int quer_plan(const char *data, size_t data_len, const quer_options_t *options, void *scratch, size_t scratch_size,
+              quer_plan_t *plan) {
+    int status = check_plan_args(data, data_len, options, scratch, scratch_size, plan);
+    if (status != QUER_OK)
+        return status;
+    if (options->corr_level < QUER_CORR_L || options->corr_level > QUER_CORR_H)
+        return QUER_ERR_INVALID_ARG;
+    uint8_t *segments_mem = scratch;
+    uint8_t *modes = segments_mem + align_up(SEGMENTS_MEM_SIZE(QUER_MAX_INPUT_LEN));
+    int n_bits;
+    enum symbol_kind_t kind;
+    int version = pick_version((const uint8_t *)data, data_len, options, segments_mem, modes, &n_bits, &kind);
+    if (version == -1)
+        return QUER_ERR_TOO_LONG;
+    make_plan(options->corr_level, kind, version, n_bits, plan);
+    return QUER_OK;
+}
+
+int quer_plan_best_level(const char *data, size_t data_len, const quer_options_t *options, int max_version,
+                         void *scratch, size_t scratch_size, quer_plan_t *plan) {
+    int status = check_plan_args(data, data_len, options, scratch, scratch_size, plan);
+    if (status != QUER_OK)
+        return status;
+    if (max_version < QUER_MIN_VERSION || max_version > QUER_MAX_VERSION)
+        return QUER_ERR_INVALID_ARG;
+    uint8_t *segments_mem = scratch;
+    uint8_t *modes = segments_mem + align_up(SEGMENTS_MEM_SIZE(QUER_MAX_INPUT_LEN));
+    // the segments depend only on the group of versions, not on the level
+    int n_bits[N_VERSION_GROUPS], min_version = (options->min_version > 0 ? options->min_version : QUER_MIN_VERSION);
+    for (int group = version_group(min_version); group <= version_group(max_version); group++)
+        n_bits[group] = plan_segments((const uint8_t *)data, data_len, group, options->kanji, segments_mem, modes) +
+                        header_bits(options, group);
+    // and the Micro QR versions, smaller than any QR version, come first at every level
+    int micro_n_bits[QUER_MAX_MICRO_VERSION + 1], micro = allows_micro(options, data_len);
+    for (int version = QUER_MIN_VERSION; micro && version <= QUER_MAX_MICRO_VERSION; version++)
+        micro_n_bits[version] = plan_segments((const uint8_t *)data, data_len, micro_version_group(version),
+                                              options->kanji, segments_mem, modes);
+    // then the rMQR versions, at the levels they have
+    int rmqr_n_bits[QUER_MAX_RMQR_VERSION + 1], rmqr = allows_rmqr(options, data_len);
+    for (int version = QUER_MIN_VERSION; rmqr && version <= QUER_MAX_RMQR_VERSION; version++) {
+        int group = rmqr_version_group(version);
+        rmqr_n_bits[version] = plan_segments((const uint8_t *)data, data_len, group, options->kanji, segments_mem,
+                                             modes) +
+                               header_bits(options, group);
+    }
+    for (int level = QUER_CORR_H; level >= QUER_CORR_L; level--) {
+        for (int version = QUER_MIN_VERSION; micro && version <= QUER_MAX_MICRO_VERSION; version++) {
+            if (micro_n_bits[version] <= MICRO_DATA_BITS[level][version]) {
+                make_plan(level, SYMBOL_MICRO, version, micro_n_bits[version], plan);
+                return QUER_OK;
+            }
+        }
+        int rmqr_level = symbol_corr_level(SYMBOL_RMQR, level);
+        for (int i = 0; rmqr && i < QUER_MAX_RMQR_VERSION; i++) {
+            int version = RMQR_BY_AREA[i];
+            if (rmqr_n_bits[version] <= RMQR_DATA_CODEWORDS[rmqr_level][version] * 8) {
+                make_plan(level, SYMBOL_RMQR, version, rmqr_n_bits[version], plan);
+                return QUER_OK;
+            }
+        }
+        for (int version = min_version; version <= max_version; version++) {
+            int group = version_group(version);
+            if (n_bits[group] <= TOTAL_DATA_CODEWORDS[level][version] * 8) {
+                make_plan(level, SYMBOL_QR, version, n_bits[group], plan);
+                return QUER_OK;
+            }
+        }
+    }
+    return QUER_ERR_TOO_LONG;
+}
+
+// splits data greedily into symbols holding the longest prefixes of the rest that take at most max_bits bits
+// (planned for the given group of versions), stores their starts and returns their number,
+// or QUER_MAX_APPEND_SYMBOLS + 1 if there would be more
+static int split_greedily(const uint8_t *data, int data_len, int group, int allow_kanji, int max_bits,
+                          size_t *starts) {
+    int n_symbols = 0;
+    for (int start = 0; start < data_len || n_symbols == 0; n_symbols++) {
+        int len = longest_prefix(data + start, data_len - start, group, allow_kanji, max_bits);
+        if (n_symbols == QUER_MAX_APPEND_SYMBOLS || (len == 0 && data_len > 0))
+            return QUER_MAX_APPEND_SYMBOLS + 1;
+        starts[n_symbols] = start;
+        start += len;
+    }
+    starts[n_symbols] = data_len;
+    return n_symbols;
+}
+
+// the number of symbols of the version needed by the data split greedily (with the Structured Append header
+// if append is set)
+static int count_symbols(const uint8_t *data, int data_len, const quer_options_t *options, int version, int append,
+                         size_t *starts) {
+    int group = version_group(version);
+    int max_bits = TOTAL_DATA_CODEWORDS[(int)options->corr_level][version] * 8 - eci_bits(options->eci, group) -
+                   (append ? APPEND_HEADER_BITS : 0);
+    return split_greedily(data, data_len, group, options->kanji, max_bits, starts);
+}
+
+// the smallest version in [min_version, max_version] that needs at most n_symbols symbols
+// (the number of symbols doesn't grow with the version), max_version must be one of them
+static int smallest_version(const uint8_t *data, int data_len, const quer_options_t *options, int min_version,
+                            int max_version, int n_symbols, int append, size_t *starts) {
+    while (min_version < max_version) {
+        int version = (min_version + max_version) / 2;
+        if (count_symbols(data, data_len, options, version, append, starts) <= n_symbols)
+            max_version = version;
+        else
+            min_version = version + 1;
+    }
+    return max_version;
+}
+
+int quer_split(const char *data, size_t data_len, const quer_options_t *options, int max_version, quer_split_t *split) {
+    if (options == NULL || split == NULL || (data == NULL && data_len > 0) || options->corr_level < QUER_CORR_L ||
+        options->corr_level > QUER_CORR_H || !valid_options(options) || max_version < QUER_MIN_VERSION ||
+        max_version > QUER_MAX_VERSION || max_version < options->min_version)
+        return QUER_ERR_INVALID_ARG;
+    if (data_len > QUER_MAX_APPEND_SYMBOLS * QUER_MAX_INPUT_LEN)
+        return QUER_ERR_TOO_LONG;
+    const uint8_t *bytes = (const uint8_t *)data;
+    int len = data_len, min_version = (options->min_version > 0 ? options->min_version : QUER_MIN_VERSION);
+    *split = (quer_split_t){.n_symbols = 1};
+    for (int i = 0; i < len; i++)
+        split->parity ^= bytes[i];
+
+    // a standalone code if the data fits in one
+    if (len <= QUER_MAX_INPUT_LEN && count_symbols(bytes, len, options, max_version, 0, split->starts) == 1) {
+        split->version = smallest_version(bytes, len, options, min_version, max_version, 1, 0, split->starts);
+        count_symbols(bytes, len, options, split->version, 0, split->starts);
+        return QUER_OK;
+    }
+    // the fewest symbols, then the smallest version that holds as many
+    int n_symbols = count_symbols(bytes, len, options, max_version, 1, split->starts);
+    if (n_symbols > QUER_MAX_APPEND_SYMBOLS)
+        return QUER_ERR_TOO_LONG;
+    int version = smallest_version(bytes, len, options, min_version, max_version, n_symbols, 1, split->starts);
+    // and the smallest bound on the bits of every symbol that still needs no more of them, which evens their sizes out
+    int group = version_group(version), lo = 0,
+        hi = TOTAL_DATA_CODEWORDS[(int)options->corr_level][version] * 8 - eci_bits(options->eci, group) -
+             APPEND_HEADER_BITS;
+    while (lo < hi) {
+        int max_bits = (lo + hi) / 2;
+        if (split_greedily(bytes, len, group, options->kanji, max_bits, split->starts) <= n_symbols)
+            hi = max_bits;
+        else
+            lo = max_bits + 1;
+    }
+    split->n_symbols = split_greedily(bytes, len, group, options->kanji, hi, split->starts);
+    split->version = version;
+    return QUER_OK;
+}
+
+int quer_verify(const quer_code_t *code, const char *data, size_t data_len, const quer_options_t *options) {
+    if (code == NULL || options == NULL || (data == NULL && data_len > 0))
+        return QUER_ERR_INVALID_ARG;
+    enum symbol_kind_t kind = (code->micro ? SYMBOL_MICRO : code->rmqr ? SYMBOL_RMQR : SYMBOL_QR);
+    if (data_len > QUER_MAX_INPUT_LEN || code->corr_level != symbol_corr_level(kind, options->corr_level))
+        return QUER_ERR_VERIFY;
+    int append = (options->append_total > 0 ? options->append_index << 12 | (options->append_total - 1) << 8 |
+                                                  options->append_parity
+                                            : -1);
+    int status = verify_code(code->modules, code->micro, code->rmqr, code->version, code->corr_level,
+                             (const uint8_t *)data, data_len, options->eci, append);
+    return status == 0 ? QUER_OK : QUER_ERR_VERIFY;
+}
+
+size_t quer_read_scratch_size(int width, int height) {
+    // the sampled code and the memory of the reader
+    if (width <= 0 || height <= 0)
+        return 0;
+    return align_up(sizeof(bitset_t)) + reader_scratch_size(width, height);
+}
+
+int quer_read(const quer_image_t *image, void *scratch, size_t scratch_size, char *data, size_t data_cap,
+              size_t *data_len, quer_code_t *code) {
+    if (image == NULL || image->pixels == NULL || image->width <= 0 || image->height <= 0 ||
+        image->stride < (size_t)image->width || data == NULL || data_len == NULL || data_cap < QUER_MAX_INPUT_LEN)
+        return QUER_ERR_INVALID_ARG;
+    if (scratch == NULL || scratch_size < quer_read_scratch_size(image->width, image->height))
+        return QUER_ERR_SCRATCH;
+
+    bitset_t *modules = scratch;
+    char *mem = (char *)scratch + align_up(sizeof(bitset_t));
+    decoded_info_t info;
+    int len = read_image(image, mem, (uint8_t *)data, QUER_MAX_INPUT_LEN, modules, &info);
+    if (len < 0)
+        return len;
+    *data_len = len;
+    if (code != NULL)
+        *code = (quer_code_t){.version = info.version,
+                              .width = modules->width,
+                              .height = modules->height,
+                              .mask = info.mask,
+                              .corr_level = info.corr_level,
+                              .modules = modules,
+                              .append_index = info.append_index,
+                              .append_total = info.append_total,
+                              .append_parity = info.append_parity};
+    return QUER_OK;
+}
+
+int quer_get_module(const quer_code_t *code, int r, int c) { return bitset_get(code->modules, r, c); }
+
+const char *quer_strerror(int status) {
+    switch (status) {
+        case QUER_OK:
+            return "success";
+        case QUER_ERR_TOO_LONG:
+            return "input is too long to be stored in a QR code with the specified error correction level";
+        case QUER_ERR_SCRATCH:
+            return "scratch memory is too small";
+        case QUER_ERR_INVALID_ARG:
+            return "invalid argument";
+        case QUER_ERR_VERIFY:
+            return "the encoded QR code doesn't decode back to the input";
+        case QUER_ERR_NOT_FOUND:
+            return "no QR code found in the image";
+        case QUER_ERR_UNREADABLE:
+            return "the QR code is too damaged to be read";
+        default:
+            return "unknown error";
+    }
+}
@@ -0,0 +1,209 @@
+#ifndef QUER_H
+#define QUER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define QUER_MIN_VERSION 1
+#define QUER_MAX_VERSION 40
+// Micro QR versions M1-M4 (see quer_options_t.micro)
+#define QUER_MAX_MICRO_VERSION 4
+// rMQR versions R7x43-R17x139, numbered from 1 (see quer_options_t.rmqr)
+#define QUER_MAX_RMQR_VERSION 32
+// the largest number of bytes that fit in a QR code (version 40, low error correction level, byte mode)
+#define QUER_MAX_CAPACITY 2953
+// the longest input that can fit in a QR code (digits, in numeric mode)
+#define QUER_MAX_INPUT_LEN 7089
+// the largest ECI assignment number
+#define QUER_MAX_ECI 999999
+// the most symbols a Structured Append can split the data into
+#define QUER_MAX_APPEND_SYMBOLS 16
+
+enum quer_corr_level_t {
+    QUER_CORR_L,
+    QUER_CORR_M,
+    QUER_CORR_Q,
+    QUER_CORR_H,
+};
+
+enum quer_status_t {
+    QUER_OK = 0,
+    // the data doesn't fit in a QR code with the requested error correction level
+    QUER_ERR_TOO_LONG = -1,
+    // the scratch memory is smaller than quer_scratch_size()
+    QUER_ERR_SCRATCH = -2,
+    QUER_ERR_INVALID_ARG = -3,
+    // the encoded code doesn't read back as the data (a bug, never expected to happen)
+    QUER_ERR_VERIFY = -4,
+    // quer_read found no finder patterns that could be the corners of a QR code
+    QUER_ERR_NOT_FOUND = -5,
+    // quer_read found a QR code, but couldn't decode it
+    QUER_ERR_UNREADABLE = -6,
+};
+
+// how the codewords of a version and error correction level are split into blocks:
+// n_blocks blocks of n_corr_codewords_per_block error correction codewords each,
+// the first n_small_blocks of them with small_block_len data codewords and the rest with one more
+typedef struct quer_blocks_t {
+    int n_data_codewords;
+    int n_blocks;
+    int n_small_blocks;
+    int small_block_len;
+    int n_corr_codewords_per_block;
+} quer_blocks_t;
+
+// what quer_encode did at each stage, filled in only when asked for (see quer_options_t.stats),
+// building with QUER_NO_STATS removes the counters altogether
+typedef struct quer_stats_t {
+    quer_blocks_t blocks;
+    // the penalty of every candidate mask (the lowest one is chosen), for Micro QR codes the scores of their 4 masks
+    // (the highest one is chosen) and zeros
+    int penalties[8];
+    // nanoseconds spent on planning and writing the segments, the error correction, placing the codewords
+    // (including building the function patterns of the version on its first use), choosing the mask
+    // and verifying the code (0 without quer_options_t.verify)
+    int64_t segments_ns;
+    int64_t rs_ns;
+    int64_t placement_ns;
+    int64_t masks_ns;
+    int64_t verify_ns;
+} quer_stats_t;
+
+typedef struct quer_options_t {
+    enum quer_corr_level_t corr_level;
+    // number of threads (up to 8, one per mask) evaluating the candidate masks, 0 or 1 means only the calling thread
+    // the chosen mask doesn't depend on it, but it pays off only for large versions
+    int n_threads;
+    // ECI assignment number announcing the character set of the data (e.g. 26 for UTF-8), 0 for none
+    int eci;
+    // 1 if the data is Shift JIS text, so that its double-byte characters can be stored in Kanji mode
+    int kanji;
+    // 1 to read every encoded code back (see quer_verify) before returning it
+    int verify;
+    // the smallest version to choose (0 for any), e.g. so that all the symbols of a Structured Append are as large
+    int min_version;
+    // 1 to choose a Micro QR code (M1-M4, 11x11 to 17x17 modules with a single finder pattern, which needs only
+    // a 2-module quiet zone) when the data fits in one, the smallest symbol that fits is chosen
+    // Micro QR codes have no level H (nor ECI and Structured Append, such data always gets a QR code) and M1 only
+    // detects errors, it's chosen only for level L
+    int micro;
+    // 1 to choose an rMQR code (rectangular Micro QR, R7x43 to R17x139, 7 to 17 modules high with a finder pattern
+    // in one corner and a smaller one in the opposite corner, which needs only a 2-module quiet zone) when the data
+    // fits in one, the rMQR version with the fewest modules that fits is chosen (after the Micro QR versions
+    // if micro is set too, which are all smaller)
+    // rMQR codes have only levels M and H, level L is raised to M and Q to H (see quer_code_t.corr_level), and no
+    // Structured Append (such data always gets a QR code)
+    int rmqr;
+    // Structured Append: the code is symbol append_index (from 0) of the append_total ones (up to
+    // QUER_MAX_APPEND_SYMBOLS) holding the data together, append_parity is the XOR of all the bytes of the whole data
+    // (see quer_split), append_total is 0 for a standalone code
+    int append_index;
+    int append_total;
+    int append_parity;
+    // if not NULL, quer_encode stores what it did there, at the cost of two clock reads per stage
+    quer_stats_t* stats;
+} quer_options_t;
+
+// the code quer_encode would make of some data, found without encoding it
+typedef struct quer_plan_t {
+    // M1-M4 if micro is set, 1-32 (R7x43-R17x139) if rmqr is set
+    int version;
+    int micro;
+    int rmqr;
+    // in modules, the same for all but the rMQR codes
+    int width;
+    int height;
+    enum quer_corr_level_t corr_level;
+    // bits taken by the segments (and the ECI header) out of the n_data_codewords * 8 bits of the version
+    int n_bits;
+    quer_blocks_t blocks;
+} quer_plan_t;
+
+// data split into the symbols of a Structured Append, symbol i holds bytes [starts[i], starts[i + 1]) of the data
+typedef struct quer_split_t {
+    int n_symbols;
+    // the version of all the symbols
+    int version;
+    int parity;
+    size_t starts[QUER_MAX_APPEND_SYMBOLS + 1];
+} quer_split_t;
+
+struct bitset_t;
+
+// an encoded QR code
+// the modules are stored in the scratch memory passed to quer_encode,
+// so the code is valid only as long as that memory isn't reused
+typedef struct quer_code_t {
+    // M1-M4 if micro is set, with one of 4 masks, 1-32 (R7x43-R17x139, named by their height and width)
+    // if rmqr is set, with a single mask (0)
+    int version;
+    int micro;
+    int rmqr;
+    // in modules, the same for all but the rMQR codes
+    int width;
+    int height;
+    int mask;
+    // the level of the code, which for rMQR codes may be higher than the one asked for
+    enum quer_corr_level_t corr_level;
+    struct bitset_t* modules;
+    // the Structured Append header, append_total is 0 for a standalone code
+    int append_index;
+    int append_total;
+    int append_parity;
+} quer_code_t;
+
+// an 8-bit grayscale image (0 is black), row y starts at pixels + y * stride
+typedef struct quer_image_t {
+    const uint8_t* pixels;
+    int width;
+    int height;
+    size_t stride;
+} quer_image_t;
+
+// size (in bytes) of the scratch memory needed by quer_encode
+size_t quer_scratch_size(void);
+// encode data_len bytes of data into a QR code matrix
+// the data is split into numeric, alphanumeric, byte (and Kanji) segments so that it takes as few bits as possible,
+// the version is the smallest one that fits them (a Micro QR one with options->micro, an rMQR one with options->rmqr)
+// doesn't allocate and the only global state it touches is the (thread-safe) cache of per-version data,
+// built on the first use of each version, so it can be called from many threads at once
+// (each with its own scratch memory)
+int quer_encode(const char* data, size_t data_len, const quer_options_t* options, void* scratch,
+                size_t scratch_size, quer_code_t* code);
+// size (in bytes) of the scratch memory needed by quer_plan and quer_plan_best_level (a scratch memory of
+// quer_scratch_size() bytes is large enough too)
+size_t quer_plan_scratch_size(void);
+// finds the version (and the block structure) quer_encode would choose for the data, without encoding it
+// the data is split into segments for every group of versions (like quer_encode does), which is all the work there is,
+// returns QUER_OK or QUER_ERR_TOO_LONG, doesn't allocate
+int quer_plan(const char* data, size_t data_len, const quer_options_t* options, void* scratch, size_t scratch_size,
+              quer_plan_t* plan);
+// like quer_plan, but finds the highest error correction level at which the data fits in a version of at most
+// max_version (options->corr_level is ignored), returns QUER_ERR_TOO_LONG if it doesn't fit even at the lowest level
+int quer_plan_best_level(const char* data, size_t data_len, const quer_options_t* options, int max_version,
+                         void* scratch, size_t scratch_size, quer_plan_t* plan);
+// splits the data into the fewest Structured Append symbols of at most max_version, and then balances their sizes,
+// so that all of them fit in the smallest version that allows it
+// symbol i is encoded by quer_encode with options->min_version = split->version, append_index = i,
+// append_total = split->n_symbols and append_parity = split->parity, a single symbol means that the data fits in
+// a standalone code (encoded without the Structured Append fields), doesn't allocate
+// returns QUER_OK or QUER_ERR_TOO_LONG if the data doesn't fit in QUER_MAX_APPEND_SYMBOLS symbols
+int quer_split(const char* data, size_t data_len, const quer_options_t* options, int max_version, quer_split_t* split);
+// reads the code back like a scanner (format info, unmasking, Reed-Solomon syndromes, segments) and checks that it
+// holds exactly the data encoded with the given options, returns QUER_OK or QUER_ERR_VERIFY
+// doesn't allocate and costs a fraction of quer_encode
+int quer_verify(const quer_code_t* code, const char* data, size_t data_len, const quer_options_t* options);
+// size (in bytes) of the scratch memory needed by quer_read for an image of the given dimensions
+size_t quer_read_scratch_size(int width, int height);
+// finds a QR code (not a Micro QR or rMQR one) in the image and decodes it into data (of data_cap >=
+// QUER_MAX_INPUT_LEN bytes), storing its length in *data_len, Kanji characters are returned as Shift JIS and
+// the errors are fixed by Reed-Solomon decoding
+// code (if not NULL) gets the version, level and mask of the code and the sampled modules (valid while the scratch
+// memory isn't reused), doesn't allocate
+int quer_read(const quer_image_t* image, void* scratch, size_t scratch_size, char* data, size_t data_cap,
+              size_t* data_len, quer_code_t* code);
+// returns 1 if the module in row r and column c is dark, 0 otherwise
+int quer_get_module(const quer_code_t* code, int r, int c);
+const char* quer_strerror(int status);
+
+#endif  // QUER_H
@@ -0,0 +1,63 @@
+#include "raster.h"
+
+// fills pixels [start, start + len) of the row with the given bit
+static void fill_pixels(uint8_t* row, int start, int len, int bit) {
+    if (len <= 0)
+        return;
+    int end = start + len;
+    int first_byte = start / 8, last_byte = (end - 1) / 8;
+    uint8_t first_mask = 0xFF >> (start % 8);
+    uint8_t last_mask = 0xFF << (7 - (end - 1) % 8);
+    if (first_byte == last_byte) {
+        first_mask &= last_mask;
+        row[first_byte] = bit ? row[first_byte] | first_mask : row[first_byte] & ~first_mask;
+        return;
+    }
+    row[first_byte] = bit ? row[first_byte] | first_mask : row[first_byte] & ~first_mask;
+    memset(row + first_byte + 1, bit ? 0xFF : 0x00, last_byte - first_byte - 1);
+    row[last_byte] = bit ? row[last_byte] | last_mask : row[last_byte] & ~last_mask;
+}
+
+int raster_init(raster_t* raster, const bitset_t* code, int ppm, int padding, int dark_bit) {
+    int64_t width = ((int64_t)code->width + 2 * padding) * ppm;
+    int64_t height = ((int64_t)code->height + 2 * padding) * ppm;
+    if (ppm <= 0 || width > RASTER_MAX_DIM || height > RASTER_MAX_DIM)
+        return -1;
+    raster->code = code;
+    raster->width = width;
+    raster->height = height;
+    raster->row_bytes = (width + 7) / 8;
+    raster->ppm = ppm;
+    raster->padding = padding;
+    raster->dark_bit = dark_bit;
+    return 0;
+}
+
+int raster_module_row(const raster_t* raster, int y) {
+    int module_row = y / raster->ppm - raster->padding;
+    return module_row < 0 || module_row >= raster->code->height ? -1 : module_row;
+}
+
+void raster_render(const raster_t* raster, int module_row, size_t start, size_t len, uint8_t* out) {
+    memset(out, raster->dark_bit ? 0x00 : 0xFF, len);
+    if (module_row < 0)
+        return;
+    int64_t first_pixel = (int64_t)start * 8, end_pixel = first_pixel + (int64_t)len * 8;
+    int64_t first_module = first_pixel / raster->ppm - raster->padding;
+    if (first_module >= raster->code->width)
+        return;
+    // dark runs of modules become runs of dark pixels, clipped to the rendered part of the row
+    int x = first_module < 0 ? 0 : first_module, run_end;
+    while ((x = bitset_next_run(raster->code, module_row, x, &run_end)) != -1) {
+        int64_t run_start_pixel = ((int64_t)raster->padding + x) * raster->ppm;
+        int64_t run_end_pixel = ((int64_t)raster->padding + run_end) * raster->ppm;
+        if (run_start_pixel >= end_pixel)
+            break;
+        if (run_start_pixel < first_pixel)
+            run_start_pixel = first_pixel;
+        if (run_end_pixel > end_pixel)
+            run_end_pixel = end_pixel;
+        fill_pixels(out, run_start_pixel - first_pixel, run_end_pixel - run_start_pixel, raster->dark_bit);
+        x = run_end;
+    }
+}
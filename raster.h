@@ -0,0 +1,40 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <stdint.h>
+
+#include "bitset.h"
+
+// the largest width/height of an image, the limit of PNG
+#define RASTER_MAX_DIM INT32_MAX
+// the writers render the rows in pieces of at most this many bytes, so that their memory doesn't depend on ppm
+#define RASTER_CHUNK_BYTES (1 << 14)
+
+// an image of a code, ppm x ppm pixels per module, surrounded by padding modules of quiet zone,
+// rendered on demand as packed 1-bit rows (the leftmost pixel in the most significant bit, like in PNG and PBM)
+// nothing but the parameters is stored, every module row gives ppm identical pixel rows
+typedef struct raster_t {
+    const bitset_t* code;
+    int width;
+    int height;
+    int row_bytes;
+    int ppm;
+    int padding;
+    int dark_bit;
+} raster_t;
+
+// dark pixels are rendered as dark_bit (1 for PBM, 0 for grayscale PNG)
+// returns -1 if the image would be larger than RASTER_MAX_DIM x RASTER_MAX_DIM
+int raster_init(raster_t* raster, const bitset_t* code, int ppm, int padding, int dark_bit);
+// the module row shown in pixel row y, -1 for the quiet zone (pixel rows with equal module rows are identical)
+int raster_module_row(const raster_t* raster, int y);
+// renders bytes [start, start + len) of a pixel row of the given module row, len <= RASTER_CHUNK_BYTES
+void raster_render(const raster_t* raster, int module_row, size_t start, size_t len, uint8_t* out);
+
+// the length of the chunk of a row starting at byte start
+static inline size_t raster_chunk_len(const raster_t* raster, size_t start) {
+    size_t left = raster->row_bytes - start;
+    return left < RASTER_CHUNK_BYTES ? left : RASTER_CHUNK_BYTES;
+}
+
+#endif  // RASTER_H
@@ -0,0 +1,676 @@
+#include "reader.h"
+
+#include <math.h>
+
+#include "tables.h"
+#include "templates.h"
+
+#define SCRATCH_ALIGN 16
+#define MAX_DIM (4 * QUER_MAX_VERSION + 17)
+#define BLOCK_SIZE 8
+// blocks with a smaller range of values are flat (all light, or as dark as their neighbours)
+#define MIN_DYNAMIC_RANGE 24
+#define MAX_FINDERS 64
+// only the finders seen most often are tried as the corners of a code
+#define MAX_CORNER_CANDIDATES 10
+// the triples of finders that are tried, and the largest score (see select_corners) of a triple
+#define MAX_CODE_CANDIDATES 3
+#define MAX_CORNERS_SCORE 0.5
+// in modules, from where the finders alone put the bottom right alignment pattern
+#define MAX_ALIGNMENT_DISTANCE 16
+
+typedef struct point_t {
+    double x;
+    double y;
+} point_t;
+
+typedef struct finder_t {
+    point_t center;
+    double module;
+    // number of scanned rows that found it
+    int count;
+} finder_t;
+
+// the centers of the finder patterns of a code
+typedef struct corners_t {
+    point_t top_left;
+    point_t top_right;
+    point_t bottom_left;
+    // the size of a module along the rows and columns of the image (more than a module if the code is rotated)
+    double module;
+} corners_t;
+
+// maps module coordinates (u, v) to pixel coordinates: x = (m[0] u + m[1] v + m[2]) / (m[6] u + m[7] v + 1),
+// y = (m[3] u + m[4] v + m[5]) / (m[6] u + m[7] v + 1)
+typedef struct transform_t {
+    double m[8];
+} transform_t;
+
+typedef struct reader_t {
+    const quer_image_t* image;
+    // 1 for dark pixels
+    bitset_t bitmap;
+    // per block of BLOCK_SIZE x BLOCK_SIZE pixels
+    uint8_t* averages;
+    uint8_t* thresholds;
+    int* runs;
+    finder_t finders[MAX_FINDERS];
+    int n_finders;
+} reader_t;
+
+static size_t align_up(size_t n) { return (n + SCRATCH_ALIGN - 1) / SCRATCH_ALIGN * SCRATCH_ALIGN; }
+
+static size_t n_blocks(int width, int height) {
+    return (size_t)((width + BLOCK_SIZE - 1) / BLOCK_SIZE) * ((height + BLOCK_SIZE - 1) / BLOCK_SIZE);
+}
+
+size_t reader_scratch_size(int width, int height) {
+    // the bitmap, the block averages and thresholds, the runs of a row and the sampled code
+    return align_up(bitset_size(width, height)) + 2 * align_up(n_blocks(width, height)) +
+           align_up((size_t)(width + 2) * sizeof(int)) + align_up(bitset_size(MAX_DIM, MAX_DIM));
+}
+
+static double distance(point_t a, point_t b) { return hypot(a.x - b.x, a.y - b.y); }
+
+// the 8 pixels starting at p, the first one in the lowest byte
+static uint64_t load_pixels(const uint8_t* p) {
+    uint64_t pixels;
+    memcpy(&pixels, p, sizeof(pixels));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    pixels = __builtin_bswap64(pixels);
+#endif
+    return pixels;
+}
+
+// bit i is set if byte i of pixels is at most threshold, compares all 8 bytes at once
+static uint64_t pack_dark(uint64_t pixels, uint8_t threshold) {
+    uint64_t high = 0x8080808080808080, thresholds = 0x0101010101010101 * (uint64_t)threshold;
+    // the high bit of a byte is set if the low 7 bits of the pixel are at most those of the threshold
+    // (the subtraction never borrows across bytes)
+    uint64_t low_le = (thresholds | high) - (pixels & ~high);
+    uint64_t le = ((~pixels & thresholds) | (~(pixels ^ thresholds) & low_le)) & high;
+    // gathers the high bits of the bytes into the lowest byte
+    return (le * 0x0002040810204081) >> 56;
+}
+
+// a pixel is dark if it's not lighter than the mean of the block averages in the 5x5 blocks around its block
+// (a light background is assumed for flat blocks, unless their neighbours are darker)
+static void binarize(reader_t* reader) {
+    const quer_image_t* image = reader->image;
+    int width = image->width, height = image->height;
+    int blocks_x = (width + BLOCK_SIZE - 1) / BLOCK_SIZE, blocks_y = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    for (int by = 0; by < blocks_y; by++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            int min = 255, max = 0, sum = 0, n = 0;
+            for (int y = by * BLOCK_SIZE; y < (by + 1) * BLOCK_SIZE && y < height; y++) {
+                const uint8_t* row = image->pixels + y * image->stride;
+                for (int x = bx * BLOCK_SIZE; x < (bx + 1) * BLOCK_SIZE && x < width; x++, n++) {
+                    sum += row[x];
+                    min = row[x] < min ? row[x] : min;
+                    max = row[x] > max ? row[x] : max;
+                }
+            }
+            int average = sum / n;
+            if (max - min <= MIN_DYNAMIC_RANGE) {
+                average = min / 2;
+                if (by > 0 && bx > 0) {
+                    int neighbours = (reader->averages[(by - 1) * blocks_x + bx] +
+                                      2 * reader->averages[by * blocks_x + bx - 1] +
+                                      reader->averages[(by - 1) * blocks_x + bx - 1]) /
+                                     4;
+                    if (min < neighbours)
+                        average = neighbours;
+                }
+            }
+            reader->averages[by * blocks_x + bx] = average;
+        }
+    }
+    for (int by = 0; by < blocks_y; by++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            int sum = 0, n = 0;
+            for (int y = by - 2 < 0 ? 0 : by - 2; y <= by + 2 && y < blocks_y; y++) {
+                for (int x = bx - 2 < 0 ? 0 : bx - 2; x <= bx + 2 && x < blocks_x; x++, n++)
+                    sum += reader->averages[y * blocks_x + x];
+            }
+            reader->thresholds[by * blocks_x + bx] = sum / n;
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = image->pixels + y * image->stride;
+        const uint8_t* thresholds = reader->thresholds + (y / BLOCK_SIZE) * blocks_x;
+        uint64_t* bits = bitset_row(&reader->bitmap, y);
+        // a block never straddles two words of the bitmap
+        for (int bx = 0; bx < blocks_x; bx++) {
+            int x = bx * BLOCK_SIZE;
+            uint64_t block_bits = 0;
+            if (x + BLOCK_SIZE <= width) {
+                block_bits = pack_dark(load_pixels(row + x), thresholds[bx]);
+            } else {
+                for (int i = 0; x + i < width; i++)
+                    block_bits |= (uint64_t)(row[x + i] <= thresholds[bx]) << i;
+            }
+            bits[x / WORD_BITS] |= block_bits << (x % WORD_BITS);
+        }
+    }
+}
+
+static int is_dark(const reader_t* reader, int x, int y) { return bitset_get(&reader->bitmap, y, x); }
+
+static int is_inside(const reader_t* reader, int x, int y) {
+    return x >= 0 && y >= 0 && x < reader->image->width && y < reader->image->height;
+}
+
+// splits row y of the bitmap into runs of the same color, returns the number of runs
+// the runs at even indices are light (the first one is empty if the row starts with a dark pixel)
+static int get_runs(const reader_t* reader, int y, int* runs) {
+    const uint64_t* row = bitset_const_row(&reader->bitmap, y);
+    int width = reader->image->width, n_runs = 0, run_start = 0;
+    for (int i = 0; i * WORD_BITS < width; i++) {
+        // bit x is set if pixel x differs from pixel x - 1 (the one before the row is light)
+        uint64_t carry = (i == 0 ? 0 : row[i - 1] >> 63);
+        uint64_t transitions = row[i] ^ ((row[i] << 1) | carry);
+        if (width - i * WORD_BITS < WORD_BITS)
+            transitions &= ((uint64_t)1 << (width - i * WORD_BITS)) - 1;
+        while (transitions != 0) {
+            int x = i * WORD_BITS + __builtin_ctzll(transitions);
+            runs[n_runs++] = x - run_start;
+            run_start = x;
+            transitions &= transitions - 1;
+        }
+    }
+    runs[n_runs++] = width - run_start;
+    return n_runs;
+}
+
+// 1:1:3:1:1 with each module within half a module of its size (total / 7)
+static int is_finder_ratio(const int counts[5]) {
+    int total = counts[0] + counts[1] + counts[2] + counts[3] + counts[4];
+    if (total < 7)
+        return 0;
+    return abs(14 * counts[0] - 2 * total) < total && abs(14 * counts[1] - 2 * total) < total &&
+           abs(14 * counts[2] - 6 * total) < 3 * total && abs(14 * counts[3] - 2 * total) < total &&
+           abs(14 * counts[4] - 2 * total) < total;
+}
+
+// measures the 1:1:3:1:1 pattern through (x, y) along the direction (dx, dy), from its center outwards
+// returns the coordinate of its center along the direction (x + t * dx, y + t * dy for some t), or -1 if there's
+// no such pattern or its size is far from original_total, stores its size in *total
+static double cross_check_finder(const reader_t* reader, int x, int y, int dx, int dy, int max_count,
+                                 int original_total, int* total) {
+    int counts[5] = {0};
+    int i = 0;
+    while (is_inside(reader, x - i * dx, y - i * dy) && is_dark(reader, x - i * dx, y - i * dy)) {
+        counts[2]++;
+        i++;
+    }
+    for (int k = 1; k >= 0; k--) {
+        int dark = (k == 0);
+        while (is_inside(reader, x - i * dx, y - i * dy) && is_dark(reader, x - i * dx, y - i * dy) == dark &&
+               counts[k] <= max_count) {
+            counts[k]++;
+            i++;
+        }
+        if (counts[k] == 0 || counts[k] > max_count)
+            return -1;
+    }
+    i = 1;
+    while (is_inside(reader, x + i * dx, y + i * dy) && is_dark(reader, x + i * dx, y + i * dy)) {
+        counts[2]++;
+        i++;
+    }
+    for (int k = 3; k <= 4; k++) {
+        int dark = (k == 4);
+        while (is_inside(reader, x + i * dx, y + i * dy) && is_dark(reader, x + i * dx, y + i * dy) == dark &&
+               counts[k] <= max_count) {
+            counts[k]++;
+            i++;
+        }
+        if (counts[k] == 0 || counts[k] > max_count)
+            return -1;
+    }
+    *total = counts[0] + counts[1] + counts[2] + counts[3] + counts[4];
+    if (5 * abs(*total - original_total) >= 2 * original_total || !is_finder_ratio(counts))
+        return -1;
+    int end = (dx != 0 ? x : y) + i;
+    return end - counts[4] - counts[3] - counts[2] / 2.0;
+}
+
+// merges the finder with one found before (on another row) or adds a new one, found in row y
+static void add_finder(reader_t* reader, point_t center, double module, int y) {
+    for (int i = 0; i < reader->n_finders; i++) {
+        finder_t* finder = &reader->finders[i];
+        double module_diff = fabs(module - finder->module);
+        if (fabs(center.x - finder->center.x) <= finder->module &&
+            fabs(center.y - finder->center.y) <= finder->module &&
+            (module_diff <= 1 || module_diff <= finder->module)) {
+            int count = finder->count;
+            finder->center.x = (count * finder->center.x + center.x) / (count + 1);
+            finder->center.y = (count * finder->center.y + center.y) / (count + 1);
+            finder->module = (count * finder->module + module) / (count + 1);
+            finder->count++;
+            return;
+        }
+    }
+    finder_t finder = {.center = center, .module = module, .count = 1};
+    if (reader->n_finders < MAX_FINDERS) {
+        reader->finders[reader->n_finders++] = finder;
+        return;
+    }
+    // noise can fill the table, but a finder seen only once and already passed by the scan is noise too
+    for (int i = 0; i < reader->n_finders; i++) {
+        const finder_t* old = &reader->finders[i];
+        if (old->count == 1 && old->center.y + 3.5 * old->module < y) {
+            reader->finders[i] = finder;
+            return;
+        }
+    }
+}
+
+// confirms a finder pattern seen in a row by crossing it vertically, then crosses its center horizontally again
+// (which only refines the center, as the row has already been checked)
+static void check_finder(reader_t* reader, const int counts[5], double center_x, int y) {
+    int total = counts[0] + counts[1] + counts[2] + counts[3] + counts[4], vertical_total, horizontal_total;
+    double center_y = cross_check_finder(reader, (int)center_x, y, 0, 1, counts[2], total, &vertical_total);
+    if (center_y < 0)
+        return;
+    double refined_x =
+        cross_check_finder(reader, (int)center_x, (int)center_y, 1, 0, counts[2], total, &horizontal_total);
+    if (refined_x < 0)
+        horizontal_total = total;
+    else
+        center_x = refined_x;
+    add_finder(reader, (point_t){center_x, center_y}, (vertical_total + horizontal_total) / 14.0, y);
+}
+
+static void find_finders(reader_t* reader) {
+    int height = reader->image->height;
+    // a row every few pixels is enough even for a version 40 code that fills the whole image
+    int row_step = 3 * height / (4 * MAX_DIM);
+    if (row_step < 1)
+        row_step = 1;
+    reader->n_finders = 0;
+    for (int y = row_step - 1; y < height; y += row_step) {
+        int n_runs = get_runs(reader, y, reader->runs);
+        int start = reader->runs[0];
+        // the dark runs are at odd indices, start is where run k begins
+        for (int k = 1; k + 4 < n_runs; k += 2) {
+            if (is_finder_ratio(reader->runs + k)) {
+                int end = start + reader->runs[k] + reader->runs[k + 1] + reader->runs[k + 2] + reader->runs[k + 3] +
+                          reader->runs[k + 4];
+                const int* counts = reader->runs + k;
+                check_finder(reader, counts, end - counts[4] - counts[3] - counts[2] / 2.0, y);
+            }
+            start += reader->runs[k] + reader->runs[k + 1];
+        }
+    }
+}
+
+// picks (up to MAX_CODE_CANDIDATES) triples of finders that look most like the corners of a code: similar sizes,
+// two equal sides at a right angle, best first, returns their number
+static int select_corners(const reader_t* reader, corners_t* candidates) {
+    // the finders seen most often go first, then the larger ones (noise makes small ones)
+    int order[MAX_FINDERS];
+    for (int i = 0; i < reader->n_finders; i++) {
+        const finder_t* finder = &reader->finders[i];
+        int j = i;
+        for (; j > 0 && (reader->finders[order[j - 1]].count < finder->count ||
+                         (reader->finders[order[j - 1]].count == finder->count &&
+                          reader->finders[order[j - 1]].module < finder->module));
+             j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+    int n = reader->n_finders < MAX_CORNER_CANDIDATES ? reader->n_finders : MAX_CORNER_CANDIDATES;
+    // the finders crossed by a single row are mostly noise, unless they're all there is
+    int n_confirmed = 0;
+    while (n_confirmed < n && reader->finders[order[n_confirmed]].count >= 2)
+        n_confirmed++;
+    if (n_confirmed >= 3)
+        n = n_confirmed;
+    double scores[MAX_CODE_CANDIDATES];
+    int n_candidates = 0;
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j < n; j++) {
+            for (int k = j + 1; k < n; k++) {
+                const finder_t* f[3] = {&reader->finders[order[i]], &reader->finders[order[j]],
+                                        &reader->finders[order[k]]};
+                double min_module = fmin(f[0]->module, fmin(f[1]->module, f[2]->module));
+                double max_module = fmax(f[0]->module, fmax(f[1]->module, f[2]->module));
+                if (max_module > 1.5 * min_module)
+                    continue;
+                // the corner is opposite the longest side
+                int corner = 0;
+                double sides[3];
+                for (int c = 0; c < 3; c++)
+                    sides[c] = distance(f[(c + 1) % 3]->center, f[(c + 2) % 3]->center);
+                for (int c = 1; c < 3; c++)
+                    corner = sides[c] > sides[corner] ? c : corner;
+                double a = sides[(corner + 1) % 3], b = sides[(corner + 2) % 3], c = sides[corner];
+                if (fmin(a, b) < 10 * max_module)
+                    continue;
+                double score = fabs(a - b) / fmax(a, b) + fabs(c * c - a * a - b * b) / (c * c);
+                if (score >= MAX_CORNERS_SCORE ||
+                    (n_candidates == MAX_CODE_CANDIDATES && score >= scores[n_candidates - 1]))
+                    continue;
+                point_t p = f[corner]->center, q = f[(corner + 1) % 3]->center, r = f[(corner + 2) % 3]->center;
+                // with the y axis pointing down, top right -> top left -> bottom left turns clockwise
+                if ((q.x - p.x) * (r.y - p.y) - (q.y - p.y) * (r.x - p.x) < 0) {
+                    point_t tmp = q;
+                    q = r;
+                    r = tmp;
+                }
+                int pos = n_candidates < MAX_CODE_CANDIDATES ? n_candidates++ : n_candidates - 1;
+                for (; pos > 0 && scores[pos - 1] > score; pos--) {
+                    scores[pos] = scores[pos - 1];
+                    candidates[pos] = candidates[pos - 1];
+                }
+                scores[pos] = score;
+                candidates[pos] = (corners_t){.top_left = p,
+                                              .top_right = q,
+                                              .bottom_left = r,
+                                              .module = (f[0]->module + f[1]->module + f[2]->module) / 3};
+            }
+        }
+    }
+    return n_candidates;
+}
+
+// pixels from the center of the finder at from, towards to, up to the light module past its outer dark ring
+// (3.5 modules of the finder, at whatever angle the code is rotated by), -1 if the image ends first
+static double finder_radius(const reader_t* reader, point_t from, point_t to) {
+    double length = distance(from, to), dx = (to.x - from.x) / length, dy = (to.y - from.y) / length;
+    // dark center, light ring, dark ring
+    int color = 1, n_transitions = 0;
+    for (int i = 0; i < length; i++) {
+        int x = (int)(from.x + i * dx), y = (int)(from.y + i * dy);
+        if (!is_inside(reader, x, y))
+            return -1;
+        if (is_dark(reader, x, y) != color) {
+            color ^= 1;
+            if (++n_transitions == 3)
+                return i;
+        }
+    }
+    return -1;
+}
+
+// the size of a module along the line between two finders, the runs crossed by the scanner are too long
+// in a rotated code
+static double module_between(const reader_t* reader, point_t a, point_t b) {
+    point_t away_a = {2 * a.x - b.x, 2 * a.y - b.y}, away_b = {2 * b.x - a.x, 2 * b.y - a.y};
+    double radii[4] = {finder_radius(reader, a, b), finder_radius(reader, a, away_a), finder_radius(reader, b, a),
+                       finder_radius(reader, b, away_b)};
+    double sum = 0;
+    int n = 0;
+    for (int i = 0; i < 4; i++) {
+        if (radii[i] > 0) {
+            sum += radii[i];
+            n++;
+        }
+    }
+    return n == 0 ? -1 : sum / (3.5 * n);
+}
+
+// solves for the transform that maps the 4 module coordinates in src to the pixel coordinates in dst
+static int solve_transform(const point_t src[4], const point_t dst[4], transform_t* transform) {
+    double a[8][9];
+    for (int i = 0; i < 4; i++) {
+        double u = src[i].x, v = src[i].y, x = dst[i].x, y = dst[i].y;
+        double row_x[9] = {u, v, 1, 0, 0, 0, -u * x, -v * x, x};
+        double row_y[9] = {0, 0, 0, u, v, 1, -u * y, -v * y, y};
+        memcpy(a[2 * i], row_x, sizeof(row_x));
+        memcpy(a[2 * i + 1], row_y, sizeof(row_y));
+    }
+    // Gaussian elimination with partial pivoting
+    for (int col = 0; col < 8; col++) {
+        int pivot = col;
+        for (int row = col + 1; row < 8; row++)
+            pivot = fabs(a[row][col]) > fabs(a[pivot][col]) ? row : pivot;
+        if (fabs(a[pivot][col]) < 1e-12)
+            return -1;
+        for (int k = 0; k < 9; k++) {
+            double tmp = a[col][k];
+            a[col][k] = a[pivot][k];
+            a[pivot][k] = tmp;
+        }
+        for (int row = 0; row < 8; row++) {
+            if (row == col)
+                continue;
+            double factor = a[row][col] / a[col][col];
+            for (int k = col; k < 9; k++)
+                a[row][k] -= factor * a[col][k];
+        }
+    }
+    for (int i = 0; i < 8; i++)
+        transform->m[i] = a[i][8] / a[i][i];
+    return 0;
+}
+
+static point_t apply_transform(const transform_t* transform, double u, double v) {
+    const double* m = transform->m;
+    double w = m[6] * u + m[7] * v + 1;
+    return (point_t){(m[0] * u + m[1] * v + m[2]) / w, (m[3] * u + m[4] * v + m[5]) / w};
+}
+
+// light, dark, light runs of about one module each
+static int is_alignment_ratio(const int counts[3], double module) {
+    return fabs(module - counts[0]) < module / 2 && fabs(module - counts[1]) < module / 2 &&
+           fabs(module - counts[2]) < module / 2;
+}
+
+// measures the alignment pattern through (x, y) along the direction (dx, dy): its dark center, the light ring
+// and (at least half a module of) the dark ring on both sides, returns the coordinate of its center along the
+// direction, or -1 if there's no such pattern
+static double cross_check_alignment(const reader_t* reader, int x, int y, int dx, int dy, double module) {
+    // the dark ring, the light ring, the center, the light ring, the dark ring
+    int counts[5] = {0}, max_count = (int)(2 * module) + 1, min_ring = (int)(module / 2) + 1;
+    int i = 0;
+    for (int k = 2; k >= 0; k--) {
+        int dark = (k != 1), max = (k == 0 ? min_ring : max_count);
+        while (is_inside(reader, x - i * dx, y - i * dy) && is_dark(reader, x - i * dx, y - i * dy) == dark &&
+               counts[k] < max) {
+            counts[k]++;
+            i++;
+        }
+    }
+    i = 1;
+    for (int k = 2; k <= 4; k++) {
+        int dark = (k != 3), max = (k == 4 ? min_ring : max_count);
+        while (is_inside(reader, x + i * dx, y + i * dy) && is_dark(reader, x + i * dx, y + i * dy) == dark &&
+               counts[k] < max) {
+            counts[k]++;
+            i++;
+        }
+    }
+    if (counts[0] < min_ring || counts[4] < min_ring || !is_alignment_ratio(counts + 1, module))
+        return -1;
+    int end = (dx != 0 ? x : y) + i - counts[4];
+    return end - counts[3] - counts[2] / 2.0;
+}
+
+// 1 if the module in row r and column c is dark (the modules outside of the image are light)
+static int sample_module(const reader_t* reader, const transform_t* transform, int r, int c) {
+    point_t p = apply_transform(transform, c + 0.5, r + 0.5);
+    int x = (int)floor(p.x), y = (int)floor(p.y);
+    return is_inside(reader, x, y) && is_dark(reader, x, y);
+}
+
+// number of the modules of the timing and alignment patterns that the transform maps to pixels of the right color
+static int count_pattern_matches(const reader_t* reader, const transform_t* transform, int version) {
+    int dim = 4 * version + 17, n_matches = 0;
+    for (int i = 8; i < dim - 8; i++) {
+        n_matches += sample_module(reader, transform, 6, i) == (i % 2 == 0);
+        n_matches += sample_module(reader, transform, i, 6) == (i % 2 == 0);
+    }
+    int positions[7];
+    int n_positions = get_alignment_pattern_positions(version, positions);
+    for (int i = 0; i < n_positions; i++) {
+        for (int j = 0; j < n_positions; j++) {
+            // the ones that would overlap the finders aren't there
+            if ((i == 0 && j == 0) || (i == 0 && j == n_positions - 1) || (i == n_positions - 1 && j == 0))
+                continue;
+            for (int dr = -2; dr <= 2; dr++) {
+                for (int dc = -2; dc <= 2; dc++) {
+                    int dark = (abs(dr) != 1 || abs(dc) > 1) && (abs(dc) != 1 || abs(dr) > 1);
+                    n_matches += sample_module(reader, transform, positions[i] + dr, positions[j] + dc) == dark;
+                }
+            }
+        }
+    }
+    return n_matches;
+}
+
+// looks for the bottom right alignment pattern within radius modules of the estimate and solves for the transform
+// with it, among the patterns found (the data modules can look like one too) the transform that fits the timing
+// and alignment patterns best wins, returns -1 if there's none
+static int find_alignment(reader_t* reader, point_t estimate, double module, int radius, int version,
+                          const point_t src[4], point_t dst[4], transform_t* transform) {
+    int min_x = (int)fmax(0, estimate.x - radius * module), max_x = (int)fmin(reader->image->width - 1,
+                                                                              estimate.x + radius * module);
+    int min_y = (int)fmax(0, estimate.y - radius * module), max_y = (int)fmin(reader->image->height - 1,
+                                                                              estimate.y + radius * module);
+    int best_matches = -1;
+    for (int y = min_y; y <= max_y; y++) {
+        int n_runs = get_runs(reader, y, reader->runs);
+        int start = 0;
+        // a dark run between two light ones, with dark runs around them
+        for (int k = 0; k + 3 < n_runs && start <= max_x; k++) {
+            if (k % 2 == 0 && k > 0 && start + reader->runs[k] >= min_x &&
+                is_alignment_ratio(reader->runs + k, module)) {
+                int x = start + reader->runs[k] + reader->runs[k + 1] / 2;
+                double center_y = cross_check_alignment(reader, x, y, 0, 1, module);
+                double center_x = center_y < 0 ? -1 : cross_check_alignment(reader, x, (int)center_y, 1, 0, module);
+                transform_t candidate;
+                dst[3] = (point_t){center_x, center_y};
+                if (center_x >= 0 && solve_transform(src, dst, &candidate) == 0) {
+                    int n_matches = count_pattern_matches(reader, &candidate, version);
+                    if (n_matches > best_matches) {
+                        best_matches = n_matches;
+                        *transform = candidate;
+                    }
+                }
+            }
+            start += reader->runs[k];
+        }
+    }
+    return best_matches < 0 ? -1 : 0;
+}
+
+// maps the centers of the finders and of the bottom right alignment pattern (or, without it, the corner that makes
+// a parallelogram with them) to the image
+static int get_transform(reader_t* reader, const corners_t* corners, int version, int use_alignment,
+                         transform_t* transform) {
+    int dim = 4 * version + 17;
+    point_t top_left = corners->top_left, top_right = corners->top_right, bottom_left = corners->bottom_left;
+    point_t src[4] = {{3.5, 3.5}, {dim - 3.5, 3.5}, {3.5, dim - 3.5}, {dim - 3.5, dim - 3.5}};
+    point_t dst[4] = {top_left, top_right, bottom_left,
+                      {top_right.x + bottom_left.x - top_left.x, top_right.y + bottom_left.y - top_left.y}};
+    int positions[7];
+    int n_positions = get_alignment_pattern_positions(version, positions);
+    if (!use_alignment)
+        return solve_transform(src, dst, transform);
+    if (n_positions == 0)
+        return -1;
+    // the affine estimate from the finders is off by a few modules under perspective
+    double pos = positions[n_positions - 1] + 0.5, t = (pos - 3.5) / (dim - 7);
+    point_t estimate = {top_left.x + t * (top_right.x - top_left.x) + t * (bottom_left.x - top_left.x),
+                        top_left.y + t * (top_right.y - top_left.y) + t * (bottom_left.y - top_left.y)};
+    src[3] = (point_t){pos, pos};
+    return find_alignment(reader, estimate, corners->module, MAX_ALIGNMENT_DISTANCE, version, src, dst, transform);
+}
+
+static void sample_grid(const reader_t* reader, const transform_t* transform, bitset_t* code) {
+    int dim = code->width;
+    for (int r = 0; r < dim; r++) {
+        for (int c = 0; c < dim; c++) {
+            if (sample_module(reader, transform, r, c))
+                bitset_set(code, r, c);
+        }
+    }
+}
+
+// samples the code as the given version (refined by the alignment pattern, then without it) and decodes it
+// stores the version read from the version info if it's a different one (-1 otherwise)
+static int read_as_version(reader_t* reader, const corners_t* corners, int version, void* code_mem, bitset_t* code,
+                        uint8_t* out, int out_cap, decoded_info_t* info, int* other_version) {
+    int dim = 4 * version + 17;
+    *other_version = -1;
+    for (int use_alignment = 1; use_alignment >= 0; use_alignment--) {
+        transform_t transform;
+        if (get_transform(reader, corners, version, use_alignment, &transform) == -1)
+            continue;
+        bitset_init_from_buffer(code, dim, dim, code_mem, bitset_size(MAX_DIM, MAX_DIM));
+        sample_grid(reader, &transform, code);
+        if (version >= 7) {
+            int found = decode_version_info(code, 0);
+            if (found == -1)
+                found = decode_version_info(code, 1);
+            if (found != -1 && found != version) {
+                *other_version = found;
+                continue;
+            }
+        }
+        int len = decode_code(code, out, out_cap, info);
+        if (len >= 0)
+            return len;
+    }
+    return -1;
+}
+
+// reads the code with the given corners, trying the versions around the one estimated from their distances
+static int read_corners(reader_t* reader, const corners_t* corners, void* code_mem, bitset_t* code, uint8_t* out,
+                        int out_cap, decoded_info_t* info) {
+    double module_right = module_between(reader, corners->top_left, corners->top_right),
+           module_down = module_between(reader, corners->top_left, corners->bottom_left);
+    double module = (module_right > 0 && module_down > 0 ? (module_right + module_down) / 2
+                                                         : fmax(module_right, module_down));
+    if (module <= 0)
+        return -1;
+    double dim_estimate =
+        (distance(corners->top_left, corners->top_right) + distance(corners->top_left, corners->bottom_left)) /
+            (2 * module) +
+        7;
+    int estimate = (int)lround((dim_estimate - 17) / 4);
+    static const int offsets[5] = {0, -1, 1, -2, 2};
+    int tried[QUER_MAX_VERSION + 1] = {0};
+    for (int i = 0; i < 5; i++) {
+        int version = estimate + offsets[i];
+        // a version info that doesn't match the sampled version is tried next
+        while (version >= QUER_MIN_VERSION && version <= QUER_MAX_VERSION && !tried[version]) {
+            tried[version] = 1;
+            int len = read_as_version(reader, corners, version, code_mem, code, out, out_cap, info, &version);
+            if (len >= 0)
+                return len;
+        }
+    }
+    return -1;
+}
+
+int read_image(const quer_image_t* image, void* scratch, uint8_t* out, int out_cap, bitset_t* code,
+               decoded_info_t* info) {
+    reader_t reader = {.image = image};
+    char* mem = scratch;
+    size_t bitmap_bytes = align_up(bitset_size(image->width, image->height));
+    bitset_init_from_buffer(&reader.bitmap, image->width, image->height, mem, bitmap_bytes);
+    mem += bitmap_bytes;
+    reader.averages = (uint8_t*)mem;
+    mem += align_up(n_blocks(image->width, image->height));
+    reader.thresholds = (uint8_t*)mem;
+    mem += align_up(n_blocks(image->width, image->height));
+    reader.runs = (int*)mem;
+    mem += align_up((size_t)(image->width + 2) * sizeof(int));
+    void* code_mem = mem;
+
+    binarize(&reader);
+    find_finders(&reader);
+    corners_t candidates[MAX_CODE_CANDIDATES];
+    int n_candidates = select_corners(&reader, candidates);
+    if (n_candidates == 0)
+        return QUER_ERR_NOT_FOUND;
+    for (int i = 0; i < n_candidates; i++) {
+        int len = read_corners(&reader, &candidates[i], code_mem, code, out, out_cap, info);
+        if (len >= 0)
+            return len;
+    }
+    return QUER_ERR_UNREADABLE;
+}
@@ -0,0 +1,23 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitset.h"
+#include "decoder.h"
+#include "quer.h"
+
+// finding a QR code in a grayscale image: the image is binarized with a threshold local to every 8x8 block,
+// the finder patterns are found by a 1:1:3:1:1 run scanner (cross-checked vertically and horizontally),
+// the bottom right alignment pattern refines the perspective transform, and the module grid is sampled into a bitset
+
+// bytes of scratch memory needed by read_image for an image of the given dimensions
+size_t reader_scratch_size(int width, int height);
+// finds and decodes a code in the image, the sampled modules are stored in *code (backed by the scratch memory)
+// returns the length of the data written to out, QUER_ERR_NOT_FOUND if there's no code
+// or QUER_ERR_UNREADABLE if it's too damaged
+int read_image(const quer_image_t* image, void* scratch, uint8_t* out, int out_cap, bitset_t* code,
+               decoded_info_t* info);
+
+#endif  // READER_H
@@ -1,71 +1,235 @@
 #include "reed_solomon.h"
 
-int pow_2[MAX_N + 1];
-int log_2[MAX_N + 1];
+const uint8_t pow_2[2 * MAX_N + 2] = {
+    1, 2, 4, 8, 16, 32, 64, 128, 29, 58, 116, 232, 205, 135, 19, 38, 76, 152, 45, 90, 180, 117, 234, 201, 143, 3, 6,
+    12, 24, 48, 96, 192, 157, 39, 78, 156, 37, 74, 148, 53, 106, 212, 181, 119, 238, 193, 159, 35, 70, 140, 5, 10, 20,
+    40, 80, 160, 93, 186, 105, 210, 185, 111, 222, 161, 95, 190, 97, 194, 153, 47, 94, 188, 101, 202, 137, 15, 30, 60,
+    120, 240, 253, 231, 211, 187, 107, 214, 177, 127, 254, 225, 223, 163, 91, 182, 113, 226, 217, 175, 67, 134, 17, 34,
+    68, 136, 13, 26, 52, 104, 208, 189, 103, 206, 129, 31, 62, 124, 248, 237, 199, 147, 59, 118, 236, 197, 151, 51,
+    102, 204, 133, 23, 46, 92, 184, 109, 218, 169, 79, 158, 33, 66, 132, 21, 42, 84, 168, 77, 154, 41, 82, 164, 85,
+    170, 73, 146, 57, 114, 228, 213, 183, 115, 230, 209, 191, 99, 198, 145, 63, 126, 252, 229, 215, 179, 123, 246, 241,
+    255, 227, 219, 171, 75, 150, 49, 98, 196, 149, 55, 110, 220, 165, 87, 174, 65, 130, 25, 50, 100, 200, 141, 7, 14,
+    28, 56, 112, 224, 221, 167, 83, 166, 81, 162, 89, 178, 121, 242, 249, 239, 195, 155, 43, 86, 172, 69, 138, 9, 18,
+    36, 72, 144, 61, 122, 244, 245, 247, 243, 251, 235, 203, 139, 11, 22, 44, 88, 176, 125, 250, 233, 207, 131, 27, 54,
+    108, 216, 173, 71, 142, 1, 2, 4, 8, 16, 32, 64, 128, 29, 58, 116, 232, 205, 135, 19, 38, 76, 152, 45, 90, 180, 117,
+    234, 201, 143, 3, 6, 12, 24, 48, 96, 192, 157, 39, 78, 156, 37, 74, 148, 53, 106, 212, 181, 119, 238, 193, 159, 35,
+    70, 140, 5, 10, 20, 40, 80, 160, 93, 186, 105, 210, 185, 111, 222, 161, 95, 190, 97, 194, 153, 47, 94, 188, 101,
+    202, 137, 15, 30, 60, 120, 240, 253, 231, 211, 187, 107, 214, 177, 127, 254, 225, 223, 163, 91, 182, 113, 226, 217,
+    175, 67, 134, 17, 34, 68, 136, 13, 26, 52, 104, 208, 189, 103, 206, 129, 31, 62, 124, 248, 237, 199, 147, 59, 118,
+    236, 197, 151, 51, 102, 204, 133, 23, 46, 92, 184, 109, 218, 169, 79, 158, 33, 66, 132, 21, 42, 84, 168, 77, 154,
+    41, 82, 164, 85, 170, 73, 146, 57, 114, 228, 213, 183, 115, 230, 209, 191, 99, 198, 145, 63, 126, 252, 229, 215,
+    179, 123, 246, 241, 255, 227, 219, 171, 75, 150, 49, 98, 196, 149, 55, 110, 220, 165, 87, 174, 65, 130, 25, 50,
+    100, 200, 141, 7, 14, 28, 56, 112, 224, 221, 167, 83, 166, 81, 162, 89, 178, 121, 242, 249, 239, 195, 155, 43, 86,
+    172, 69, 138, 9, 18, 36, 72, 144, 61, 122, 244, 245, 247, 243, 251, 235, 203, 139, 11, 22, 44, 88, 176, 125, 250,
+    233, 207, 131, 27, 54, 108, 216, 173, 71, 142, 1, 2};
 
-void init_lut() {
-    pow_2[0] = 1;
-    for (int i = 1; i <= MAX_N; i++) {
-        pow_2[i] = pow_2[i - 1] * 2;
-        if (pow_2[i] >= 256)
-            pow_2[i] ^= MOD;
+const uint8_t log_2[MAX_N + 1] = {
+    0, 0, 1, 25, 2, 50, 26, 198, 3, 223, 51, 238, 27, 104, 199, 75, 4, 100, 224, 14, 52, 141, 239, 129, 28, 193, 105,
+    248, 200, 8, 76, 113, 5, 138, 101, 47, 225, 36, 15, 33, 53, 147, 142, 218, 240, 18, 130, 69, 29, 181, 194, 125,
+    106, 39, 249, 185, 201, 154, 9, 120, 77, 228, 114, 166, 6, 191, 139, 98, 102, 221, 48, 253, 226, 152, 37, 179, 16,
+    145, 34, 136, 54, 208, 148, 206, 143, 150, 219, 189, 241, 210, 19, 92, 131, 56, 70, 64, 30, 66, 182, 163, 195, 72,
+    126, 110, 107, 58, 40, 84, 250, 133, 186, 61, 202, 94, 155, 159, 10, 21, 121, 43, 78, 212, 229, 172, 115, 243, 167,
+    87, 7, 112, 192, 247, 140, 128, 99, 13, 103, 74, 222, 237, 49, 197, 254, 24, 227, 165, 153, 119, 38, 184, 180, 124,
+    17, 68, 146, 217, 35, 32, 137, 46, 55, 63, 209, 91, 149, 188, 207, 205, 144, 135, 151, 178, 220, 252, 190, 97, 242,
+    86, 211, 171, 20, 42, 93, 158, 132, 60, 57, 83, 71, 109, 65, 162, 31, 45, 67, 216, 183, 123, 164, 118, 196, 23, 73,
+    236, 127, 12, 111, 246, 108, 161, 59, 82, 41, 157, 85, 170, 251, 96, 134, 177, 187, 204, 62, 90, 203, 89, 95, 176,
+    156, 169, 160, 81, 11, 245, 22, 235, 122, 117, 44, 215, 79, 174, 213, 233, 230, 231, 173, 232, 116, 214, 244, 234,
+    168, 80, 88, 175};
+
+// the generator polynomials (x - 2^0)(x - 2^1) ... (x - 2^(deg - 1)) for every degree,
+// as the logs of the coefficients a_deg, a_{deg - 1}, ..., a_0 (none of them is 0)
+static const uint8_t GENERATOR_POLYS[MAX_DEGREE][MAX_DEGREE] = {
+    {0},
+    {0, 0},
+    {0, 25, 1},
+    {0, 198, 199, 3},
+    {0, 75, 249, 78, 6},
+    {0, 113, 164, 166, 119, 10},
+    {0, 166, 0, 134, 5, 176, 15},
+    {0, 87, 229, 146, 149, 238, 102, 21},
+    {0, 175, 238, 208, 249, 215, 252, 196, 28},
+    {0, 95, 246, 137, 231, 235, 149, 11, 123, 36},
+    {0, 251, 67, 46, 61, 118, 70, 64, 94, 32, 45},
+    {0, 220, 192, 91, 194, 172, 177, 209, 116, 227, 10, 55},
+    {0, 102, 43, 98, 121, 187, 113, 198, 143, 131, 87, 157, 66},
+    {0, 74, 152, 176, 100, 86, 100, 106, 104, 130, 218, 206, 140, 78},
+    {0, 199, 249, 155, 48, 190, 124, 218, 137, 216, 87, 207, 59, 22, 91},
+    {0, 8, 183, 61, 91, 202, 37, 51, 58, 58, 237, 140, 124, 5, 99, 105},
+    {0, 120, 104, 107, 109, 102, 161, 76, 3, 91, 191, 147, 169, 182, 194, 225, 120},
+    {0, 43, 139, 206, 78, 43, 239, 123, 206, 214, 147, 24, 99, 150, 39, 243, 163, 136},
+    {0, 215, 234, 158, 94, 184, 97, 118, 170, 79, 187, 152, 148, 252, 179, 5, 98, 96, 153},
+    {0, 67, 3, 105, 153, 52, 90, 83, 17, 150, 159, 44, 128, 153, 133, 252, 222, 138, 220, 171},
+    {0, 17, 60, 79, 50, 61, 163, 26, 187, 202, 180, 221, 225, 83, 239, 156, 164, 212, 212, 188, 190},
+    {0, 240, 233, 104, 247, 181, 140, 67, 98, 85, 200, 210, 115, 148, 137, 230, 36, 122, 254, 148, 175, 210},
+    {0, 210, 171, 247, 242, 93, 230, 14, 109, 221, 53, 200, 74, 8, 172, 98, 80, 219, 134, 160, 105, 165, 231},
+    {0, 171, 102, 146, 91, 49, 103, 65, 17, 193, 150, 14, 25, 183, 248, 94, 164, 224, 192, 1, 78, 56, 147, 253},
+    {0, 229, 121, 135, 48, 211, 117, 251, 126, 159, 180, 169, 152, 192, 226, 228, 218, 111, 0, 117, 232, 87, 96, 227,
+     21},
+    {0, 231, 181, 156, 39, 170, 26, 12, 59, 15, 148, 201, 54, 66, 237, 208, 99, 167, 144, 182, 95, 243, 129, 178, 252,
+     45},
+    {0, 173, 125, 158, 2, 103, 182, 118, 17, 145, 201, 111, 28, 165, 53, 161, 21, 245, 142, 13, 102, 48, 227, 153, 145,
+     218, 70},
+    {0, 79, 228, 8, 165, 227, 21, 180, 29, 9, 237, 70, 99, 45, 58, 138, 135, 73, 126, 172, 94, 216, 193, 157, 26, 17,
+     149, 96},
+    {0, 168, 223, 200, 104, 224, 234, 108, 180, 110, 190, 195, 147, 205, 27, 232, 201, 21, 43, 245, 87, 42, 195, 212,
+     119, 242, 37, 9, 123},
+    {0, 156, 45, 183, 29, 151, 219, 54, 96, 249, 24, 136, 5, 241, 175, 189, 28, 75, 234, 150, 148, 23, 9, 202, 162, 68,
+     250, 140, 24, 151},
+    {0, 41, 173, 145, 152, 216, 31, 179, 182, 50, 48, 110, 86, 239, 96, 222, 125, 42, 173, 226, 193, 224, 130, 156, 37,
+     251, 216, 238, 40, 192, 180},
+};
+
+void compute_corr_codewords(const uint8_t* msg, int msg_len, int n_corr_codewords, uint8_t* corr_codewords) {
+    const uint8_t* gen_poly = GENERATOR_POLYS[n_corr_codewords];
+    // long division of msg * x^n_corr_codewords by the generator poly, done in place:
+    // res[i] is the coefficient of x^(msg_len + n_corr_codewords - 1 - i), the remainder ends up at the end
+    uint8_t res[MAX_N + MAX_DEGREE];
+    memcpy(res, msg, msg_len);
+    memset(res + msg_len, 0, n_corr_codewords);
+    for (int i = 0; i < msg_len; i++) {
+        if (res[i] == 0)
+            continue;
+        int coeff_exp = log_2[res[i]];
+        uint8_t* tail = res + i;
+        for (int j = 1; j <= n_corr_codewords; j++)
+            tail[j] ^= pow_2[gen_poly[j] + coeff_exp];
     }
-    for (int i = 1; i <= MAX_N; i++) {
-        for (int j = 0; j <= MAX_N; j++) {
-            if (pow_2[j] == i) {
-                log_2[i] = j;
-                break;
-            }
+    memcpy(corr_codewords, res + msg_len, n_corr_codewords);
+}
+
+int compute_syndromes(const uint8_t* block, int block_len, int n_corr_codewords, uint8_t* syndromes) {
+    // syndromes[j] = block(2^j), where block[i] is the coefficient of x^(block_len - 1 - i), by Horner's rule
+    // all of the syndromes are advanced together, so that their (independent) steps can overlap
+    memset(syndromes, 0, n_corr_codewords);
+    for (int i = 0; i < block_len; i++) {
+        for (int j = 0; j < n_corr_codewords; j++) {
+            uint8_t value = syndromes[j];
+            syndromes[j] = (value == 0 ? 0 : pow_2[log_2[value] + j]) ^ block[i];
         }
     }
+    uint8_t any = 0;
+    for (int j = 0; j < n_corr_codewords; j++)
+        any |= syndromes[j];
+    return any == 0;
 }
 
-void compute_generator_poly(int deg, int poly[MAX_DEGREE]) {
-    memset(poly, 0, MAX_DEGREE * sizeof(int));
-    poly[0] = 1;
-    // (x - 2^0)(x - 2^1) ... (x - 2^(deg - 1))
-    int temp[MAX_DEGREE];
-    for (int i = 0; i < deg; i++) {
-        memset(temp, 0, MAX_DEGREE * sizeof(int));
-        for (int j = 1; j <= i + 1; j++) {
-            // multiply by x
-            temp[j] = poly[j - 1];
+static inline uint8_t gf_mul(uint8_t a, uint8_t b) { return a == 0 || b == 0 ? 0 : pow_2[log_2[a] + log_2[b]]; }
+
+static inline uint8_t gf_div(uint8_t a, uint8_t b) { return a == 0 ? 0 : pow_2[log_2[a] + MAX_N - log_2[b]]; }
+
+// 2^-power
+static inline uint8_t gf_inv_pow(int power) { return pow_2[(MAX_N - power % MAX_N) % MAX_N]; }
+
+// evaluates the polynomial with coefficients poly[0] (of x^0), ..., poly[deg] at x
+static uint8_t poly_eval(const uint8_t* poly, int deg, uint8_t x) {
+    uint8_t value = 0;
+    for (int i = deg; i >= 0; i--)
+        value = gf_mul(value, x) ^ poly[i];
+    return value;
+}
+
+int correct_block(uint8_t* block, int block_len, int n_corr_codewords, const int* erasures, int n_erasures) {
+    uint8_t syndromes[MAX_DEGREE];
+    if (block_len > MAX_N || n_erasures > n_corr_codewords)
+        return -1;
+    if (compute_syndromes(block, block_len, n_corr_codewords, syndromes))
+        return 0;
+
+    // the errata locator starts as the erasure locator, the product of (1 - X x) over the erasures,
+    // where X = 2^(block_len - 1 - position) for the codeword at that position
+    uint8_t locator[MAX_DEGREE + 1] = {1}, prev[MAX_DEGREE + 1], tmp[MAX_DEGREE + 1];
+    for (int i = 0; i < n_erasures; i++) {
+        if (erasures[i] < 0 || erasures[i] >= block_len)
+            return -1;
+        uint8_t x = pow_2[block_len - 1 - erasures[i]];
+        for (int j = i + 1; j >= 1; j--)
+            locator[j] ^= gf_mul(locator[j - 1], x);
+    }
+    memcpy(prev, locator, sizeof(locator));
+
+    // Berlekamp-Massey over the syndromes not used up by the erasures
+    int len = n_erasures, shift = 1;
+    uint8_t prev_discrepancy = 1;
+    for (int r = n_erasures; r < n_corr_codewords; r++) {
+        uint8_t discrepancy = 0;
+        for (int i = 0; i <= len; i++)
+            discrepancy ^= gf_mul(locator[i], syndromes[r - i]);
+        if (discrepancy == 0) {
+            shift++;
+            continue;
         }
-        for (int j = 0; j <= i + 1; j++) {
-            // multiply by -2^i
-            if (poly[j] != 0)
-                poly[j] = pow_2[(log_2[poly[j]] + i) % MAX_N];
-            poly[j] ^= temp[j];
+        uint8_t coeff = gf_div(discrepancy, prev_discrepancy);
+        memcpy(tmp, locator, sizeof(locator));
+        for (int i = 0; i + shift <= n_corr_codewords; i++)
+            locator[i + shift] ^= gf_mul(coeff, prev[i]);
+        if (2 * len <= r + n_erasures) {
+            len = r + 1 + n_erasures - len;
+            memcpy(prev, tmp, sizeof(tmp));
+            prev_discrepancy = discrepancy;
+            shift = 1;
+        } else {
+            shift++;
         }
     }
-    for (int i = 0; i <= deg / 2; i++) {
-        int tmp = poly[i];
-        poly[i] = poly[deg - i];
-        poly[deg - i] = tmp;
-    }
-}
+    if (2 * (len - n_erasures) + n_erasures > n_corr_codewords)
+        return -1;
 
-void compute_corr_codewords(int* gen_poly, uint8_t* msg_bytes, int block_start, int block_len, int n_corr_codewords,
-                            uint8_t* corr_codewords) {
-    // the generator poly is implicitly multiplied by x^(block_len - 1), and the message poly by x^n_corr_codewords
-    // every iteration the degree of the generator poly decreases by 1
-    int degree = block_len > n_corr_codewords + 1 ? block_len : n_corr_codewords + 1;
-    uint8_t res[degree];
-    for (int i = 0; i < block_len; i++)
-        res[i] = msg_bytes[block_start + i];
-    // if there are more correction codewords than the length of the block
-    for (int i = block_len; i < degree; i++)
-        res[i] = 0;
-    for (int i = 0; i < block_len; i++) {
-        int coeff_exp = log_2[res[0]];
-        for (int j = 0; j < n_corr_codewords + 1; j++) {
-            res[j] ^= pow_2[(log_2[gen_poly[j]] + coeff_exp) % MAX_N];
+    // Chien search: the codeword at position p is wrong if locator(2^-(block_len - 1 - p)) = 0
+    // term i of the sum is kept as a log, moving to the next position multiplies it by 2^i
+    int positions[MAX_DEGREE], term_logs[MAX_DEGREE + 1];
+    int n_found = 0;
+    for (int i = 1; i <= len; i++)
+        term_logs[i] = locator[i] == 0 ? -1 : (log_2[locator[i]] + i * (MAX_N - (block_len - 1) % MAX_N)) % MAX_N;
+    for (int p = 0; p < block_len; p++) {
+        uint8_t value = locator[0];
+        for (int i = 1; i <= len; i++) {
+            if (term_logs[i] == -1)
+                continue;
+            value ^= pow_2[term_logs[i]];
+            term_logs[i] += i;
+            if (term_logs[i] >= MAX_N)
+                term_logs[i] -= MAX_N;
         }
-        for (int j = 0; j < degree - 1; j++)
-            res[j] = res[j + 1];
-        if (i >= degree - n_corr_codewords - 1)
-            res[n_corr_codewords] = 0;
+        if (value != 0)
+            continue;
+        if (n_found == len)
+            return -1;
+        positions[n_found++] = p;
+    }
+    // fewer roots than the degree means the errors are in positions outside of the (shortened) block
+    if (n_found != len)
+        return -1;
+
+    // Forney: the errata evaluator is syndromes(x) * locator(x) mod x^n_corr_codewords,
+    // the magnitude at X is X * evaluator(X^-1) / locator'(X^-1) (the generator's first root is 2^0)
+    uint8_t evaluator[MAX_DEGREE] = {0};
+    for (int i = 0; i < n_corr_codewords; i++) {
+        for (int j = 0; j <= len && j <= i; j++)
+            evaluator[i] ^= gf_mul(syndromes[i - j], locator[j]);
+    }
+    uint8_t magnitudes[MAX_DEGREE];
+    for (int k = 0; k < n_found; k++) {
+        int power = block_len - 1 - positions[k];
+        uint8_t x_inv = gf_inv_pow(power), x_inv_sq = gf_mul(x_inv, x_inv);
+        // the formal derivative has only the odd powers of the locator (the even ones vanish in characteristic 2)
+        uint8_t derivative = 0;
+        for (int i = len - (len % 2 == 0); i >= 1; i -= 2)
+            derivative = gf_mul(derivative, x_inv_sq) ^ locator[i];
+        if (derivative == 0)
+            return -1;
+        magnitudes[k] = gf_mul(pow_2[power], gf_div(poly_eval(evaluator, n_corr_codewords - 1, x_inv), derivative));
+    }
+
+    int n_corrected = 0;
+    for (int k = 0; k < n_found; k++) {
+        block[positions[k]] ^= magnitudes[k];
+        n_corrected += (magnitudes[k] != 0);
+    }
+    // a block with more errors than can be corrected may still produce a locator with the right number of roots
+    if (!compute_syndromes(block, block_len, n_corr_codewords, syndromes)) {
+        for (int k = 0; k < n_found; k++)
+            block[positions[k]] ^= magnitudes[k];
+        return -1;
     }
-    for (int i = 0; i < n_corr_codewords; i++)
-        corr_codewords[i] = res[i];
+    return n_corrected;
 }
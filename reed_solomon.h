@@ -8,13 +8,22 @@
 
 #define MAX_DEGREE 31
 #define MAX_N 255
-#define MOD 285 // from the QR code spec
+#define MOD 285  // from the QR code spec
 
-// initialize lookup tables of powers of 2 and logs base 2 in the Galois field GF(256)
-void init_lut();
-// returns the polynomial a_nx^n + a_{n - 1}x^{n - 1} + ... as {a_n, a_{n - 1}, ...}
-void compute_generator_poly(int deg, int poly[MAX_DEGREE]);
-void compute_corr_codewords(int* gen_poly, uint8_t* msg_bytes, int block_start, int block_len, int n_corr_codewords,
-                            uint8_t* corr_codewords);
+// powers of 2 and logs base 2 in the Galois field GF(256) (generated with the polynomial MOD)
+// pow_2 is repeated twice, so that pow_2[log_2[a] + log_2[b]] = a * b without reducing the exponent mod 255
+extern const uint8_t pow_2[2 * MAX_N + 2];
+extern const uint8_t log_2[MAX_N + 1];
+
+// computes the n_corr_codewords (at most MAX_DEGREE - 1) error correction codewords of a block of msg_len bytes
+void compute_corr_codewords(const uint8_t* msg, int msg_len, int n_corr_codewords, uint8_t* corr_codewords);
+// computes the n_corr_codewords syndromes of a received block (data followed by its error correction codewords),
+// returns 1 if all of them are zero, i.e. the block is a valid codeword
+int compute_syndromes(const uint8_t* block, int block_len, int n_corr_codewords, uint8_t* syndromes);
+// corrects a received block (data followed by its n_corr_codewords error correction codewords) in place,
+// erasures holds the positions of the n_erasures codewords known to be unreliable (e.g. unreadable modules)
+// it can fix any e errors at unknown positions and f erasures as long as 2e + f <= n_corr_codewords
+// returns the number of corrected codewords, or -1 (leaving the block unchanged) if there are too many errors
+int correct_block(uint8_t* block, int block_len, int n_corr_codewords, const int* erasures, int n_erasures);
 
 #endif  // REED_SOLOMON_H
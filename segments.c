@@ -0,0 +1,290 @@
+#include "segments.h"
+
+#include <limits.h>
+#include <string.h>
+
+// the costs are in sixths of a bit, so that numeric (10 bits per 3 digits) and alphanumeric (11 bits per 2 characters)
+// characters have integer costs
+#define SIXTHS 6
+#define INF (INT_MAX / 2)
+#define ECI_MODE_INDICATOR 0b0111
+#define RMQR_ECI_MODE_INDICATOR 0b111
+#define APPEND_MODE_INDICATOR 0b0011
+
+// in Micro QR codes the mode indicators are the indices of the modes, in rMQR codes the indices plus one
+static const int MODE_INDICATOR[N_SEGMENT_MODES] = {0b0001, 0b0010, 0b0100, 0b1000};
+static const int MODE_INDICATOR_BITS[N_GROUPS] = {4, 4, 4, 0, 1, 2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+                                                  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3};
+static const int TERMINATOR_BITS[N_GROUPS] = {4, 4, 4, 3, 5, 7, 9, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+                                              3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3};
+static const int CHAR_COUNT_BITS[N_SEGMENT_MODES][N_GROUPS] = {
+    {10, 12, 14, 3, 4, 5, 6, 4, 5, 6, 7, 7, 5, 6, 7, 7, 8, 4, 6, 7, 7, 8, 8, 5, 6, 7, 7, 8, 8, 7, 7, 8, 8, 9, 7, 8, 8,
+     8, 9},
+    {9, 11, 13, 0, 3, 4, 5, 3, 5, 5, 6, 6, 5, 5, 6, 6, 7, 4, 5, 6, 6, 7, 7, 5, 6, 6, 7, 7, 8, 6, 7, 7, 7, 8, 6, 7, 7,
+     8, 8},
+    {8, 16, 16, 0, 0, 4, 5, 3, 4, 5, 5, 6, 4, 5, 5, 6, 6, 3, 5, 5, 6, 6, 7, 4, 5, 6, 6, 7, 7, 6, 6, 7, 7, 7, 6, 6, 7,
+     7, 8},
+    {8, 10, 12, 0, 0, 3, 4, 2, 3, 4, 5, 5, 3, 4, 5, 5, 6, 2, 4, 5, 5, 6, 6, 3, 5, 5, 6, 6, 7, 5, 5, 6, 6, 7, 5, 6, 6,
+     6, 7}};
+static const int CHAR_COST[N_SEGMENT_MODES] = {20, 33, 48, 78};
+// Kanji characters take two bytes of Shift JIS
+static const int CHAR_BYTES[N_SEGMENT_MODES] = {1, 1, 1, 2};
+static const int GROUP_START[N_VERSION_GROUPS] = {1, 10, 27};
+
+int version_group(int version) { return version <= 9 ? 0 : (version <= 26 ? 1 : 2); }
+
+int micro_version_group(int version) { return N_VERSION_GROUPS + version - 1; }
+
+int rmqr_version_group(int version) { return N_VERSION_GROUPS + N_MICRO_GROUPS + version - 1; }
+
+int version_group_start(int group) { return GROUP_START[group]; }
+
+int char_count_bits(enum segment_mode_t mode, int group) { return CHAR_COUNT_BITS[mode][group]; }
+
+int mode_indicator_bits(int group) { return MODE_INDICATOR_BITS[group]; }
+
+int terminator_bits(int group) { return TERMINATOR_BITS[group]; }
+
+int mode_indicator(enum segment_mode_t mode, int group) {
+    if (group < N_VERSION_GROUPS)
+        return MODE_INDICATOR[mode];
+    return is_micro_group(group) ? (int)mode : (int)mode + 1;
+}
+
+int eci_mode_indicator(int group) { return group < N_VERSION_GROUPS ? ECI_MODE_INDICATOR : RMQR_ECI_MODE_INDICATOR; }
+
+// an empty input is stored as an empty byte segment, in Micro QR codes (which don't all have the byte mode) as nothing
+// but the terminator (an empty numeric segment would look just like it)
+static int empty_input_bits(int group) {
+    return is_micro_group(group) ? 0 : MODE_INDICATOR_BITS[group] + CHAR_COUNT_BITS[MODE_BYTE][group];
+}
+
+int eci_bits(int eci, int group) {
+    if (eci <= 0)
+        return 0;
+    return MODE_INDICATOR_BITS[group] + (eci < (1 << 7) ? 8 : (eci < (1 << 14) ? 16 : 24));
+}
+
+// the value of an alphanumeric character, -1 if it isn't one
+static int alphanumeric_value(uint8_t c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A' + 10;
+    switch (c) {
+        case ' ':
+            return 36;
+        case '$':
+            return 37;
+        case '%':
+            return 38;
+        case '*':
+            return 39;
+        case '+':
+            return 40;
+        case '-':
+            return 41;
+        case '.':
+            return 42;
+        case '/':
+            return 43;
+        case ':':
+            return 44;
+        default:
+            return -1;
+    }
+}
+
+// the 13-bit value of the Shift JIS double-byte character starting at data[i], -1 if Kanji mode can't store it
+static int kanji_value(const uint8_t* data, int len, int i) {
+    if (i + 1 >= len || data[i + 1] < 0x40 || data[i + 1] > 0xFC || data[i + 1] == 0x7F)
+        return -1;
+    int c = data[i] << 8 | data[i + 1];
+    if (c >= 0x8140 && c <= 0x9FFC)
+        c -= 0x8140;
+    else if (c >= 0xE040 && c <= 0xEBBF)
+        c -= 0xC140;
+    else
+        return -1;
+    return (c >> 8) * 0xC0 + (c & 0xFF);
+}
+
+static int can_encode(enum segment_mode_t mode, const uint8_t* data, int len, int i, int allow_kanji) {
+    switch (mode) {
+        case MODE_NUMERIC:
+            return data[i] >= '0' && data[i] <= '9';
+        case MODE_ALPHANUMERIC:
+            return alphanumeric_value(data[i]) != -1;
+        case MODE_KANJI:
+            return allow_kanji && kanji_value(data, len, i) != -1;
+        default:
+            return 1;
+    }
+}
+
+static int round_up_to_bits(int cost) { return (cost + SIXTHS - 1) / SIXTHS * SIXTHS; }
+
+// the planning of data[0, i), extended one character at a time
+// cost[i % 3][m]: the fewest sixths of a bit that encode data[0, i) with the last character in mode m,
+// counting the previous segments rounded up to whole bits
+// ends[i % 3]: the two cheapest of those costs rounded up to whole bits (the cost of ending the segment there),
+// so that starting a new segment takes the cheapest one in another mode without looking at all of them
+typedef struct planner_t {
+    int cost[3][N_SEGMENT_MODES];
+    struct {
+        int cost[2];
+        int mode[2];
+    } ends[3];
+} planner_t;
+
+// extends the planning to data[0, i), storing the mode of the character before the last one in from[m]
+// (N_SEGMENT_MODES if it's the first one) for every mode m of the last one, returns the fewest bits of data[0, i)
+static int plan_step(planner_t* planner, const uint8_t* data, int len, int i, int group, int allow_kanji,
+                     uint8_t* from) {
+    int* row = planner->cost[i % 3];
+    for (int m = 0; m < N_SEGMENT_MODES; m++) {
+        int start = i - CHAR_BYTES[m];
+        row[m] = INF;
+        if (start < 0 || CHAR_COUNT_BITS[m][group] == 0 || !can_encode(m, data, len, start, allow_kanji))
+            continue;
+        int header = (MODE_INDICATOR_BITS[group] + CHAR_COUNT_BITS[m][group]) * SIXTHS;
+        if (start == 0) {
+            row[m] = header + CHAR_COST[m];
+            from[m] = N_SEGMENT_MODES;
+            continue;
+        }
+        const int* prev = planner->cost[start % 3];
+        // either continue the segment, or end the previous one and start a new one
+        // (on equal costs the segment is continued, or else the mode with the lowest index is taken)
+        if (prev[m] < INF) {
+            row[m] = prev[m] + CHAR_COST[m];
+            from[m] = m;
+        }
+        int k = (planner->ends[start % 3].mode[0] == m), end = planner->ends[start % 3].cost[k];
+        if (end < INF && end + header + CHAR_COST[m] < row[m]) {
+            row[m] = end + header + CHAR_COST[m];
+            from[m] = planner->ends[start % 3].mode[k];
+        }
+    }
+    planner->ends[i % 3].cost[0] = planner->ends[i % 3].cost[1] = INF;
+    planner->ends[i % 3].mode[0] = planner->ends[i % 3].mode[1] = N_SEGMENT_MODES;
+    for (int m = 0; m < N_SEGMENT_MODES; m++) {
+        int end = (row[m] < INF ? round_up_to_bits(row[m]) : INF);
+        if (end < planner->ends[i % 3].cost[0]) {
+            planner->ends[i % 3].cost[1] = planner->ends[i % 3].cost[0];
+            planner->ends[i % 3].mode[1] = planner->ends[i % 3].mode[0];
+            planner->ends[i % 3].cost[0] = end;
+            planner->ends[i % 3].mode[0] = m;
+        } else if (end < planner->ends[i % 3].cost[1]) {
+            planner->ends[i % 3].cost[1] = end;
+            planner->ends[i % 3].mode[1] = m;
+        }
+    }
+    return planner->ends[i % 3].cost[0] / SIXTHS;
+}
+
+int plan_segments(const uint8_t* data, int len, int group, int allow_kanji, uint8_t* mem, uint8_t* modes) {
+    if (len == 0)
+        return empty_input_bits(group);
+
+    // from[i][m]: the mode of the character before the last one of data[0, i) if the last one is in mode m
+    planner_t planner;
+    uint8_t(*from)[N_SEGMENT_MODES] = (uint8_t(*)[N_SEGMENT_MODES])mem;
+    for (int i = 1; i <= len; i++)
+        plan_step(&planner, data, len, i, group, allow_kanji, from[i]);
+
+    const int* last = planner.cost[len % 3];
+    int mode = MODE_BYTE;
+    for (int m = 0; m < N_SEGMENT_MODES; m++) {
+        if (round_up_to_bits(last[m]) < round_up_to_bits(last[mode]))
+            mode = m;
+    }
+    // the data may have characters the modes of a Micro QR version can't store
+    if (last[mode] >= INF)
+        return INF / SIXTHS;
+    int n_bits = round_up_to_bits(last[mode]) / SIXTHS;
+    for (int i = len; i > 0;) {
+        int prev_mode = from[i][mode];
+        for (int k = i - CHAR_BYTES[mode]; k < i; k++)
+            modes[k] = mode;
+        i -= CHAR_BYTES[mode];
+        mode = prev_mode;
+    }
+    return n_bits;
+}
+
+int longest_prefix(const uint8_t* data, int len, int group, int allow_kanji, int max_bits) {
+    planner_t planner;
+    uint8_t from[N_SEGMENT_MODES];
+    for (int i = 1; i <= len; i++) {
+        // the bits only grow with the length of the prefix
+        if (plan_step(&planner, data, len, i, group, allow_kanji, from) > max_bits)
+            return i - 1;
+    }
+    return len;
+}
+
+void write_append_header(bitstream_t* bitstream, int index, int total, int parity) {
+    add_bits_to_stream(bitstream, APPEND_MODE_INDICATOR, 4);
+    add_bits_to_stream(bitstream, index << 4 | (total - 1), 8);
+    add_bits_to_stream(bitstream, parity, 8);
+}
+
+static void write_eci(bitstream_t* bitstream, int eci, int group) {
+    add_bits_to_stream(bitstream, eci_mode_indicator(group), MODE_INDICATOR_BITS[group]);
+    if (eci < (1 << 7))
+        add_bits_to_stream(bitstream, eci, 8);
+    else if (eci < (1 << 14))
+        add_bits_to_stream(bitstream, 0b10 << 14 | eci, 16);
+    else
+        add_bits_to_stream(bitstream, 0b110 << 21 | eci, 24);
+}
+
+void write_segments(bitstream_t* bitstream, const uint8_t* data, int len, const uint8_t* modes, int group, int eci) {
+    if (eci > 0)
+        write_eci(bitstream, eci, group);
+    if (len == 0) {
+        if (empty_input_bits(group) > 0) {
+            add_bits_to_stream(bitstream, mode_indicator(MODE_BYTE, group), MODE_INDICATOR_BITS[group]);
+            add_bits_to_stream(bitstream, 0, CHAR_COUNT_BITS[MODE_BYTE][group]);
+        }
+        return;
+    }
+    for (int start = 0; start < len;) {
+        enum segment_mode_t mode = modes[start];
+        int end = start;
+        while (end < len && modes[end] == mode)
+            end++;
+        add_bits_to_stream(bitstream, mode_indicator(mode, group), MODE_INDICATOR_BITS[group]);
+        add_bits_to_stream(bitstream, (end - start) / CHAR_BYTES[mode], CHAR_COUNT_BITS[mode][group]);
+        switch (mode) {
+            case MODE_NUMERIC:
+                // groups of 3 digits in 10 bits, the last group of 2 or 1 digits in 7 or 4 bits
+                for (int i = start; i < end; i += 3) {
+                    int n = end - i < 3 ? end - i : 3, value = 0;
+                    for (int k = 0; k < n; k++)
+                        value = value * 10 + (data[i + k] - '0');
+                    add_bits_to_stream(bitstream, value, 3 * n + 1);
+                }
+                break;
+            case MODE_ALPHANUMERIC:
+                // pairs of characters in 11 bits, the last single character in 6 bits
+                for (int i = start; i < end; i += 2) {
+                    if (i + 1 < end)
+                        add_bits_to_stream(bitstream,
+                                           45 * alphanumeric_value(data[i]) + alphanumeric_value(data[i + 1]), 11);
+                    else
+                        add_bits_to_stream(bitstream, alphanumeric_value(data[i]), 6);
+                }
+                break;
+            case MODE_KANJI:
+                for (int i = start; i < end; i += 2)
+                    add_bits_to_stream(bitstream, kanji_value(data, len, i), 13);
+                break;
+            default:
+                for (int i = start; i < end; i++)
+                    add_bits_to_stream(bitstream, data[i], 8);
+        }
+        start = end;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef SEGMENTS_H
+#define SEGMENTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitstream.h"
+
+enum segment_mode_t {
+    MODE_NUMERIC,
+    MODE_ALPHANUMERIC,
+    MODE_BYTE,
+    MODE_KANJI,
+    N_SEGMENT_MODES,
+};
+
+// the versions are split into 3 groups (1-9, 10-26 and 27-40) with different widths of the character count fields
+#define N_VERSION_GROUPS 3
+// followed by a group for each Micro QR version (M1-M4), which also have their own widths of the mode indicators
+// and fewer modes (M1 only numeric, M2 numeric and alphanumeric)
+#define N_MICRO_GROUPS 4
+// and by a group for each rMQR version (R7x43 to R17x139), with 3-bit mode indicators and terminators
+#define N_RMQR_GROUPS 32
+#define N_GROUPS (N_VERSION_GROUPS + N_MICRO_GROUPS + N_RMQR_GROUPS)
+
+// the Structured Append header: the mode indicator, the index and count of the symbols and the parity of the data
+#define APPEND_HEADER_BITS 20
+
+// bytes of memory needed by plan_segments for data of len bytes
+#define SEGMENTS_MEM_SIZE(len) ((size_t)((len) + 1) * N_SEGMENT_MODES)
+
+int version_group(int version);
+int micro_version_group(int version);
+int rmqr_version_group(int version);
+static inline int is_micro_group(int group) {
+    return group >= N_VERSION_GROUPS && group < N_VERSION_GROUPS + N_MICRO_GROUPS;
+}
+// the first version of the group (of QR versions)
+int version_group_start(int group);
+// number of bits of the character count field of the mode in the group, 0 if the versions of the group don't have it
+int char_count_bits(enum segment_mode_t mode, int group);
+// number of bits of the mode indicators in the group (0 in M1, which has only the numeric mode)
+int mode_indicator_bits(int group);
+// number of bits of the terminator after the segments in the group (fewer if the data ends before it)
+int terminator_bits(int group);
+// the mode indicator of the mode in the group
+int mode_indicator(enum segment_mode_t mode, int group);
+// the mode indicator of the ECI header in the group (Micro QR codes have no ECI)
+int eci_mode_indicator(int group);
+// number of bits of the ECI header for the given assignment number in the group, 0 if eci is 0 (no ECI)
+int eci_bits(int eci, int group);
+
+// finds the split of data into segments that takes the fewest bits for the versions of the given group,
+// stores the mode of every byte in modes (both bytes of a Kanji character get MODE_KANJI)
+// Kanji mode is only considered if allow_kanji is set (the data is Shift JIS text)
+// mem has room for SEGMENTS_MEM_SIZE(len) bytes
+// returns the length of the data segments in bits (more than any version holds if the modes of a Micro QR group
+// can't store the data, modes are then left untouched)
+int plan_segments(const uint8_t* data, int len, int group, int allow_kanji, uint8_t* mem, uint8_t* modes);
+// the length of the longest prefix of data that plan_segments would fit in max_bits bits (the prefix may end in the
+// middle of a Kanji character, whose first byte then goes to a byte segment)
+int longest_prefix(const uint8_t* data, int len, int group, int allow_kanji, int max_bits);
+// writes the Structured Append header of symbol index (from 0) of total, with the parity of the whole data
+void write_append_header(bitstream_t* bitstream, int index, int total, int parity);
+// writes the ECI header (unless eci is 0) and the segments planned by plan_segments for the group
+void write_segments(bitstream_t* bitstream, const uint8_t* data, int len, const uint8_t* modes, int group, int eci);
+
+#endif  // SEGMENTS_H
@@ -0,0 +1,606 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "serve.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <threads.h>
+#include <unistd.h>
+
+// the requests of one connection that can be queued or rendered at once, and the bytes of its responses that can
+// wait to be written (counting the largest possible size of the ones not rendered yet), past either its reader stops
+// reading (so the client's writes block once the socket's buffer is full) until some of them are written
+#define MAX_IN_FLIGHT 64
+#define MAX_BUFFERED (16 << 20)
+// the connections served at once, which bounds the memory of all of them together (MAX_BUFFERED each), past it the
+// new ones wait in the socket's backlog until one of the others is closed
+#define MAX_CONNS 64
+// the longest error message of a response
+#define MAX_MESSAGE 64
+// the length of the queue shared by all the connections per worker, the readers wait while it's full
+#define QUEUE_PER_WORKER 4
+#define N_FORMATS 6
+
+struct job_t;
+
+typedef struct conn_t {
+    int fd;
+    mtx_t lock;
+    // signalled whenever a response is queued (for the writer) or written (for the reader)
+    cnd_t changed;
+    int in_flight;
+    // the bytes of the responses waiting to be written and the bytes reserved for the ones in flight
+    size_t n_buffered;
+    // the responses waiting to be written, in the order in which they were done
+    struct job_t *head;
+    struct job_t *tail;
+    // set once the reader stops, the writer leaves after the last response
+    int is_read;
+} conn_t;
+
+typedef struct job_t {
+    conn_t *conn;
+    serve_request_t req;
+    int is_valid;
+    // the frame the payload points into
+    uint8_t *frame;
+    // the response, the body is owned by the job unless it's an error message
+    uint8_t header[SERVE_RESPONSE_HEADER];
+    const char *body;
+    size_t body_len;
+    int owns_body;
+    // the bytes of the response counted in conn->n_buffered
+    size_t n_reserved;
+    struct job_t *next;
+} job_t;
+
+typedef struct queue_t {
+    mtx_t lock;
+    cnd_t not_empty;
+    cnd_t not_full;
+    job_t *head;
+    job_t *tail;
+    int len;
+    int cap;
+    // set when the server stops, the workers leave once it's empty instead of waiting for more requests
+    int is_closed;
+} queue_t;
+
+typedef struct server_t {
+    const serve_options_t *options;
+    queue_t queue;
+    atomic_int n_conns;
+    // written to whenever a connection is closed, so that the main thread wakes up to accept another one
+    int wake_fds[2];
+} server_t;
+
+typedef struct worker_arg_t {
+    server_t *server;
+    void *worker;
+} worker_arg_t;
+
+typedef struct reader_arg_t {
+    server_t *server;
+    conn_t *conn;
+} reader_arg_t;
+
+static volatile sig_atomic_t is_stopping;
+
+static void stop(int) { is_stopping = 1; }
+
+static void put_u32(uint8_t *p, uint32_t x) {
+    p[0] = x;
+    p[1] = x >> 8;
+    p[2] = x >> 16;
+    p[3] = x >> 24;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// returns -1 on error or if the stream ends first
+static int read_full(int fd, void *buf, size_t len) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// MSG_NOSIGNAL, so that a client that's gone doesn't kill the server with SIGPIPE
+static int send_full(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static const char *serve_strerror(int status) {
+    switch (status) {
+        case SERVE_ERR_BAD_REQUEST:
+            return "invalid request";
+        case SERVE_ERR_OUTPUT:
+            return "unable to write the image";
+        case SERVE_ERR_TOO_LARGE:
+            return "the image would be too large";
+        default:
+            return quer_strerror(status);
+    }
+}
+
+// the fields of a request frame (without its length), returns 0 if they're valid
+static int parse_request(const uint8_t *frame, size_t len, serve_request_t *req) {
+    uint32_t ppm = get_u32(frame + 8), eci = get_u32(frame + 12);
+    *req = (serve_request_t){
+        .id = get_u32(frame),
+        .corr_level = frame[4],
+        .format = frame[5],
+        .flags = frame[6],
+        .ppm = ppm > SERVE_MAX_PPM ? 0 : (int)ppm,
+        .eci = eci > QUER_MAX_ECI ? 0 : (int)eci,
+        .payload = (const char *)frame + SERVE_REQUEST_HEADER - 4,
+        .payload_len = len - (SERVE_REQUEST_HEADER - 4),
+    };
+    int is_valid = req->corr_level <= QUER_CORR_H && req->format < N_FORMATS && req->ppm > 0 && eci <= QUER_MAX_ECI;
+    return is_valid ? 0 : -1;
+}
+
+static int queue_init(queue_t *queue, int cap) {
+    if (mtx_init(&queue->lock, mtx_plain) != thrd_success || cnd_init(&queue->not_empty) != thrd_success ||
+        cnd_init(&queue->not_full) != thrd_success)
+        return -1;
+    queue->head = queue->tail = NULL;
+    queue->len = 0;
+    queue->cap = cap;
+    queue->is_closed = 0;
+    return 0;
+}
+
+// blocks while the queue is full, returns -1 (without queueing the job) once it's closed
+static int queue_push(queue_t *queue, job_t *job) {
+    mtx_lock(&queue->lock);
+    while (queue->len == queue->cap && !queue->is_closed)
+        cnd_wait(&queue->not_full, &queue->lock);
+    if (queue->is_closed) {
+        mtx_unlock(&queue->lock);
+        return -1;
+    }
+    job->next = NULL;
+    if (queue->tail == NULL)
+        queue->head = job;
+    else
+        queue->tail->next = job;
+    queue->tail = job;
+    queue->len++;
+    cnd_signal(&queue->not_empty);
+    mtx_unlock(&queue->lock);
+    return 0;
+}
+
+// returns NULL once the queue is closed and empty, the jobs queued before it was closed are still returned
+static job_t *queue_pop(queue_t *queue) {
+    mtx_lock(&queue->lock);
+    while (queue->len == 0 && !queue->is_closed)
+        cnd_wait(&queue->not_empty, &queue->lock);
+    if (queue->len == 0) {
+        mtx_unlock(&queue->lock);
+        return NULL;
+    }
+    job_t *job = queue->head;
+    queue->head = job->next;
+    if (queue->head == NULL)
+        queue->tail = NULL;
+    queue->len--;
+    cnd_signal(&queue->not_full);
+    mtx_unlock(&queue->lock);
+    return job;
+}
+
+static void queue_close(queue_t *queue) {
+    mtx_lock(&queue->lock);
+    queue->is_closed = 1;
+    cnd_broadcast(&queue->not_empty);
+    cnd_broadcast(&queue->not_full);
+    mtx_unlock(&queue->lock);
+}
+
+static void job_free(job_t *job) {
+    if (job->owns_body)
+        free((char *)job->body);
+    free(job->frame);
+    free(job);
+}
+
+// queues the response for the writer of the connection, so that a worker never waits for a client
+static void respond(job_t *job, int status, const char *body, size_t body_len, int owns_body) {
+    conn_t *conn = job->conn;
+    put_u32(job->header, SERVE_RESPONSE_HEADER - 4 + body_len);
+    put_u32(job->header + 4, job->req.id);
+    put_u32(job->header + 8, (uint32_t)status);
+    job->body = body;
+    job->body_len = body_len;
+    job->owns_body = owns_body;
+    // the payload isn't needed anymore
+    free(job->frame);
+    job->frame = NULL;
+    job->next = NULL;
+
+    mtx_lock(&conn->lock);
+    if (conn->tail == NULL)
+        conn->head = job;
+    else
+        conn->tail->next = job;
+    conn->tail = job;
+    conn->in_flight--;
+    conn->n_buffered = conn->n_buffered - job->n_reserved + SERVE_RESPONSE_HEADER + body_len;
+    job->n_reserved = SERVE_RESPONSE_HEADER + body_len;
+    cnd_broadcast(&conn->changed);
+    mtx_unlock(&conn->lock);
+}
+
+// renders the requests into a memory stream, since the response starts with the length of the image
+static int run_worker(void *arg) {
+    worker_arg_t *worker_arg = arg;
+    const serve_options_t *options = worker_arg->server->options;
+    job_t *job;
+    while ((job = queue_pop(&worker_arg->server->queue)) != NULL) {
+        int status = SERVE_ERR_BAD_REQUEST;
+        char *image = NULL;
+        size_t image_len = 0;
+        if (job->is_valid) {
+            FILE *out = open_memstream(&image, &image_len);
+            status = out == NULL ? SERVE_ERR_OUTPUT : options->render(worker_arg->worker, &job->req, out);
+            if (out != NULL && fclose(out))
+                status = SERVE_ERR_OUTPUT;
+        }
+        if (status == 0) {
+            respond(job, status, image, image_len, 1);
+        } else {
+            free(image);
+            const char *message = serve_strerror(status);
+            respond(job, status, message, strlen(message), 0);
+        }
+    }
+    return 0;
+}
+
+// writes the responses of a connection until its reader stops and all of them are written, a client that's gone
+// gets the rest of them dropped (and its reader sees the connection closed)
+static int run_writer(void *arg) {
+    conn_t *conn = arg;
+    int is_broken = 0;
+    mtx_lock(&conn->lock);
+    for (;;) {
+        while (conn->head == NULL && !(conn->is_read && conn->in_flight == 0))
+            cnd_wait(&conn->changed, &conn->lock);
+        job_t *job = conn->head;
+        if (job == NULL)
+            break;
+        conn->head = job->next;
+        if (conn->head == NULL)
+            conn->tail = NULL;
+        mtx_unlock(&conn->lock);
+
+        if (!is_broken && (send_full(conn->fd, job->header, SERVE_RESPONSE_HEADER) == -1 ||
+                           send_full(conn->fd, job->body, job->body_len) == -1)) {
+            is_broken = 1;
+            shutdown(conn->fd, SHUT_RDWR);
+        }
+        size_t n_bytes = job->n_reserved;
+        job_free(job);
+
+        mtx_lock(&conn->lock);
+        conn->n_buffered -= n_bytes;
+        cnd_broadcast(&conn->changed);
+    }
+    mtx_unlock(&conn->lock);
+    return 0;
+}
+
+// reads the requests of a connection until it's closed (or sends a malformed frame) and closes it once all of them
+// are answered, its responses are written by a writer of its own
+static int run_reader(void *arg) {
+    reader_arg_t *reader_arg = arg;
+    server_t *server = reader_arg->server;
+    conn_t *conn = reader_arg->conn;
+    free(reader_arg);
+    thrd_t writer;
+    int is_writing = thrd_create(&writer, run_writer, conn) == thrd_success;
+    uint8_t len_buf[4];
+    while (is_writing && read_full(conn->fd, len_buf, sizeof(len_buf)) == 0) {
+        uint32_t len = get_u32(len_buf);
+        if (len < SERVE_REQUEST_HEADER - 4 || len > SERVE_MAX_REQUEST - 4)
+            break;
+        job_t *job = calloc(1, sizeof(job_t));
+        uint8_t *frame = malloc(len);
+        if (job == NULL || frame == NULL || read_full(conn->fd, frame, len) == -1) {
+            free(job);
+            free(frame);
+            break;
+        }
+        job->conn = conn;
+        job->frame = frame;
+        job->is_valid = parse_request(frame, len, &job->req) == 0;
+        job->n_reserved = SERVE_RESPONSE_HEADER + MAX_MESSAGE;
+        if (job->is_valid) {
+            size_t bound = serve_image_bound(job->req.format, job->req.ppm, SERVE_MAX_SIDE, SERVE_MAX_SIDE);
+            job->n_reserved += bound < SERVE_MAX_IMAGE ? bound : SERVE_MAX_IMAGE;
+        }
+
+        // a request that doesn't fit is let in alone, so that its response is the only one in memory
+        mtx_lock(&conn->lock);
+        while (conn->in_flight == MAX_IN_FLIGHT ||
+               (conn->n_buffered > 0 && conn->n_buffered + job->n_reserved > MAX_BUFFERED))
+            cnd_wait(&conn->changed, &conn->lock);
+        conn->in_flight++;
+        conn->n_buffered += job->n_reserved;
+        mtx_unlock(&conn->lock);
+        // the server is stopping
+        if (queue_push(&server->queue, job) == -1) {
+            mtx_lock(&conn->lock);
+            conn->in_flight--;
+            conn->n_buffered -= job->n_reserved;
+            mtx_unlock(&conn->lock);
+            job_free(job);
+            break;
+        }
+    }
+
+    mtx_lock(&conn->lock);
+    conn->is_read = 1;
+    cnd_broadcast(&conn->changed);
+    mtx_unlock(&conn->lock);
+    if (is_writing)
+        thrd_join(writer, NULL);
+    close(conn->fd);
+    mtx_destroy(&conn->lock);
+    cnd_destroy(&conn->changed);
+    free(conn);
+    // the pipe is non-blocking, a full one already wakes the main thread
+    atomic_fetch_sub(&server->n_conns, 1);
+    write(server->wake_fds[1], "", 1);
+    return 0;
+}
+
+// starts the reader of a new connection, closes it on error
+static void accept_conn(server_t *server, int fd) {
+    conn_t *conn = malloc(sizeof(conn_t));
+    reader_arg_t *reader_arg = malloc(sizeof(reader_arg_t));
+    thrd_t reader;
+    if (conn == NULL || reader_arg == NULL) {
+        free(conn);
+        free(reader_arg);
+        close(fd);
+        return;
+    }
+    *conn = (conn_t){.fd = fd};
+    *reader_arg = (reader_arg_t){.server = server, .conn = conn};
+    // counted before the reader starts, since it can end right away
+    atomic_fetch_add(&server->n_conns, 1);
+    if (mtx_init(&conn->lock, mtx_plain) != thrd_success || cnd_init(&conn->changed) != thrd_success ||
+        thrd_create(&reader, run_reader, reader_arg) != thrd_success) {
+        atomic_fetch_sub(&server->n_conns, 1);
+        free(conn);
+        free(reader_arg);
+        close(fd);
+        return;
+    }
+    thrd_detach(reader);
+}
+
+// binds a listening socket at path, replacing a socket left there by a server that's gone (but not a live one,
+// nor any other file)
+static int listen_at(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        int fd = serve_connect(path);
+        if (fd != -1 || !S_ISSOCK(st.st_mode)) {
+            if (fd != -1)
+                close(fd);
+            errno = EADDRINUSE;
+            return -1;
+        }
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve(const char *path, const serve_options_t *options) {
+    static server_t server;
+    server.options = options;
+    int n_workers = options->n_workers, n_started = 0, status = 0;
+    if (queue_init(&server.queue, QUEUE_PER_WORKER * n_workers) == -1)
+        return -1;
+    worker_arg_t *worker_args = calloc(n_workers, sizeof(worker_arg_t));
+    thrd_t *workers = calloc(n_workers, sizeof(thrd_t));
+    if (worker_args == NULL || workers == NULL) {
+        free(worker_args);
+        free(workers);
+        return -1;
+    }
+    for (int i = 0; i < n_workers && status == 0; i++) {
+        worker_args[i] = (worker_arg_t){.server = &server, .worker = options->worker_init(options->ctx)};
+        if (worker_args[i].worker == NULL)
+            status = -1;
+    }
+    int listen_fd = (status == 0 ? listen_at(path) : -1);
+    if (listen_fd == -1)
+        status = -1;
+    // the pipe is left open, since the readers still running write to it until the process exits
+    if (status == 0 && (pipe(server.wake_fds) == -1 || fcntl(server.wake_fds[1], F_SETFL, O_NONBLOCK) == -1))
+        status = -1;
+
+    // SIGINT and SIGTERM are delivered only while the main thread waits for a connection, so that it can remove
+    // the socket, all the other threads (which inherit the mask) have them blocked
+    sigset_t stop_signals, old_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+    struct sigaction action = {.sa_handler = stop};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    for (; n_started < n_workers && status == 0; n_started++) {
+        if (thrd_create(&workers[n_started], run_worker, &worker_args[n_started]) != thrd_success)
+            status = -1;
+    }
+
+    while (status == 0 && !is_stopping) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(server.wake_fds[0], &fds);
+        if (atomic_load(&server.n_conns) < MAX_CONNS)
+            FD_SET(listen_fd, &fds);
+        int n_fds = (listen_fd > server.wake_fds[0] ? listen_fd : server.wake_fds[0]) + 1;
+        if (pselect(n_fds, &fds, NULL, NULL, NULL, &old_mask) == -1) {
+            if (errno == EINTR)
+                continue;
+            status = -1;
+            break;
+        }
+        if (FD_ISSET(server.wake_fds[0], &fds)) {
+            char buf[64];
+            read(server.wake_fds[0], buf, sizeof(buf));
+        }
+        if (FD_ISSET(listen_fd, &fds)) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd != -1)
+                accept_conn(&server, fd);
+        }
+    }
+    if (listen_fd != -1) {
+        close(listen_fd);
+        unlink(path);
+    }
+    // the workers render the requests already queued, the connections are closed by the exit of the process
+    queue_close(&server.queue);
+    for (int i = 0; i < n_started; i++)
+        thrd_join(workers[i], NULL);
+    for (int i = 0; i < n_workers; i++) {
+        if (worker_args[i].worker != NULL)
+            options->worker_free(worker_args[i].worker);
+    }
+    free(worker_args);
+    free(workers);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    return status;
+}
+
+size_t serve_image_bound(int format, int ppm, int width, int height) {
+    uint64_t n_modules = (uint64_t)width * height, row_pixels = (uint64_t)width * ppm, n_rows = (uint64_t)height * ppm;
+    uint64_t n_bytes;
+    switch (format) {
+        case 0:
+            // PNG: no worse than stored blocks (a filter byte per row, 5 bytes per block) and the chunks around them
+            n_bytes = ((row_pixels + 7) / 8 + 1) * n_rows;
+            n_bytes += n_bytes / 256 + 1024;
+            break;
+        case 1:
+        case 2:
+            // SVG and EPS: a rectangle per run of dark modules, each of them under 24 characters
+            n_bytes = n_modules * 24 + 1024;
+            break;
+        case 3:
+            n_bytes = (row_pixels + 7) / 8 * n_rows + 64;
+            break;
+        case 4:
+            n_bytes = row_pixels * n_rows + 64;
+            break;
+        default:
+            n_bytes = (uint64_t)(width + 7) / 8 * height;
+            break;
+    }
+    return n_bytes > SIZE_MAX ? SIZE_MAX : n_bytes;
+}
+
+int serve_connect(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve_send(int fd, const serve_request_t *req) {
+    if (req->payload_len > QUER_MAX_INPUT_LEN) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    uint8_t header[SERVE_REQUEST_HEADER] = {0};
+    put_u32(header, SERVE_REQUEST_HEADER - 4 + req->payload_len);
+    put_u32(header + 4, req->id);
+    header[8] = req->corr_level;
+    header[9] = req->format;
+    header[10] = req->flags;
+    put_u32(header + 12, req->ppm);
+    put_u32(header + 16, req->eci);
+    if (send_full(fd, header, sizeof(header)) == -1)
+        return -1;
+    return send_full(fd, req->payload, req->payload_len);
+}
+
+int serve_receive(int fd, serve_response_t *resp, size_t *body_cap) {
+    uint8_t header[SERVE_RESPONSE_HEADER];
+    if (read_full(fd, header, sizeof(header)) == -1)
+        return -1;
+    uint32_t len = get_u32(header);
+    if (len < SERVE_RESPONSE_HEADER - 4)
+        return -1;
+    resp->id = get_u32(header + 4);
+    resp->status = (int32_t)get_u32(header + 8);
+    resp->body_len = len - (SERVE_RESPONSE_HEADER - 4);
+    if (resp->body_len > *body_cap) {
+        uint8_t *body = realloc(resp->body, resp->body_len);
+        if (body == NULL)
+            return -1;
+        resp->body = body;
+        *body_cap = resp->body_len;
+    }
+    return read_full(fd, resp->body, resp->body_len);
+}
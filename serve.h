@@ -0,0 +1,89 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "quer.h"
+
+// the protocol of `quer --serve` over a Unix domain socket, all the integers are little-endian
+// request:  u32 length (of the rest of the frame), u32 id, u8 error correction level (0-3 for L, M, Q, H),
+//           u8 format (0-5 for png, svg, eps, pbm, pgm, raw), u8 flags (SERVE_FLAG_*), u8 0, u32 ppm, u32 eci
+//           (0 for none), the payload
+// response: u32 length, u32 id (of the request), i32 status (0 or a QUER_ERR_* / SERVE_ERR_* code), the image
+//           (or the error message)
+// a client can send many requests without waiting for the responses, which come in the order in which they're done
+// (the PNG encoder and the cache are the ones given to the server, e.g. `quer --serve socket -e fast`)
+// the responses of a connection are written by a thread of its own, so a client that doesn't read them holds up only
+// itself: the server stops reading its requests while 64 of them are in progress or 16 MiB of its responses (counting
+// the largest size of the ones being rendered) wait to be written
+// the server serves up to 64 connections at once, the ones past them wait to be accepted until another one is closed
+#define SERVE_REQUEST_HEADER 20
+#define SERVE_RESPONSE_HEADER 12
+#define SERVE_MAX_REQUEST (SERVE_REQUEST_HEADER + QUER_MAX_INPUT_LEN)
+#define SERVE_FLAG_MICRO 1
+#define SERVE_FLAG_KANJI 2
+#define SERVE_FLAG_VERIFY 4
+// an rMQR code if the data fits in one (see quer_options_t.rmqr)
+#define SERVE_FLAG_RMQR 8
+// the largest ppm of a request, the size of its image is limited by SERVE_MAX_IMAGE too
+#define SERVE_MAX_PPM 256
+// the largest image a response can carry (images are rendered whole into memory), the requests of larger ones are
+// refused before they're rendered
+#define SERVE_MAX_IMAGE (64 << 20)
+// the side of the largest symbol in modules, its quiet zone included (version 40 with a padding of 35 modules)
+#define SERVE_MAX_SIDE 247
+// the request has invalid fields (the data is fine, but e.g. its format doesn't exist)
+#define SERVE_ERR_BAD_REQUEST -100
+// the image couldn't be written
+#define SERVE_ERR_OUTPUT -101
+// the image would be larger than SERVE_MAX_IMAGE
+#define SERVE_ERR_TOO_LARGE -102
+
+typedef struct serve_request_t {
+    uint32_t id;
+    int corr_level;
+    int format;
+    int flags;
+    int ppm;
+    int eci;
+    const char *payload;
+    size_t payload_len;
+} serve_request_t;
+
+typedef struct serve_response_t {
+    uint32_t id;
+    int status;
+    // the image, or the error message if status isn't 0
+    uint8_t *body;
+    size_t body_len;
+} serve_response_t;
+
+// renders a request into out with the state of one worker, returns 0 or an error status
+typedef int (*serve_render_t)(void *worker, const serve_request_t *req, FILE *out);
+
+typedef struct serve_options_t {
+    int n_workers;
+    // creates the state of a worker (its scratch memory, PNG writer, ...), NULL on error
+    void *(*worker_init)(void *ctx);
+    void (*worker_free)(void *worker);
+    serve_render_t render;
+    void *ctx;
+} serve_options_t;
+
+// accepts connections on a Unix domain socket at path and answers their requests with n_workers threads
+// until SIGINT or SIGTERM, returns -1 if the socket can't be set up
+int serve(const char *path, const serve_options_t *options);
+
+// an upper bound of the size of an image in the format of a request of a symbol of width x height modules (its quiet
+// zone included)
+size_t serve_image_bound(int format, int ppm, int width, int height);
+// connects to a server at path, returns the socket or -1
+int serve_connect(const char *path);
+// sends a request, returns -1 on error
+int serve_send(int fd, const serve_request_t *req);
+// receives a response into resp, resp->body is reallocated as needed (*body_cap bytes), returns -1 on error or EOF
+int serve_receive(int fd, serve_response_t *resp, size_t *body_cap);
+
+#endif  // SERVE_H
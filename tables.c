@@ -0,0 +1,104 @@
+#include "tables.h"
+
+// data capacity (in bytes) for given error correction level and version
+const int CAPACITY[4][41] = {
+    {0,    17,   32,   53,   78,   106,  134,  154,  190,  226,  262,  321,  367,  419,
+     461,  523,  589,  647,  714,  792,  858,  929,  1003, 1091, 1171, 1273, 1367, 1465,
+     1528, 1628, 1732, 1840, 1952, 2068, 2188, 2303, 2431, 2563, 2699, 2809, 2953},
+    {0,    14,   26,   42,   62,   84,   106,  122,  152,  180,  213,  251,  287,  331,
+     362,  412,  450,  504,  560,  624,  666,  711,  779,  857,  911,  997,  1059, 1125,
+     1190, 1264, 1370, 1452, 1538, 1628, 1722, 1809, 1911, 1989, 2099, 2213, 2331},
+    {0,   11,  20,  32,  46,  60,  74,  86,  108, 130, 151,  177,  203,  241,  258,  292,  322,  364,  394,  442, 482,
+     509, 565, 611, 661, 715, 751, 805, 868, 908, 982, 1030, 1112, 1168, 1228, 1283, 1351, 1423, 1499, 1579, 1663},
+    {0,   7,   14,  24,  34,  44,  58,  64,  84,  98,  119, 137, 155, 177, 194, 220,  250,  280,  310,  338, 382,
+     403, 439, 461, 511, 535, 593, 625, 658, 698, 742, 790, 842, 898, 958, 983, 1051, 1093, 1139, 1219, 1273}};
+
+// total number of data codewords for given error correction level and version
+const int TOTAL_DATA_CODEWORDS[4][41] = {
+    {0,    19,   34,   55,   80,   108,  136,  156,  194,  232,  274,  324,  370,  428,
+     461,  523,  589,  647,  721,  795,  861,  932,  1006, 1094, 1174, 1276, 1370, 1468,
+     1531, 1631, 1735, 1843, 1955, 2071, 2191, 2306, 2434, 2566, 2702, 2812, 2956},
+    {0,    16,   28,   44,   64,   86,   108,  124,  154,  182,  216,  254,  290,  334,
+     365,  415,  453,  507,  563,  627,  669,  714,  782,  860,  914,  1000, 1062, 1128,
+     1193, 1267, 1373, 1455, 1541, 1631, 1725, 1812, 1914, 1992, 2102, 2216, 2334},
+    {0,   13,  22,  34,  48,  62,  76,  88,  110, 132, 154,  180,  206,  244,  261,  295,  325,  367,  397,  445, 485,
+     512, 568, 614, 664, 718, 754, 808, 871, 911, 985, 1033, 1115, 1171, 1231, 1286, 1354, 1426, 1502, 1582, 1666},
+    {0,   9,   16,  26,  36,  46,  60,  66,  86,  100, 122, 140, 158, 180, 197, 223,  253,  283,  313,  341, 385,
+     406, 442, 464, 514, 538, 596, 628, 661, 701, 745, 793, 845, 901, 961, 986, 1054, 1096, 1142, 1222, 1276}};
+
+// number of modules (bits) available in the entire code (excluding function patterns) for given version
+const int TOTAL_AVAILABLE_MODULES[41] = {
+    0,     208,   359,   567,   807,   1079,  1383,  1568,  1936,  2336,  2768,  3232,  3728,  4256,
+    4651,  5243,  5867,  6523,  7211,  7931,  8683,  9252,  10068, 10916, 11796, 12708, 13652, 14628,
+    15371, 16411, 17483, 18587, 19723, 20891, 22091, 23008, 24272, 25568, 26896, 28256, 29648};
+
+const int CORR_CODEWORDS_PER_BLOCK[4][41] = {
+    {0,  7,  10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28,
+     28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+    {0,  10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26,
+     26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28},
+    {0,  13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30,
+     28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+    {0,  17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28,
+     30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+};
+
+const int TOTAL_BLOCKS[4][41] = {
+    {0, 1, 1, 1,  1,  1,  2,  2,  2,  2,  4,  4,  4,  4,  4,  6,  6,  6,  6,  7, 8,
+     8, 9, 9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},
+    {0,  1,  1,  1,  2,  2,  4,  4,  4,  5,  5,  5,  8,  9,  9,  10, 10, 11, 13, 14, 16,
+     17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},
+    {0,  1,  1,  2,  2,  4,  4,  6,  6,  8,  8,  8,  10, 12, 16, 12, 17, 16, 18, 21, 20,
+     23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},
+    {0,  1,  1,  2,  4,  4,  4,  5,  6,  8,  8,  11, 11, 16, 16, 18, 16, 19, 21, 25, 25,
+     25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},
+};
+
+// lookup table for encoded version information
+const int VERSION_INFO[41] = {0,       0,       0,       0,       0,       0,       0,       0x07C94, 0x085BC,
+                              0x09A99, 0x0A4D3, 0x0BBF6, 0x0C762, 0x0D847, 0x0E60D, 0x0F928, 0x10B78, 0x1145D,
+                              0x12A17, 0x13532, 0x149A6, 0x15683, 0x168C9, 0x177EC, 0x18EC4, 0x191E1, 0x1AFAB,
+                              0x1B08E, 0x1CC1A, 0x1D33F, 0x1ED75, 0x1F250, 0x209D5, 0x216F0, 0x228BA, 0x2379F,
+                              0x24B0B, 0x2542E, 0x26A64, 0x27541, 0x28C69};
+
+const int MICRO_DATA_BITS[4][5] = {{0, 20, 40, 84, 128}, {0, 0, 32, 68, 112}, {0, 0, 0, 0, 80}, {0, 0, 0, 0, 0}};
+
+const int MICRO_CORR_CODEWORDS[4][5] = {{0, 2, 5, 6, 8}, {0, 0, 6, 8, 10}, {0, 0, 0, 0, 14}, {0, 0, 0, 0, 0}};
+
+const int MICRO_AVAILABLE_MODULES[5] = {0, 36, 80, 132, 192};
+
+const int MICRO_SYMBOL_NUMBER[4][5] = {{0, 0, 1, 3, 5}, {0, 0, 2, 4, 6}, {0, 0, 0, 0, 7}, {0, 0, 0, 0, 0}};
+
+const int MICRO_MASK_PATTERNS[4] = {1, 4, 6, 7};
+
+const int RMQR_WIDTH[33] = {0,  43, 59, 77, 99, 139, 43, 59, 77, 99, 139, 27, 43, 59, 77, 99, 139,
+                            27, 43, 59, 77, 99, 139, 43, 59, 77, 99, 139, 43, 59, 77, 99, 139};
+
+const int RMQR_HEIGHT[33] = {0,  7,  7,  7,  7,  7,  9,  9,  9,  9,  9,  11, 11, 11, 11, 11, 11,
+                             13, 13, 13, 13, 13, 13, 15, 15, 15, 15, 15, 17, 17, 17, 17, 17};
+
+const int RMQR_AVAILABLE_MODULES[33] = {0,   104, 171, 261, 358, 545, 170, 267, 393, 532, 797,
+                                        122, 249, 376, 538, 719, 1062, 172, 329, 486, 684, 907,
+                                        1328, 409, 596, 830, 1095, 1594, 489, 706, 976, 1283, 1860};
+
+const int RMQR_DATA_CODEWORDS[4][33] = {
+    {0},
+    {0,  6,  12, 20, 28, 44, 12, 21, 31, 42, 63, 7,  19, 31, 43,  57, 84,
+     12, 27, 38, 53, 73, 106, 33, 48, 67, 88, 127, 39, 56, 78, 100, 152},
+    {0},
+    {0, 3,  7,  10, 14, 24, 7,  11, 17, 22, 33, 5,  11, 15, 23, 29, 42,
+     7, 13, 20, 29, 35, 54, 15, 26, 31, 48, 69, 21, 28, 38, 56, 76}};
+
+const int RMQR_CORR_CODEWORDS_PER_BLOCK[4][33] = {
+    {0},
+    {0, 7,  9,  12, 16, 24, 9,  12, 18, 24, 18, 8,  12, 16, 24, 16, 24,
+     9, 14, 22, 16, 20, 20, 18, 26, 18, 24, 24, 22, 16, 22, 20, 20},
+    {0},
+    {0,  10, 14, 22, 30, 22, 14, 22, 16, 22, 22, 10, 20, 16, 22, 30, 30,
+     14, 28, 20, 28, 26, 28, 18, 24, 24, 22, 26, 20, 30, 28, 26, 26}};
+
+const int RMQR_BLOCKS[4][33] = {
+    {0},
+    {0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 2, 2, 1, 1, 1, 2, 2, 3, 1, 1, 2, 2, 3, 1, 2, 2, 3, 4},
+    {0},
+    {0, 1, 1, 1, 1, 2, 1, 1, 2, 2, 3, 1, 1, 2, 2, 2, 3, 1, 1, 2, 2, 3, 4, 2, 2, 3, 4, 5, 2, 2, 3, 4, 6}};
@@ -0,0 +1,43 @@
+#ifndef TABLES_H
+#define TABLES_H
+
+// tables from the QR code spec, indexed by the error correction level and/or the version
+
+// data capacity (in bytes) for given error correction level and version
+extern const int CAPACITY[4][41];
+// total number of data codewords for given error correction level and version
+extern const int TOTAL_DATA_CODEWORDS[4][41];
+// number of modules (bits) available in the entire code (excluding function patterns) for given version
+extern const int TOTAL_AVAILABLE_MODULES[41];
+// number of error correction codewords in each block
+extern const int CORR_CODEWORDS_PER_BLOCK[4][41];
+// number of blocks the codewords are split into
+extern const int TOTAL_BLOCKS[4][41];
+// lookup table for encoded version information
+extern const int VERSION_INFO[41];
+
+// the same for the Micro QR versions M1-M4, with 0 for the levels a version doesn't have
+// (M1 only detects errors, it's used for level L, and there's no level H at all)
+// data capacity in bits (the last data codeword of M1 and M3 is only 4 bits long)
+extern const int MICRO_DATA_BITS[4][5];
+// number of error correction codewords (all Micro QR codes have a single block)
+extern const int MICRO_CORR_CODEWORDS[4][5];
+// number of modules available for the codewords
+extern const int MICRO_AVAILABLE_MODULES[5];
+// the symbol number stored in the format info instead of the level
+extern const int MICRO_SYMBOL_NUMBER[4][5];
+// the QR code mask patterns used by the 4 masks of Micro QR codes
+extern const int MICRO_MASK_PATTERNS[4];
+
+// the same for the rMQR versions R7x43, R7x59, ..., R17x139 (numbered from 1 in the order of their version
+// indicators, see quer_options_t.rmqr), with 0 for levels L and Q, which rMQR codes don't have
+// the dimensions in modules
+extern const int RMQR_WIDTH[33];
+extern const int RMQR_HEIGHT[33];
+// number of modules available for the codewords (the remainder bits included)
+extern const int RMQR_AVAILABLE_MODULES[33];
+extern const int RMQR_DATA_CODEWORDS[4][33];
+extern const int RMQR_CORR_CODEWORDS_PER_BLOCK[4][33];
+extern const int RMQR_BLOCKS[4][33];
+
+#endif  // TABLES_H
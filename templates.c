@@ -0,0 +1,452 @@
+#include "templates.h"
+
+#include <stdatomic.h>
+#include <threads.h>
+
+#include "tables.h"
+
+// sum of dim * stride over all versions, the number of words taken by one plane of every version
+// all of the planes of all versions (the code, blocked and the 8 masks) take ~740 KiB
+// sum of TOTAL_AVAILABLE_MODULES over all versions, the placement indices of all versions take another ~860 KiB
+// (and the same for the Micro QR versions, 1 word per row and MICRO_AVAILABLE_MODULES, and the rMQR versions)
+#define ALL_VERSIONS_MODULES 441561
+#define ALL_VERSIONS_WORDS 9458
+#define ALL_MICRO_VERSIONS_MODULES 440
+#define ALL_MICRO_VERSIONS_WORDS 56
+#define ALL_RMQR_VERSIONS_MODULES 20408
+#define ALL_RMQR_VERSIONS_WORDS 672
+#define ALL_WORDS (ALL_VERSIONS_WORDS + ALL_MICRO_VERSIONS_WORDS + ALL_RMQR_VERSIONS_WORDS)
+// the templates of the Micro QR versions come after the ones of the QR versions, followed by the rMQR ones
+#define FIRST_MICRO_TEMPLATE (QUER_MAX_VERSION + 1)
+#define FIRST_RMQR_TEMPLATE (FIRST_MICRO_TEMPLATE + QUER_MAX_MICRO_VERSION)
+#define N_TEMPLATES (FIRST_RMQR_TEMPLATE + QUER_MAX_RMQR_VERSION)
+// of the widest rMQR versions
+#define MAX_RMQR_ALIGNMENT_COLUMNS 4
+
+static int mask0(int i, int j) { return ((i + j) % 2) == 0; }
+static int mask1(int i, int j) {
+    (void)j;
+    return (i % 2) == 0;
+}
+static int mask2(int i, int j) {
+    (void)i;
+    return (j % 3) == 0;
+}
+static int mask3(int i, int j) { return ((i + j) % 3) == 0; }
+static int mask4(int i, int j) { return ((i / 2 + j / 3) % 2) == 0; }
+static int mask5(int i, int j) { return ((i * j) % 2 + (i * j) % 3) == 0; }
+static int mask6(int i, int j) { return (((i * j) % 2 + (i * j) % 3) % 2) == 0; }
+static int mask7(int i, int j) { return (((i + j) % 2 + (i * j) % 3) % 2) == 0; }
+static int (*const masks[N_MASKS])(int, int) = {mask0, mask1, mask2, mask3, mask4, mask5, mask6, mask7};
+
+static void draw_separator(bitset_t *code, int sx, int sy, bitset_t *blocked) {
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            bitset_unset(code, sy + y, sx + x);
+            bitset_set(blocked, sy + y, sx + x);
+        }
+    }
+}
+
+static void draw_finder_pattern(bitset_t *code, int sx, int sy, bitset_t *blocked) {
+    for (int y = 0; y < 7; y++) {
+        for (int x = 0; x < 7; x++) {
+            bitset_set(code, sy + y, sx + x);
+            bitset_set(blocked, sy + y, sx + x);
+        }
+    }
+    for (int y = 0; y < 5; y++) {
+        for (int x = 0; x < 5; x++) {
+            bitset_unset(code, sy + y + 1, sx + x + 1);
+            bitset_set(blocked, sy + y + 1, sx + x + 1);
+        }
+    }
+    for (int y = 0; y < 3; y++) {
+        for (int x = 0; x < 3; x++) {
+            bitset_set(code, sy + y + 2, sx + x + 2);
+            bitset_set(blocked, sy + y + 2, sx + x + 2);
+        }
+    }
+}
+
+static void draw_timing_patterns(bitset_t *code, int sx, int sy, bitset_t *blocked) {
+    int x = sx + 7 + 1;
+    int y = sy + 7 - 1;
+    int flip = 1;
+    for (; x < code->width - 7 - 1; x++) {
+        if (flip == 1)
+            bitset_set(code, y, x);
+        else
+            bitset_unset(code, y, x);
+        bitset_set(blocked, y, x);
+        flip ^= 1;
+    }
+    x = sx + 7 - 1;
+    y = sy + 7 + 1;
+    flip = 1;
+    for (; y < code->height - 7 - 1; y++) {
+        if (flip == 1)
+            bitset_set(code, y, x);
+        else
+            bitset_unset(code, y, x);
+        bitset_set(blocked, y, x);
+        flip ^= 1;
+    }
+}
+
+int get_alignment_pattern_positions(int version, int positions[7]) {
+    if (version == 1)
+        return 0;
+    int count = version / 7 + 2;
+    int delta = (version * 8 + count * 3 + 5) / (count * 4 - 4) * 2;
+    int pos = version * 4 + 10;
+    for (int i = count - 1; i >= 1; i--) {
+        positions[i] = pos;
+        pos -= delta;
+    }
+    positions[0] = 6;
+    return count;
+}
+
+static void draw_alignment_patterns(bitset_t *code, int version, bitset_t *blocked) {
+    int pos[7];
+    int count = get_alignment_pattern_positions(version, pos);
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < count; j++) {
+            // these ones would overlap with the finder patterns
+            // so we can't draw them
+            if ((i == 0 && j == 0) || (i == 0 && j == count - 1) || (i == count - 1 && j == 0))
+                continue;
+
+            for (int y = pos[i] - 2; y <= pos[i] + 2; y++) {
+                for (int x = pos[j] - 2; x <= pos[j] + 2; x++) {
+                    bitset_set(code, y, x);
+                    bitset_set(blocked, y, x);
+                }
+            }
+            for (int y = pos[i] - 1; y <= pos[i] + 1; y++) {
+                for (int x = pos[j] - 1; x <= pos[j] + 1; x++) {
+                    bitset_unset(code, y, x);
+                    bitset_set(blocked, y, x);
+                }
+            }
+            bitset_set(code, pos[i], pos[j]);
+            bitset_set(blocked, pos[i], pos[j]);
+        }
+    }
+}
+
+static void draw_version_pattern(bitset_t *code, int version, int dim, bitset_t *blocked) {
+    int version_info = VERSION_INFO[version];
+    for (int y = 0; y < 6; y++) {
+        for (int x = 0; x < 3; x++) {
+            int b = 3 * y + x;
+            if ((version_info & (1 << b)) == 0) {
+                bitset_unset(code, dim - 11 + x, y);
+                bitset_unset(code, y, dim - 11 + x);
+            } else {
+                bitset_set(code, dim - 11 + x, y);
+                bitset_set(code, y, dim - 11 + x);
+            }
+            bitset_set(blocked, dim - 11 + x, y);
+            bitset_set(blocked, y, dim - 11 + x);
+        }
+    }
+}
+
+static void block_format_info(int dim, bitset_t *blocked) {
+    for (int x = 0; x < 9; x++)
+        bitset_set(blocked, 8, x);
+    for (int y = 0; y < 9; y++)
+        bitset_set(blocked, y, 8);
+    for (int x = 0; x < 8; x++)
+        bitset_set(blocked, 8, dim - 1 - x);
+    for (int y = 0; y < 7; y++)
+        bitset_set(blocked, dim - 1 - y, 8);
+}
+
+void draw_functional_patterns(bitset_t *code, int version, int dim, bitset_t *blocked) {
+    int separator_coords_x[3] = {0, dim - 8, 0};
+    int separator_coords_y[3] = {0, 0, dim - 8};
+    for (int i = 0; i < 3; i++)
+        draw_separator(code, separator_coords_x[i], separator_coords_y[i], blocked);
+    int finder_coords_x[3] = {0, dim - 7, 0};
+    int finder_coords_y[3] = {0, 0, dim - 7};
+    for (int i = 0; i < 3; i++)
+        draw_finder_pattern(code, finder_coords_x[i], finder_coords_y[i], blocked);
+    draw_timing_patterns(code, finder_coords_x[0], finder_coords_y[0], blocked);
+    draw_alignment_patterns(code, version, blocked);
+    if (version >= 7)
+        draw_version_pattern(code, version, dim, blocked);
+    // format info (just block, will be filled in later)
+    block_format_info(dim, blocked);
+    // that single black module in the lower left corner
+    bitset_set(code, dim - 8, 8);
+    bitset_set(blocked, dim - 8, 8);
+}
+
+void draw_micro_functional_patterns(bitset_t *code, int dim, bitset_t *blocked) {
+    // the separator of the only finder pattern runs along its right and bottom edges
+    draw_separator(code, 0, 0, blocked);
+    draw_finder_pattern(code, 0, 0, blocked);
+    // the timing patterns run along the top and left edges of the code
+    for (int i = 8; i < dim; i++) {
+        if (i % 2 == 0) {
+            bitset_set(code, 0, i);
+            bitset_set(code, i, 0);
+        }
+        bitset_set(blocked, 0, i);
+        bitset_set(blocked, i, 0);
+    }
+    // format info (just block, will be filled in later), a single copy next to the finder pattern
+    for (int i = 1; i <= 8; i++) {
+        bitset_set(blocked, 8, i);
+        bitset_set(blocked, i, 8);
+    }
+}
+
+// the columns of the centers of the alignment patterns of rMQR codes, by their width
+static int get_rmqr_alignment_columns(int width, int columns[MAX_RMQR_ALIGNMENT_COLUMNS]) {
+    static const struct {
+        int width;
+        int count;
+        int columns[MAX_RMQR_ALIGNMENT_COLUMNS];
+    } ALIGNMENT_COLUMNS[] = {{27, 0, {0}},          {43, 1, {21}},         {59, 2, {19, 39}},
+                             {77, 2, {25, 51}},     {99, 3, {23, 49, 75}}, {139, 4, {27, 55, 83, 111}}};
+    for (size_t i = 0; i < sizeof(ALIGNMENT_COLUMNS) / sizeof(ALIGNMENT_COLUMNS[0]); i++) {
+        if (ALIGNMENT_COLUMNS[i].width == width) {
+            memcpy(columns, ALIGNMENT_COLUMNS[i].columns, sizeof(ALIGNMENT_COLUMNS[i].columns));
+            return ALIGNMENT_COLUMNS[i].count;
+        }
+    }
+    return 0;
+}
+
+static void draw_module(bitset_t *code, int y, int x, int dark, bitset_t *blocked) {
+    if (dark)
+        bitset_set(code, y, x);
+    else
+        bitset_unset(code, y, x);
+    bitset_set(blocked, y, x);
+}
+
+void draw_rmqr_functional_patterns(bitset_t *code, int width, int height, bitset_t *blocked) {
+    draw_finder_pattern(code, 0, 0, blocked);
+    // the separator runs along the right edge of the finder pattern, and along its bottom edge unless that's the
+    // bottom edge of the code (R7)
+    for (int i = 0; i < 8; i++) {
+        if (i < height)
+            draw_module(code, i, 7, 0, blocked);
+        if (height >= 9)
+            draw_module(code, 7, i, 0, blocked);
+    }
+    // the sub-finder pattern: a 5x5 dark ring around a light ring and a dark center
+    for (int y = height - 5; y < height; y++) {
+        for (int x = width - 5; x < width; x++) {
+            int is_ring = (y == height - 5 || y == height - 1 || x == width - 5 || x == width - 1);
+            draw_module(code, y, x, is_ring || (y == height - 3 && x == width - 3), blocked);
+        }
+    }
+    // the corner patterns in the bottom left and top right corners
+    for (int x = 0; x < 3; x++)
+        draw_module(code, height - 1, x, 1, blocked);
+    if (height >= 11) {
+        draw_module(code, height - 2, 0, 1, blocked);
+        draw_module(code, height - 2, 1, 0, blocked);
+    }
+    draw_module(code, 0, width - 1, 1, blocked);
+    draw_module(code, 0, width - 2, 1, blocked);
+    draw_module(code, 1, width - 1, 1, blocked);
+    draw_module(code, 1, width - 2, 0, blocked);
+    // the alignment patterns, 3x3 dark rings along the top and bottom edges
+    // (with room for the left and right edges, which are appended for the vertical timing patterns below)
+    int columns[MAX_RMQR_ALIGNMENT_COLUMNS + 2];
+    int n_columns = get_rmqr_alignment_columns(width, columns);
+    for (int i = 0; i < n_columns; i++) {
+        for (int y = 0; y < 3; y++) {
+            for (int x = columns[i] - 1; x <= columns[i] + 1; x++) {
+                int is_ring = (y != 1 || x != columns[i]);
+                draw_module(code, y, x, is_ring, blocked);
+                draw_module(code, height - 1 - y, x, is_ring, blocked);
+            }
+        }
+    }
+    // the timing patterns fill what's left of the top and bottom rows, of the left and right columns
+    // and of the columns of the alignment patterns
+    for (int x = 0; x < width; x++) {
+        if (!bitset_get(blocked, 0, x))
+            draw_module(code, 0, x, x % 2 == 0, blocked);
+        if (!bitset_get(blocked, height - 1, x))
+            draw_module(code, height - 1, x, x % 2 == 0, blocked);
+    }
+    columns[n_columns++] = 0;
+    columns[n_columns++] = width - 1;
+    for (int y = 0; y < height; y++) {
+        for (int i = 0; i < n_columns; i++) {
+            if (!bitset_get(blocked, y, columns[i]))
+                draw_module(code, y, columns[i], y % 2 == 0, blocked);
+        }
+    }
+    // format info (just block, will be filled in later), a copy next to each finder pattern
+    for (int i = 0; i < RMQR_FORMAT_INFO_BITS; i++) {
+        for (int copy = 0; copy < 2; copy++) {
+            int r, c;
+            rmqr_format_info_module(width, height, copy, i, &r, &c);
+            bitset_set(blocked, r, c);
+        }
+    }
+}
+
+void draw_data_walk(bitset_t *code, const uint8_t *data, int data_len, int width, int height,
+                    const bitset_t *blocked) {
+    int bit = 7, byte = 0, up = 1;
+    for (int col = width - 1; col >= 1; col -= 2, up ^= 1) {
+        // the "parity" changes after the column of the vertical timing pattern
+        if (col == timing_column(width, height))
+            col--;
+        for (int row = 0; row < height; row++) {
+            for (int side = 0; side <= 1; side++) {
+                int x = col - side;
+                int y = up ? height - 1 - row : row;
+                if (bitset_get(blocked, y, x))
+                    continue;
+                if ((data[byte] & (1 << bit)) > 0)
+                    bitset_set(code, y, x);
+                bit--;
+                if (bit < 0) {
+                    bit = 7;
+                    byte++;
+                }
+                if (byte == data_len)
+                    return;
+            }
+        }
+    }
+    // we ignore remainder bits because they've already been zeroed by default
+}
+
+void draw_data(bitset_t *code, const version_template_t *template, const uint8_t *data, int data_len) {
+    if (template->placement == NULL) {
+        draw_data_walk(code, data, data_len, template->code.width, template->code.height, &template->blocked);
+        return;
+    }
+    const uint16_t *placement = template->placement;
+    for (int byte = 0; byte < data_len; byte++) {
+        // only the dark modules have to be written, the code is zeroed outside of the function patterns
+        unsigned bits = data[byte];
+        while (bits != 0) {
+            int bit = __builtin_ctz(bits);
+            int pos = placement[8 * byte + 7 - bit];
+            code->words[pos / WORD_BITS] |= (uint64_t)1 << (pos % WORD_BITS);
+            bits &= bits - 1;
+        }
+    }
+}
+
+static version_template_t templates[N_TEMPLATES];
+static uint64_t code_words[ALL_WORDS];
+static uint64_t blocked_words[ALL_WORDS];
+static uint64_t mask_words[N_MASKS][ALL_WORDS];
+#ifndef QUER_NO_PLACEMENT_INDEX
+static uint16_t placement_index[ALL_VERSIONS_MODULES + ALL_MICRO_VERSIONS_MODULES + ALL_RMQR_VERSIONS_MODULES];
+#endif
+static atomic_int is_built[N_TEMPLATES];
+static mtx_t build_lock;
+static once_flag build_lock_once = ONCE_FLAG_INIT;
+
+static void init_build_lock(void) { mtx_init(&build_lock, mtx_plain); }
+
+#ifndef QUER_NO_PLACEMENT_INDEX
+// records where every data module goes, in the order of draw_data_walk
+static void build_placement_index(const bitset_t *blocked, uint16_t *placement) {
+    int width = blocked->width, height = blocked->height, i = 0, up = 1;
+    for (int col = width - 1; col >= 1; col -= 2, up ^= 1) {
+        if (col == timing_column(width, height))
+            col--;
+        for (int row = 0; row < height; row++) {
+            int y = up ? height - 1 - row : row;
+            for (int x = col; x >= col - 1; x--) {
+                if (!bitset_get(blocked, y, x))
+                    placement[i++] = y * blocked->stride * WORD_BITS + x;
+            }
+        }
+    }
+}
+#endif
+
+// the dimensions and the number of data modules of the code of template i
+static int template_width(int i) {
+    if (i >= FIRST_RMQR_TEMPLATE)
+        return RMQR_WIDTH[i - FIRST_RMQR_TEMPLATE + 1];
+    return i <= QUER_MAX_VERSION ? 4 * i + 17 : 2 * (i - QUER_MAX_VERSION) + 9;
+}
+
+static int template_height(int i) {
+    return i >= FIRST_RMQR_TEMPLATE ? RMQR_HEIGHT[i - FIRST_RMQR_TEMPLATE + 1] : template_width(i);
+}
+
+static int template_modules(int i) {
+    if (i >= FIRST_RMQR_TEMPLATE)
+        return RMQR_AVAILABLE_MODULES[i - FIRST_RMQR_TEMPLATE + 1];
+    return i <= QUER_MAX_VERSION ? TOTAL_AVAILABLE_MODULES[i] : MICRO_AVAILABLE_MODULES[i - QUER_MAX_VERSION];
+}
+
+static void build_template(int i) {
+    int width = template_width(i), height = template_height(i);
+    int micro = (i >= FIRST_MICRO_TEMPLATE && i < FIRST_RMQR_TEMPLATE), rmqr = (i >= FIRST_RMQR_TEMPLATE);
+    size_t offset = 0, modules_offset = 0;
+    for (int j = QUER_MIN_VERSION; j < i; j++) {
+        offset += bitset_size(template_width(j), template_height(j)) / sizeof(uint64_t);
+        modules_offset += template_modules(j);
+    }
+    size_t n_bytes = bitset_size(width, height);
+    version_template_t *template = &templates[i];
+    bitset_t *code = &template->code, *blocked = &template->blocked;
+    bitset_init_from_buffer(code, width, height, code_words + offset, n_bytes);
+    bitset_init_from_buffer(blocked, width, height, blocked_words + offset, n_bytes);
+    if (micro)
+        draw_micro_functional_patterns(code, width, blocked);
+    else if (rmqr)
+        draw_rmqr_functional_patterns(code, width, height, blocked);
+    else
+        draw_functional_patterns(code, i, width, blocked);
+#ifndef QUER_NO_PLACEMENT_INDEX
+    template->placement = placement_index + modules_offset;
+    build_placement_index(blocked, placement_index + modules_offset);
+#else
+    (void)modules_offset;
+    template->placement = NULL;
+#endif
+
+    int n_masks = (micro ? N_MICRO_MASKS : (rmqr ? 1 : N_MASKS));
+    for (int mask_i = 0; mask_i < n_masks; mask_i++) {
+        bitset_t *mask = &template->masks[mask_i];
+        int pattern = (micro ? MICRO_MASK_PATTERNS[mask_i] : (rmqr ? RMQR_MASK_PATTERN : mask_i));
+        bitset_init_from_buffer(mask, width, height, mask_words[mask_i] + offset, n_bytes);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                if (!bitset_get(blocked, y, x) && masks[pattern](y, x))
+                    bitset_set(mask, y, x);
+            }
+        }
+    }
+}
+
+static const version_template_t *get_template(int i) {
+    if (!atomic_load_explicit(&is_built[i], memory_order_acquire)) {
+        call_once(&build_lock_once, init_build_lock);
+        mtx_lock(&build_lock);
+        if (!atomic_load_explicit(&is_built[i], memory_order_relaxed)) {
+            build_template(i);
+            atomic_store_explicit(&is_built[i], 1, memory_order_release);
+        }
+        mtx_unlock(&build_lock);
+    }
+    return &templates[i];
+}
+
+const version_template_t *get_version_template(int version) { return get_template(version); }
+
+const version_template_t *get_micro_template(int version) { return get_template(QUER_MAX_VERSION + version); }
+
+const version_template_t *get_rmqr_template(int version) { return get_template(FIRST_RMQR_TEMPLATE + version - 1); }
@@ -0,0 +1,73 @@
+#ifndef TEMPLATES_H
+#define TEMPLATES_H
+
+#include "bitset.h"
+#include "quer.h"
+
+#define N_MASKS 8
+// Micro QR codes have only 4 masks (see MICRO_MASK_PATTERNS), stored in the first 4 masks of their templates
+#define N_MICRO_MASKS 4
+// rMQR codes have a single mask (QR code mask pattern 4), stored in the first mask of their templates
+#define RMQR_MASK_PATTERN 4
+// the bits of the format info of rMQR codes, each stored next to both of their finder patterns
+#define RMQR_FORMAT_INFO_BITS 18
+
+// everything about a code that depends only on its version
+// built on first use and then shared (read-only) by all encodes, from any thread
+typedef struct version_template_t {
+    // the function patterns, every code starts as a copy of it
+    bitset_t code;
+    // the modules taken by function patterns and reserved for the format info
+    bitset_t blocked;
+    // the modules flipped by each mask, i.e. the mask pattern limited to the data modules
+    bitset_t masks[N_MASKS];
+    // bit i of the codewords goes to bit placement[i] of code.words (NULL if built with QUER_NO_PLACEMENT_INDEX)
+    const uint16_t *placement;
+} version_template_t;
+
+const version_template_t *get_version_template(int version);
+// the same for the Micro QR versions M1-M4
+const version_template_t *get_micro_template(int version);
+// and for the rMQR versions R7x43-R17x139 (numbered from 1)
+const version_template_t *get_rmqr_template(int version);
+// draws the finder, separator, timing, alignment and version patterns, the modules they take
+// (and the ones reserved for the format info) are set in blocked
+void draw_functional_patterns(bitset_t *code, int version, int dim, bitset_t *blocked);
+// the same for a Micro QR code: a single finder pattern in the top left corner, its separator and the timing patterns
+// along the top and left edges
+void draw_micro_functional_patterns(bitset_t *code, int dim, bitset_t *blocked);
+// the same for an rMQR code: the finder pattern in the top left corner, the sub-finder pattern in the bottom right
+// one, the corner patterns of the other two corners, the alignment patterns along the top and bottom edges
+// and the timing patterns joining them (along all the edges and through the alignment patterns)
+void draw_rmqr_functional_patterns(bitset_t *code, int width, int height, bitset_t *blocked);
+// the row and column of bit i of the format info of an rMQR code, next to the finder pattern (copy 0)
+// or to the sub-finder pattern (copy 1)
+static inline void rmqr_format_info_module(int width, int height, int copy, int i, int *r, int *c) {
+    if (copy == 0) {
+        *r = 1 + i % 5;
+        *c = 8 + i / 5;
+    } else if (i < 15) {
+        *r = height - 6 + i % 5;
+        *c = width - 8 + i / 5;
+    } else {
+        *r = height - 6;
+        *c = width - 20 + i;
+    }
+}
+// the column of the vertical timing pattern, which the zigzag of the data modules skips
+// (column 6 of QR codes, but the left edge of Micro QR codes, which are the ones smaller than 21 x 21, and the right
+// edge of rMQR codes, the only ones that aren't square)
+static inline int timing_column(int width, int height) {
+    if (width != height)
+        return width - 1;
+    return width < 21 ? 0 : 6;
+}
+// places the data_len codewords in the data modules of a code which has only the function patterns drawn
+void draw_data(bitset_t *code, const version_template_t *template, const uint8_t *data, int data_len);
+// same as draw_data, but walks the zigzag over the code module by module instead of using the placement index
+void draw_data_walk(bitset_t *code, const uint8_t *data, int data_len, int width, int height,
+                    const bitset_t *blocked);
+// returns the number of alignment pattern rows/columns, with their coordinates in positions
+int get_alignment_pattern_positions(int version, int positions[7]);
+
+#endif  // TEMPLATES_H
@@ -0,0 +1,178 @@
+#include "verify.h"
+
+#include "decoder.h"
+#include "reed_solomon.h"
+#include "segments.h"
+#include "tables.h"
+#include "templates.h"
+
+#define PAD_CODEWORD_0 0xEC
+#define PAD_CODEWORD_1 0x11
+// the codewords of M4
+#define MAX_MICRO_CODEWORDS 24
+
+static int is_format_module(int r, int c, int dim, int micro) {
+    if (micro)
+        return (r == 8 && c >= 1 && c <= 8) || (c == 8 && r >= 1 && r <= 8);
+    if (r == 8)
+        return (c <= 8 && c != 6) || c >= dim - 8;
+    if (c == 8)
+        return (r <= 8 && r != 6) || r >= dim - 7;
+    return 0;
+}
+
+static int is_rmqr_format_module(int r, int c, int width, int height) {
+    for (int i = 0; i < RMQR_FORMAT_INFO_BITS; i++) {
+        for (int copy = 0; copy < 2; copy++) {
+            int format_r, format_c;
+            rmqr_format_info_module(width, height, copy, i, &format_r, &format_c);
+            if (r == format_r && c == format_c)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// checks that the finder, timing, alignment and version patterns (and the dark module) weren't touched by the mask
+static int check_function_patterns(const bitset_t* code, const version_template_t* template, int micro, int rmqr) {
+    int dim = code->width;
+    for (int r = 0; r < code->height; r++) {
+        const uint64_t* row = bitset_const_row(code, r);
+        const uint64_t* expected = bitset_const_row(&template->code, r);
+        const uint64_t* blocked = bitset_const_row(&template->blocked, r);
+        for (int w = 0; w < code->stride; w++) {
+            uint64_t diff = (row[w] ^ expected[w]) & blocked[w];
+            while (diff != 0) {
+                int c = w * WORD_BITS + __builtin_ctzll(diff);
+                if (rmqr ? !is_rmqr_format_module(r, c, code->width, code->height)
+                         : !is_format_module(r, c, dim, micro))
+                    return -1;
+                diff &= diff - 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// whatever is left of the terminator and the last byte must be zeros, the rest alternates the pad codewords
+// (but for the last 4-bit data codeword of M1 and M3, padded with zeros)
+static int check_padding(const uint8_t* codewords, int n_bits, int end_bits) {
+    int first_pad = (end_bits + 7) / 8;
+    if (end_bits % 8 != 0 && (codewords[end_bits / 8] & (0xFF >> (end_bits % 8))) != 0)
+        return -1;
+    for (int i = first_pad; i < n_bits / 8; i++) {
+        if (codewords[i] != ((i - first_pad) % 2 == 0 ? PAD_CODEWORD_0 : PAD_CODEWORD_1))
+            return -1;
+    }
+    if (n_bits % 8 != 0 && first_pad <= n_bits / 8 && codewords[n_bits / 8] != 0)
+        return -1;
+    return 0;
+}
+
+static int verify_micro_code(const bitset_t* code, int version, enum quer_corr_level_t corr_level, const uint8_t* data,
+                             int data_len) {
+    uint8_t bits[MAX_MICRO_CODEWORDS];
+    uint8_t block[MAX_MICRO_CODEWORDS];
+    uint8_t syndromes[MAX_MICRO_CODEWORDS];
+    uint8_t decoded[QUER_MAX_INPUT_LEN];
+    if (version < QUER_MIN_VERSION || version > QUER_MAX_MICRO_VERSION || code->width != 2 * version + 9 ||
+        code->height != code->width || MICRO_DATA_BITS[(int)corr_level][version] == 0)
+        return -1;
+    const version_template_t* template = get_micro_template(version);
+
+    int mask = -1, info = read_micro_format_info(code);
+    for (int mask_i = 0; mask_i < N_MICRO_MASKS; mask_i++) {
+        if (info == micro_format_info_bits(version, corr_level, mask_i))
+            mask = mask_i;
+    }
+    if (mask == -1 || check_function_patterns(code, template, 1, 0) == -1)
+        return -1;
+
+    // a single block, whose error correction codewords start in the middle of a byte after the 4-bit data codeword
+    // of M1 and M3
+    int n_data_bits = MICRO_DATA_BITS[(int)corr_level][version];
+    int n_corr_codewords = MICRO_CORR_CODEWORDS[(int)corr_level][version];
+    int n_data_codewords = (n_data_bits + 7) / 8, shift = n_data_bits % 8;
+    if (read_codewords(code, &template->blocked, MICRO_MASK_PATTERNS[mask], bits,
+                       MICRO_AVAILABLE_MODULES[version]) == -1)
+        return -1;
+    memcpy(block, bits, n_data_codewords);
+    for (int j = 0; j < n_corr_codewords; j++) {
+        int k = n_data_codewords + j;
+        block[k] = (shift == 0 ? bits[k] : (bits[k - 1] << shift | bits[k] >> (8 - shift)) & 0xFF);
+    }
+    if (shift != 0)
+        block[n_data_codewords - 1] &= 0xFF << (8 - shift);
+    if (!compute_syndromes(block, n_data_codewords + n_corr_codewords, n_corr_codewords, syndromes))
+        return -1;
+
+    int eci, append, end_bits;
+    int len = decode_segments(block, n_data_bits, micro_version_group(version), decoded, QUER_MAX_INPUT_LEN, &eci,
+                              &append, &end_bits);
+    if (len != data_len || memcmp(decoded, data, len) != 0)
+        return -1;
+    return check_padding(block, n_data_bits, end_bits);
+}
+
+// rMQR codes have a single mask and the blocks of QR codes, but both copies of their format info must be intact
+static int verify_rmqr_code(const bitset_t* code, int version, enum quer_corr_level_t corr_level, const uint8_t* data,
+                            int data_len, int eci) {
+    uint8_t codewords[MAX_CODEWORDS];
+    uint8_t data_codewords[MAX_DATA_CODEWORDS];
+    uint8_t decoded[QUER_MAX_INPUT_LEN];
+    if (version < QUER_MIN_VERSION || version > QUER_MAX_RMQR_VERSION || code->width != RMQR_WIDTH[version] ||
+        code->height != RMQR_HEIGHT[version] || RMQR_DATA_CODEWORDS[(int)corr_level][version] == 0)
+        return -1;
+    const version_template_t* template = get_rmqr_template(version);
+    for (int copy = 0; copy < 2; copy++) {
+        if (read_rmqr_format_info(code, copy) != rmqr_format_info_bits(version, corr_level, copy))
+            return -1;
+    }
+    if (check_function_patterns(code, template, 0, 1) == -1)
+        return -1;
+
+    int n_data_codewords = RMQR_DATA_CODEWORDS[(int)corr_level][version];
+    if (read_codewords(code, &template->blocked, RMQR_MASK_PATTERN, codewords,
+                       RMQR_AVAILABLE_MODULES[version] / 8 * 8) == -1 ||
+        read_blocks(codewords, corr_level, version, 1, 0, data_codewords) == -1)
+        return -1;
+    int read_eci, append, end_bits;
+    int len = decode_segments(data_codewords, n_data_codewords * 8, rmqr_version_group(version), decoded,
+                              QUER_MAX_INPUT_LEN, &read_eci, &append, &end_bits);
+    if (len != data_len || read_eci != eci || append != -1 || memcmp(decoded, data, len) != 0)
+        return -1;
+    return check_padding(data_codewords, n_data_codewords * 8, end_bits);
+}
+
+int verify_code(const bitset_t* code, int micro, int rmqr, int version, enum quer_corr_level_t corr_level,
+                const uint8_t* data, int data_len, int eci, int append) {
+    if (micro)
+        return eci == 0 && append == -1 ? verify_micro_code(code, version, corr_level, data, data_len) : -1;
+    if (rmqr)
+        return append == -1 ? verify_rmqr_code(code, version, corr_level, data, data_len, eci) : -1;
+    uint8_t codewords[MAX_CODEWORDS];
+    uint8_t data_codewords[MAX_DATA_CODEWORDS];
+    uint8_t decoded[QUER_MAX_INPUT_LEN];
+    if (version < QUER_MIN_VERSION || version > QUER_MAX_VERSION || code->width != 4 * version + 17 ||
+        code->height != code->width)
+        return -1;
+    const version_template_t* template = get_version_template(version);
+
+    // both copies of the format info must be intact and agree with the level
+    enum quer_corr_level_t read_corr_level;
+    int mask, info = read_format_info(code, 0);
+    if (info != read_format_info(code, 1) || decode_format_info(info, &read_corr_level, &mask) != 0 ||
+        read_corr_level != corr_level || check_function_patterns(code, template, 0, 0) == -1)
+        return -1;
+
+    int n_data_codewords = TOTAL_DATA_CODEWORDS[(int)corr_level][version];
+    if (read_codewords(code, &template->blocked, mask, codewords, TOTAL_AVAILABLE_MODULES[version] / 8 * 8) == -1 ||
+        read_blocks(codewords, corr_level, version, 0, 0, data_codewords) == -1)
+        return -1;
+    int read_eci, read_append, end_bits;
+    int len = decode_segments(data_codewords, n_data_codewords * 8, version_group(version), decoded,
+                              QUER_MAX_INPUT_LEN, &read_eci, &read_append, &end_bits);
+    if (len != data_len || read_eci != eci || read_append != append || memcmp(decoded, data, len) != 0)
+        return -1;
+    return check_padding(data_codewords, n_data_codewords * 8, end_bits);
+}
@@ -0,0 +1,19 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdint.h>
+
+#include "bitset.h"
+#include "quer.h"
+
+// reads an encoded code back the way a scanner would: decodes the format info, unmasks the data modules,
+// follows the zigzag, deinterleaves the blocks, checks their Reed-Solomon syndromes and decodes the segments
+// returns 0 if the code is intact and holds exactly data (with the given ECI, Structured Append header, as stored by
+// decode_segments, and error correction level), -1 otherwise
+// micro is set for the Micro QR versions M1-M4 (without ECI and Structured Append), rmqr for the rMQR versions
+// R7x43-R17x139 (without Structured Append)
+// doesn't allocate (needs a few KiB of stack)
+int verify_code(const bitset_t* code, int micro, int rmqr, int version, enum quer_corr_level_t corr_level,
+                const uint8_t* data, int data_len, int eci, int append);
+
+#endif  // VERIFY_H